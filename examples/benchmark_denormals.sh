@@ -0,0 +1,36 @@
+#!/bin/bash
+
+if [ "$#" = 0 ]
+then
+  echo "Usage:"
+  echo "  $0 file1.cfg [file2.cfg ...]"
+  echo "Run each scene with subnormal numbers kept and then flushed to"
+  echo "zero, and report the time per frame in the first and second half"
+  echo "of the simulation (when the absorbing border contains decaying"
+  echo "fields), the fraction of the final electric field that is"
+  echo "subnormal and the relative error of flushing in the final"
+  echo "electric field (E) and the mean Poynting vector (S), for example:"
+  echo "  $0 circle10.cfg microwave_oven.cfg lens.cfg"
+  exit
+fi
+
+
+# Decide which component(s) of the electric field will be simulated
+POL=z
+#POL=xy
+#POL=xyz
+
+# Loop through all command-line arguments, treating each as a config
+# file
+for CFGFILE in $@
+do
+  if [ ! -r $CFGFILE ]
+  then
+    echo "Error: \"$CFGFILE\" is not a readable file"
+    exit 1
+  fi
+
+  echo "$CFGFILE:"
+  cat default/domain.cfg default/$POL.cfg $CFGFILE \
+      | ../src/maxwell2d_benchmark - benchmark=denormals
+done
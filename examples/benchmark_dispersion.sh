@@ -0,0 +1,36 @@
+#!/bin/bash
+
+if [ "$#" = 0 ]
+then
+  echo "Usage:"
+  echo "  $0 file1.cfg [file2.cfg ...]"
+  echo "Run each scene with the standard and then the fourth-order"
+  echo "stencil (stencil_order 4), and report the time per frame of each,"
+  echo "the error in the phase speed of waves at the resolution of the"
+  echo "scene, and the number of pixels per wavelength each needs to keep"
+  echo "that error below 1%, 0.5% and 0.1%, followed by a table of the"
+  echo "phase speed error against resolution, for example:"
+  echo "  $0 circle10.cfg"
+  exit
+fi
+
+
+# Decide which component(s) of the electric field will be simulated
+POL=z
+#POL=xy
+#POL=xyz
+
+# Loop through all command-line arguments, treating each as a config
+# file
+for CFGFILE in $@
+do
+  if [ ! -r $CFGFILE ]
+  then
+    echo "Error: \"$CFGFILE\" is not a readable file"
+    exit 1
+  fi
+
+  echo "$CFGFILE:"
+  cat default/domain.cfg default/$POL.cfg $CFGFILE \
+      | ../src/maxwell2d_benchmark - benchmark=dispersion
+done
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+if [ "$#" = 0 ]
+then
+  echo "Usage:"
+  echo "  $0 file1.cfg [file2.cfg ...]"
+  echo "Run each scene in double and single precision, and with the"
+  echo "fields stored in bfloat16, and report the time taken and the"
+  echo "relative error of the last two in the final electric field (E)"
+  echo "and the mean Poynting vector (S), for example:"
+  echo "  $0 circle10.cfg microwave_oven.cfg lens.cfg"
+  exit
+fi
+
+
+# Decide which component(s) of the electric field will be simulated
+POL=z
+#POL=xy
+#POL=xyz
+
+# Loop through all command-line arguments, treating each as a config
+# file
+for CFGFILE in $@
+do
+  if [ ! -r $CFGFILE ]
+  then
+    echo "Error: \"$CFGFILE\" is not a readable file"
+    exit 1
+  fi
+
+  echo "$CFGFILE:"
+  cat default/domain.cfg default/$POL.cfg $CFGFILE \
+      | ../src/maxwell2d_benchmark -
+done
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+if [ "$#" = 0 ]
+then
+  echo "Usage:"
+  echo "  $0 file1.cfg [file2.cfg ...]"
+  echo "For the grid size and polarization of each scene, time short runs"
+  echo "with different numbers of threads, kernels, temporal blocking and"
+  echo "concurrent streams, and store the fastest settings in the tuning"
+  echo "cache of this machine, ~/.maxwell2d_tuning.<hostname>, from which"
+  echo "later runs of the same grid take them automatically, for example:"
+  echo "  $0 circle10.cfg microwave_oven.cfg"
+  exit
+fi
+
+
+# Decide which component(s) of the electric field will be simulated
+POL=z
+#POL=xy
+#POL=xyz
+
+# Loop through all command-line arguments, treating each as a config
+# file
+for CFGFILE in $@
+do
+  if [ ! -r $CFGFILE ]
+  then
+    echo "Error: \"$CFGFILE\" is not a readable file"
+    exit 1
+  fi
+
+  echo "$CFGFILE:"
+  cat default/domain.cfg default/$POL.cfg $CFGFILE \
+      | ../src/maxwell2d_benchmark - benchmark=tune
+done
@@ -0,0 +1,572 @@
+/* main_benchmark.c -- Program code for maxwell2d_benchmark to compare
+   the speed and accuracy of the simulation in single and double
+   precision, with and without subnormal numbers flushed to zero, or
+   with the standard and the fourth-order stencil, and to tune the
+   settings for this machine
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "maxwell.h"
+
+/* Return the current wall-clock time in seconds */
+static
+double
+wall_time()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+/* Copy "field" to the next nx*ny elements of "dest" */
+static
+double *
+copy_field(double *dest, real **field, int nx, int ny)
+{
+  int i, j;
+  for (j = 0; j < ny; j++) {
+    for (i = 0; i < nx; i++) {
+      *dest++ = field[j][i];
+    }
+  }
+  return dest;
+}
+
+/* Run the simulation with the configuration in "config", including
+   any ensemble and Bloch partners, without writing any output, and
+   store how long it took, how long the second half of it took and the
+   final fields of each member in "benchmark". If "benchmark_frames"
+   is set, stop after that many frames. */
+int
+mw_run_benchmark(rc_data *config, mwBenchmark *benchmark)
+{
+  mwDomain domain;
+  mwDomain *members;
+  double start, middle = 0.0, duration, subnormal = 0.0;
+  double *E, *S;
+  int nmembers, nxy, i, m, frames = 0;
+
+  if (mw_start(config, &domain)
+      || mw_new_ensemble(&domain, &members, &nmembers)) {
+    return MW_FAILURE;
+  }
+  duration = members->duration;
+  rc_assign_int(config, "benchmark_frames", &frames);
+  if (frames > 0 && frames*MW_MINOR_STEPS*members->dt < duration) {
+    duration = frames*MW_MINOR_STEPS*members->dt;
+  }
+
+  benchmark->early_frames = 0;
+  start = wall_time();
+  while (members->time < duration
+	 && (frames <= 0 || members->iframe < frames)) {
+    if (!middle && members->time >= 0.5*duration) {
+      middle = wall_time();
+      benchmark->early_frames = members->iframe;
+    }
+    MW_CHECK(mw_frame_ensemble(members, nmembers));
+  }
+  benchmark->seconds = wall_time() - start;
+  benchmark->late_seconds = middle ? start + benchmark->seconds - middle : 0.0;
+  benchmark->late_frames = members->iframe - benchmark->early_frames;
+
+  benchmark->courant = 0.5*members->c*members->dt/members->dx;
+  benchmark->wavelength = benchmark->courant
+    /(members->primary_frequency*members->dt);
+  benchmark->nx = members->nx;
+  benchmark->ny = members->ny;
+  benchmark->mode = members->mode;
+  benchmark->nE = (((members->mode & MW_MODE_EZ) ? 1 : 0)
+		   + ((members->mode & MW_MODE_EXY) ? 2 : 0))*nmembers;
+  benchmark->nS = 2*nmembers;
+  nxy = members->nx*members->ny;
+  benchmark->E = (double*) malloc(sizeof(double)*benchmark->nE*nxy);
+  benchmark->S = (double*) malloc(sizeof(double)*benchmark->nS*nxy);
+  if (!benchmark->E || !benchmark->S) {
+    fprintf(stderr, "Error allocating the benchmark results\n");
+    return MW_FAILURE;
+  }
+  E = benchmark->E;
+  S = benchmark->S;
+  for (m = 0; m < nmembers; m++) {
+    mwDomain *member = members+m;
+    subnormal += mw_count_subnormals(member->Ez, member->nx, member->ny)
+      + mw_count_subnormals(member->Ex, member->nx, member->ny)
+      + mw_count_subnormals(member->Ey, member->nx, member->ny);
+    if (member->mode & MW_MODE_EZ) {
+      E = copy_field(E, member->Ez, member->nx, member->ny);
+    }
+    if (member->mode & MW_MODE_EXY) {
+      E = copy_field(E, member->Ex, member->nx, member->ny);
+      E = copy_field(E, member->Ey, member->nx, member->ny);
+    }
+    for (i = 0; i < nxy; i++) {
+      S[i] = member->Poynting_x[0][i];
+      S[nxy+i] = member->Poynting_y[0][i];
+    }
+    S += 2*nxy;
+  }
+  benchmark->subnormal = subnormal/((double) benchmark->nE*nxy);
+
+  mw_free_ensemble(members, nmembers);
+  return MW_SUCCESS;
+}
+
+/* This file is compiled in both precisions, but main() is only
+   needed once */
+#ifndef MW_DOUBLE
+
+/* Return the root-mean-square difference between the n elements of
+   "test" and "reference", divided by the root-mean-square of
+   "reference" */
+static
+double
+relative_error(const double *test, const double *reference, int n)
+{
+  double diff2 = 0.0, ref2 = 0.0;
+  int i;
+  for (i = 0; i < n; i++) {
+    diff2 += (test[i]-reference[i])*(test[i]-reference[i]);
+    ref2 += reference[i]*reference[i];
+  }
+  return ref2 > 0.0 ? sqrt(diff2/ref2) : sqrt(diff2);
+}
+
+/* Run the scene described by the configuration in double and single
+   precision, and then with the fields stored in bfloat16, and print
+   how long each took and how far its final electric field and mean
+   Poynting vector are from those in double precision, which is taken
+   as the reference */
+static
+int
+benchmark_precision(rc_data *config)
+{
+  mwBenchmark reference, test, bf16;
+  int nxy;
+
+  if (mwd_run_benchmark(config, &reference)) {
+    return MW_FAILURE;
+  }
+  rc_register(config, "precision", "float");
+  if (mw_run_benchmark(config, &test)) {
+    return MW_FAILURE;
+  }
+  rc_register(config, "precision", "bf16");
+  if (mw_run_benchmark(config, &bf16)) {
+    return MW_FAILURE;
+  }
+  nxy = reference.nx*reference.ny;
+
+  printf("precision    seconds  speed-up   E error   S error\n");
+  printf("double    %10.3f %9.2f %9.2g %9.2g\n",
+	 reference.seconds, 1.0, 0.0, 0.0);
+  printf("float     %10.3f %9.2f %9.2g %9.2g\n",
+	 test.seconds, reference.seconds/test.seconds,
+	 relative_error(test.E, reference.E, reference.nE*nxy),
+	 relative_error(test.S, reference.S, reference.nS*nxy));
+  printf("bf16      %10.3f %9.2f %9.2g %9.2g\n",
+	 bf16.seconds, reference.seconds/bf16.seconds,
+	 relative_error(bf16.E, reference.E, reference.nE*nxy),
+	 relative_error(bf16.S, reference.S, reference.nS*nxy));
+
+  free(reference.E);
+  free(reference.S);
+  free(test.E);
+  free(test.S);
+  free(bf16.E);
+  free(bf16.S);
+  return MW_SUCCESS;
+}
+
+/* Run the scene described by the configuration in the precision it
+   selects, first without and then with subnormal numbers flushed to
+   zero, and print the time per frame in the first half of the
+   simulation and in the second, by which time the absorbing border
+   and any lossy materials contain decaying fields. Also print the
+   fraction of the final electric field that is subnormal, and the
+   error of the flushed run relative to the other. */
+static
+int
+benchmark_denormals(rc_data *config, int precision)
+{
+  mwBenchmark reference, test;
+  int (*run)(rc_data *, mwBenchmark *) = mw_run_benchmark;
+  int nxy;
+
+  if (precision == MW_PRECISION_DOUBLE) {
+    run = mwd_run_benchmark;
+  }
+  rc_register(config, "flush_denormals", "0");
+  if (run(config, &reference)) {
+    return MW_FAILURE;
+  }
+  rc_register(config, "flush_denormals", "1");
+  if (run(config, &test)) {
+    return MW_FAILURE;
+  }
+  nxy = reference.nx*reference.ny;
+
+  printf("flush   s/frame early  s/frame late  subnormal   E error   S error\n");
+  printf("off  %15.3g %13.3g %10.2g %9.2g %9.2g\n",
+	 (reference.seconds-reference.late_seconds)/reference.early_frames,
+	 reference.late_seconds/reference.late_frames,
+	 reference.subnormal, 0.0, 0.0);
+  printf("on   %15.3g %13.3g %10.2g %9.2g %9.2g\n",
+	 (test.seconds-test.late_seconds)/test.early_frames,
+	 test.late_seconds/test.late_frames, test.subnormal,
+	 relative_error(test.E, reference.E, reference.nE*nxy),
+	 relative_error(test.S, reference.S, reference.nS*nxy));
+
+  free(reference.E);
+  free(reference.S);
+  free(test.E);
+  free(test.S);
+  return MW_SUCCESS;
+}
+
+/* Return the spatial difference of the stencil of the given order
+   (2 or 4) applied to a wave exp(ikx), as a multiple of
+   2i*exp(ikx)/dx, where "k" is the wavenumber times the pixel
+   spacing */
+static
+double
+stencil_difference(int order, double k)
+{
+  if (order == 4) {
+    return 9.0/8.0*sin(0.5*k) - sin(1.5*k)/24.0;
+  }
+  return sin(0.5*k);
+}
+
+/* Return the fractional error in the phase speed of a plane wave with
+   "ppw" pixels per wavelength travelling at "angle" radians to the x
+   axis, for the stencil of the given order and Courant number
+   "courant". The phase W through which the wave advances in each
+   timestep satisfies sin(W/2) = courant*sqrt(Dx^2 + Dy^2), where Dx
+   and Dy are the stencil differences along x and y, whereas the true
+   value is W = courant*k. */
+static
+double
+phase_speed_error(int order, double courant, double ppw, double angle)
+{
+  double k = 2.0*M_PI/ppw;
+  double dx = stencil_difference(order, k*cos(angle));
+  double dy = stencil_difference(order, k*sin(angle));
+  return 2.0*asin(courant*sqrt(dx*dx+dy*dy))/(courant*k) - 1.0;
+}
+
+/* Return the largest magnitude of the phase speed error over the
+   directions of travel from 0 to 45 degrees */
+static
+double
+worst_phase_speed_error(int order, double courant, double ppw)
+{
+  double worst = 0.0;
+  int angle;
+  for (angle = 0; angle <= 45; angle += 5) {
+    double error = fabs(phase_speed_error(order, courant, ppw,
+					  angle*M_PI/180.0));
+    if (error > worst) {
+      worst = error;
+    }
+  }
+  return worst;
+}
+
+/* Return the smallest number of pixels per wavelength for which the
+   phase speed error is below "tolerance" at that and every finer
+   resolution (the error of the fourth-order stencil changes sign, so
+   is not monotonic) */
+static
+double
+pixels_per_wavelength(int order, double courant, double tolerance)
+{
+  double ppw;
+  for (ppw = 100.0; ppw > 2.0; ppw -= 0.01) {
+    if (worst_phase_speed_error(order, courant, ppw) > tolerance) {
+      break;
+    }
+  }
+  return ppw + 0.01;
+}
+
+/* Run the scene described by the configuration in the precision it
+   selects with the standard and then the fourth-order stencil, and
+   print the time per frame of each, the error in the phase speed of
+   waves at the primary frequency at the resolution of the scene, and
+   the number of pixels per wavelength that each needs to keep the
+   phase speed error below 1%, 0.5% and 0.1% in every direction. Then
+   print the phase speed error along a grid axis and along a diagonal
+   as a function of resolution. */
+static
+int
+benchmark_dispersion(rc_data *config, int precision)
+{
+  mwBenchmark result[2];
+  int (*run)(rc_data *, mwBenchmark *) = mw_run_benchmark;
+  const double tolerance[3] = { 1.0e-2, 5.0e-3, 1.0e-3 };
+  const double ppw[9] = { 4, 5, 6, 8, 10, 15, 20, 30, 40 };
+  double courant;
+  int k, l;
+
+  if (precision == MW_PRECISION_DOUBLE) {
+    run = mwd_run_benchmark;
+  }
+  rc_register(config, "stencil_order", "2");
+  if (run(config, result)) {
+    return MW_FAILURE;
+  }
+  rc_register(config, "stencil_order", "4");
+  if (run(config, result+1)) {
+    return MW_FAILURE;
+  }
+  courant = result[0].courant;
+
+  printf("Courant number %g, %.3g pixels per wavelength\n",
+	 courant, result[0].wavelength);
+  printf("stencil    s/frame  phase speed error  pixels per wavelength for error below\n");
+  printf("                    at this resolution       1%%    0.5%%    0.1%%\n");
+  for (k = 0; k < 2; k++) {
+    int order = 2*(k+1);
+    printf("%-6d %11.3g %19.2e", order,
+	   result[k].seconds/(result[k].early_frames+result[k].late_frames),
+	   phase_speed_error(order, courant, result[k].wavelength, 0.0));
+    for (l = 0; l < 3; l++) {
+      printf(" %8.1f", pixels_per_wavelength(order, courant, tolerance[l]));
+    }
+    printf("\n");
+  }
+
+  printf("\npixels per  phase speed error, stencil 2  phase speed error, stencil 4\n");
+  printf("wavelength        0 deg        45 deg          0 deg        45 deg\n");
+  for (l = 0; l < 9; l++) {
+    printf("%10g", ppw[l]);
+    for (k = 0; k < 2; k++) {
+      printf(" %13.2e %13.2e",
+	     phase_speed_error(2*(k+1), courant, ppw[l], 0.0),
+	     phase_speed_error(2*(k+1), courant, ppw[l], 0.25*M_PI));
+    }
+    printf("\n");
+  }
+
+  for (k = 0; k < 2; k++) {
+    free(result[k].E);
+    free(result[k].S);
+  }
+  return MW_SUCCESS;
+}
+
+/* Register each name=value pair of the space-separated "settings" in
+   "config" */
+static
+int
+register_settings(rc_data *config, const char *settings)
+{
+  char copy[256];
+  char *setting;
+  strncpy(copy, settings, sizeof(copy)-1);
+  copy[sizeof(copy)-1] = '\0';
+  for (setting = strtok(copy, " "); setting; setting = strtok(NULL, " ")) {
+    char *value = strchr(setting, '=');
+    if (value) {
+      *value++ = '\0';
+      if (!rc_register(config, setting, value)) {
+	fprintf(stderr, "Error registering config variable \"%s\"\n", setting);
+	return MW_FAILURE;
+      }
+    }
+  }
+  return MW_SUCCESS;
+}
+
+/* Run the scene with "settings" added to "config" three times and
+   return the shortest time per frame, or a negative number if the
+   settings cannot be used on this machine */
+static
+double
+time_settings(rc_data *config, int (*run)(rc_data *, mwBenchmark *),
+	      const char *settings)
+{
+  double best = -1.0;
+  int k;
+  if (register_settings(config, settings)) {
+    return -1.0;
+  }
+  for (k = 0; k < 3; k++) {
+    mwBenchmark result;
+    double seconds;
+    if (run(config, &result)) {
+      printf("%-70s %10s\n", settings, "unusable");
+      return -1.0;
+    }
+    seconds = result.seconds/(result.early_frames+result.late_frames);
+    if (best < 0.0 || seconds < best) {
+      best = seconds;
+    }
+    free(result.E);
+    free(result.S);
+  }
+  printf("%-70s %10.3g\n", settings, best);
+  return best;
+}
+
+/* Find the fastest settings for the grid size, polarization and
+   precision of the scene on this machine, and store them in the
+   tuning cache for mw_start to use in later runs. The whole domain
+   is updated from the start, rather than just the region the waves
+   have reached, and only "benchmark_frames" frames (default 20) are
+   run for each candidate. The number of threads is chosen first, with
+   the default kernels and no blocking, then the kernels, then between
+   the plain pass through the rows, temporal blocking with various
+   block widths and concurrent streams. */
+static
+int
+benchmark_tune(rc_data *config, int precision)
+{
+  const char *kernels[3] = { "scalar", "avx2", "avx512" };
+  const int block_cols[5] = { 64, 128, 256, 512, 1024 };
+  const char *plain = "temporal_blocking=0 concurrent_streams=0";
+  int (*run)(rc_data *, mwBenchmark *) = mw_run_benchmark;
+  mwBenchmark scene;
+  char settings[256], best_settings[256], layout[64];
+  char best_kernel[16] = "auto";
+  double best = -1.0, seconds;
+  int max_threads = mw_set_threads(0);
+  int best_threads = 1, frames = 20, nthreads, k;
+
+  if (precision == MW_PRECISION_DOUBLE) {
+    run = mwd_run_benchmark;
+  }
+  rc_register(config, "use_tuning", "0");
+  rc_register(config, "active_region", "0");
+  rc_assign_int(config, "benchmark_frames", &frames);
+
+  /* Find the grid size and mode */
+  rc_register(config, "benchmark_frames", "1");
+  if (run(config, &scene)) {
+    return MW_FAILURE;
+  }
+  free(scene.E);
+  free(scene.S);
+  sprintf(settings, "%d", frames);
+  rc_register(config, "benchmark_frames", settings);
+  printf("Tuning a %d x %d domain with up to %d threads\n",
+	 scene.nx, scene.ny, max_threads);
+  printf("%-70s %10s\n", "settings", "s/frame");
+
+  /* Try powers of two and the maximum itself */
+  nthreads = 1;
+  for (;;) {
+    sprintf(settings, "threads=%d kernel=auto %s", nthreads, plain);
+    seconds = time_settings(config, run, settings);
+    if (seconds >= 0.0 && (best < 0.0 || seconds < best)) {
+      best = seconds;
+      best_threads = nthreads;
+    }
+    if (nthreads >= max_threads) {
+      break;
+    }
+    nthreads = nthreads*2 < max_threads ? nthreads*2 : max_threads;
+  }
+
+  for (k = 0; k < 3; k++) {
+    sprintf(settings, "threads=%d kernel=%s %s", best_threads, kernels[k],
+	    plain);
+    seconds = time_settings(config, run, settings);
+    if (seconds >= 0.0 && seconds < best) {
+      best = seconds;
+      strcpy(best_kernel, kernels[k]);
+    }
+  }
+
+  sprintf(best_settings, "threads=%d kernel=%s %s", best_threads,
+	  best_kernel, plain);
+  for (k = 0; k < 6; k++) {
+    if (k < 5) {
+      /* Blocks as wide as the domain gain nothing */
+      if (k > 0 && block_cols[k-1] >= scene.nx) {
+	continue;
+      }
+      sprintf(layout, "temporal_blocking=1 block_cols=%d", block_cols[k]);
+    }
+    else {
+      /* Streams need at least two of them and two threads */
+      if (best_threads < 2
+	  || (!((scene.mode & MW_MODE_EZ) && (scene.mode & MW_MODE_EXY))
+	      && !(scene.mode & MW_MODE_VACUUM))) {
+	continue;
+      }
+      strcpy(layout, "temporal_blocking=0 concurrent_streams=1");
+    }
+    sprintf(settings, "threads=%d kernel=%s %s", best_threads, best_kernel,
+	    layout);
+    seconds = time_settings(config, run, settings);
+    if (seconds >= 0.0 && seconds < best) {
+      best = seconds;
+      strcpy(best_settings, settings);
+    }
+  }
+
+  printf("Fastest: %s (%.3g s/frame)\n", best_settings, best);
+  return mw_save_tuning(config, scene.nx, scene.ny, scene.mode, precision,
+			best_settings);
+}
+
+/* Compare precisions, or if the "benchmark" config variable is
+   "denormals", compare running with and without flushing subnormal
+   numbers to zero, or if it is "dispersion", compare the standard
+   and the fourth-order stencils, or if it is "tune", find and store
+   the fastest settings for the scene's grid on this machine */
+int
+main(int argc, char **argv)
+{
+  char *benchmark = NULL;
+  int precision, status;
+
+  /* Read the configuration from command-line arguments and standard
+     input */
+  rc_data *config = mw_read_config(argc, argv);
+  if (!config || mw_get_precision(config, &precision)) {
+    exit(1);
+  }
+
+  rc_assign_string(config, "benchmark", &benchmark);
+  if (benchmark && strcmp(benchmark, "denormals") == 0) {
+    status = benchmark_denormals(config, precision);
+  }
+  else if (benchmark && strcmp(benchmark, "dispersion") == 0) {
+    status = benchmark_dispersion(config, precision);
+  }
+  else if (benchmark && strcmp(benchmark, "tune") == 0) {
+    status = benchmark_tune(config, precision);
+  }
+  else if (!benchmark || strcmp(benchmark, "precision") == 0) {
+    status = benchmark_precision(config);
+  }
+  else {
+    fprintf(stderr, "Config variable \"benchmark\" must be \"precision\", \"denormals\", \"dispersion\" or \"tune\"\n");
+    status = MW_FAILURE;
+  }
+  exit(status);
+}
+
+#endif
@@ -21,38 +21,90 @@
 #include <stdlib.h>
 #include "maxwell.h"
 
+/* Run the simulation with the configuration in "config", writing an
+   animated gif file to standard output, or to the file named by
+   "gif_file" if present. An ensemble cannot share standard output,
+   so each member writes a file named after "gif_file" (by default
+   "maxwell.gif") with its index appended. */
 int
-main(int argc, char **argv)
+mw_run_gif(rc_data *config)
 {
   mwDomain domain;
+  mwDomain *members;
+  int nmembers, m;
   char *epsilon_plot_file = NULL;
+  char *gif_file = NULL;
 
-  /* Initialize the domain based on command-line arguments and
-     standard input */
-  if (mw_start(argc, argv, &domain)) {
-    exit(1);
+  /* Initialize the domain based on the configuration, and the
+     ensemble of simulations of it (usually just one) */
+  if (mw_start(config, &domain)
+      || mw_new_ensemble(&domain, &members, &nmembers)) {
+    return MW_FAILURE;
   }
 
   /* Write out a plot of the dielectric constant if required */
-  rc_assign_string(domain.config, "epsilon_gif_file", 
+  rc_assign_string(config, "epsilon_gif_file", 
 		   &epsilon_plot_file);
   if (epsilon_plot_file) {
-    mw_gif_write_epsilon(epsilon_plot_file, &domain);
+    mw_gif_write_epsilon(epsilon_plot_file, members);
   }
 
-  /* Initialize a gif file to be written to standard output */
-  mw_gif_init(NULL, &domain);
+  /* Initialize a gif file for each member */
+  rc_assign_string(config, "gif_file", &gif_file);
+  if (!gif_file && nmembers > 1) {
+    gif_file = "maxwell.gif";
+  }
+  for (m = 0; m < nmembers; m++) {
+    char *filename = NULL;
+    if (gif_file && !(filename = mw_member_filename(gif_file, members+m))) {
+      return MW_FAILURE;
+    }
+    if (mw_gif_init(filename, members+m)) {
+      fprintf(stderr, "Error opening gif file\n");
+      return MW_FAILURE;
+    }
+    if (filename) {
+      free(filename);
+    }
+  }
 
   /* Continue simulation until the total required time has elapsed */
-  while (domain.time < domain.duration) {
-    /* Write a frame to a gif file */
-    mw_gif_write_frame(&domain);
+  while (members->time < members->duration) {
+    /* Write a frame to each gif file */
+    for (m = 0; m < nmembers; m++) {
+      mw_gif_write_frame(members+m);
+    }
     fprintf(stderr, ".");
 
-    /* Move the simulation forward one frame (7 timesteps) */
-    mw_frame(&domain);
+    /* Move the simulations forward one frame (7 timesteps) */
+    mw_frame_ensemble(members, nmembers);
   }
   fprintf(stderr, "\n");
-  mw_gif_close();
-  exit(0);
+  for (m = 0; m < nmembers; m++) {
+    mw_gif_close(members+m);
+  }
+  mw_free_ensemble(members, nmembers);
+  return MW_SUCCESS;
+}
+
+/* This file is compiled in both precisions, but main() is only
+   needed once */
+#ifndef MW_DOUBLE
+int
+main(int argc, char **argv)
+{
+  int precision;
+
+  /* Read the configuration from command-line arguments and standard
+     input */
+  rc_data *config = mw_read_config(argc, argv);
+  if (!config || mw_get_precision(config, &precision)) {
+    exit(1);
+  }
+
+  if (precision == MW_PRECISION_DOUBLE) {
+    exit(mwd_run_gif(config));
+  }
+  exit(mw_run_gif(config));
 }
+#endif
@@ -0,0 +1,212 @@
+/* main_mpi.c -- Run the simulation divided among MPI processes
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "maxwell.h"
+
+/* Run the simulation with the configuration in "config", each process
+   advancing one band of the rows of the domain (see mw_mpi.c), and
+   write a NetCDF file from the first process */
+int
+mw_run_mpi(rc_data *config, int argc, char **argv)
+{
+  mwDomain domain, band;
+  char *nc_file = NULL;
+  int rank, nc_skip;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  /* Every process initializes the whole domain, then keeps only its
+     band, except the first process, which writes out the whole
+     domain */
+  if (mw_start(config, &domain)) {
+    return MW_FAILURE;
+  }
+  if (rc_exists(config, "ensemble_frequency")
+      || rc_exists(config, "ensemble_amplitude")) {
+    fprintf(stderr, "An ensemble cannot be divided among processes\n");
+    return MW_FAILURE;
+  }
+  if (rank == 0) {
+    rc_assign_string(config, "nc_file", &nc_file);
+    if (mw_nc_init(nc_file ? nc_file : "maxwell.nc", &domain, argc, argv)) {
+      return MW_FAILURE;
+    }
+  }
+  if (mw_mpi_split(&domain, &band)) {
+    return MW_FAILURE;
+  }
+  if (rank > 0) {
+    mw_free_domain(&domain);
+  }
+  nc_skip = rc_get_boolean(config, "nc_skip_time_dependent_fields");
+
+  /* Continue simulation until the total required time has elapsed */
+  while (band.time < band.duration) {
+    /* Gather the bands and write a frame to the netcdf file */
+    if (!nc_skip) {
+      if (mw_mpi_gather_fields(&band, &domain)) {
+	return MW_FAILURE;
+      }
+      if (rank == 0 && mw_nc_write_frame(&domain)) {
+	return MW_FAILURE;
+      }
+    }
+    if (rank == 0) {
+      fprintf(stderr, ".");
+    }
+
+    /* Move the simulation forward one frame (7 timesteps) */
+    if (mw_mpi_frame(&band)) {
+      return MW_FAILURE;
+    }
+  }
+
+  /* Gather the Poynting vector data, which the following function
+     writes to the netcdf file before closing it */
+  if (mw_mpi_gather_sums(&band, &domain)) {
+    return MW_FAILURE;
+  }
+  if (rank == 0) {
+    fprintf(stderr, "\n");
+    if (mw_nc_close(&domain)) {
+      return MW_FAILURE;
+    }
+    mw_free_domain(&domain);
+  }
+  mw_free_domain(&band);
+  return MW_SUCCESS;
+}
+
+/* This file is compiled in both precisions, but main() is only
+   needed once */
+#ifndef MW_DOUBLE
+
+/* Read the configuration from command-line arguments and standard
+   input in the first process, which is the only one that can read
+   standard input, and send it to the others as a sequence of
+   variables, each a name with any dimensions followed by "=" and the
+   value or by "-" if there is no value */
+static
+rc_data *
+read_config(int argc, char **argv)
+{
+  rc_data *config = NULL, *data;
+  char *buffer = NULL, *c;
+  int length = 0, rank;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank == 0) {
+    config = mw_read_config(argc, argv);
+    if (!config) {
+      length = -1;
+    }
+    for (data = config; data && data->param; data = data->next) {
+      char name[256];
+      int size;
+      if (data->n > 0) {
+	snprintf(name, sizeof(name), "%s[%d][%d]",
+		 data->param, data->m, data->n);
+      }
+      else if (data->m > 0) {
+	snprintf(name, sizeof(name), "%s[%d]", data->param, data->m);
+      }
+      else {
+	snprintf(name, sizeof(name), "%s", data->param);
+      }
+      size = strlen(name) + 2 + (data->value ? strlen(data->value)+1 : 0);
+      buffer = (char*) realloc(buffer, length+size);
+      if (!buffer) {
+	fprintf(stderr, "Error allocating the configuration to send\n");
+	MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      strcpy(buffer+length, name);
+      length += strlen(name)+1;
+      if (data->value) {
+	buffer[length++] = '=';
+	strcpy(buffer+length, data->value);
+	length += strlen(data->value)+1;
+      }
+      else {
+	buffer[length++] = '-';
+      }
+    }
+  }
+
+  MPI_Bcast(&length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (length < 0) {
+    return NULL;
+  }
+  if (rank > 0) {
+    buffer = (char*) malloc(length+1);
+    config = rc_read(NULL, stderr);
+    if (!buffer || !config) {
+      fprintf(stderr, "Error allocating the configuration received\n");
+      return NULL;
+    }
+  }
+  if (length > 0) {
+    MPI_Bcast(buffer, length, MPI_CHAR, 0, MPI_COMM_WORLD);
+  }
+  for (c = buffer; rank > 0 && c < buffer+length; ) {
+    char *name = c;
+    c += strlen(name)+1;
+    if (*c++ == '=') {
+      rc_register(config, name, c);
+      c += strlen(c)+1;
+    }
+    else {
+      rc_register(config, name, NULL);
+    }
+  }
+  if (buffer) {
+    free(buffer);
+  }
+  return config;
+}
+
+int
+main(int argc, char **argv)
+{
+  rc_data *config;
+  int precision, status;
+
+  MPI_Init(&argc, &argv);
+
+  /* Any process that fails stops all of them, since the others
+     would otherwise wait for it forever */
+  config = read_config(argc, argv);
+  if (!config || mw_get_precision(config, &precision)) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  if (precision == MW_PRECISION_DOUBLE) {
+    status = mwd_run_mpi(config, argc, argv);
+  }
+  else {
+    status = mw_run_mpi(config, argc, argv);
+  }
+  if (status != MW_SUCCESS) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  MPI_Finalize();
+  exit(0);
+}
+#endif
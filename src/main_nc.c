@@ -21,42 +21,76 @@
 #include <stdlib.h>
 #include "maxwell.h"
 
+/* Run the simulation with the configuration in "config", writing a
+   NetCDF file for each member of the ensemble */
 int
-main(int argc, char **argv)
+mw_run_nc(rc_data *config, int argc, char **argv)
 {
   mwDomain domain;
+  mwDomain *members;
+  int nmembers, m;
   char *nc_file = NULL;
 
-  /* Initialize the domain based on command-line arguments and
-     standard input */
-  if (mw_start(argc, argv, &domain)) {
-    exit(1);
+  /* Initialize the domain based on the configuration, and the
+     ensemble of simulations of it (usually just one) */
+  if (mw_start(config, &domain)
+      || mw_new_ensemble(&domain, &members, &nmembers)) {
+    return MW_FAILURE;
   }
 
   /* Determine the name of the netcdf file to write, and initialize
      it */
-  rc_assign_string(domain.config, "nc_file", &nc_file);
-  if (nc_file) {
-    mw_nc_init(nc_file, &domain, argc, argv);
-  }
-  else {
-    mw_nc_init("maxwell.nc", &domain, argc, argv);
+  rc_assign_string(config, "nc_file", &nc_file);
+  for (m = 0; m < nmembers; m++) {
+    char *filename = mw_member_filename(nc_file ? nc_file : "maxwell.nc",
+					members+m);
+    if (!filename || mw_nc_init(filename, members+m, argc, argv)) {
+      return MW_FAILURE;
+    }
+    free(filename);
   }
 
   /* Continue simulation until the total required time has elapsed */
-  while (domain.time < domain.duration) {
-    /* Write a frame to a netcdf file */
-    mw_nc_write_frame(&domain);
+  while (members->time < members->duration) {
+    /* Write a frame to each netcdf file */
+    for (m = 0; m < nmembers; m++) {
+      mw_nc_write_frame(members+m);
+    }
     fprintf(stderr, ".");
 
-    /* Move the simulation forward one frame (7 timesteps) */
-    mw_frame(&domain);
+    /* Move the simulations forward one frame (7 timesteps) */
+    mw_frame_ensemble(members, nmembers);
 
   }
   fprintf(stderr, "\n");
 
   /* The following function writes the Poynting vector data to the
      netcdf file then closes it */
-  mw_nc_close(&domain);
-  exit(0);
+  for (m = 0; m < nmembers; m++) {
+    mw_nc_close(members+m);
+  }
+  mw_free_ensemble(members, nmembers);
+  return MW_SUCCESS;
+}
+
+/* This file is compiled in both precisions, but main() is only
+   needed once */
+#ifndef MW_DOUBLE
+int
+main(int argc, char **argv)
+{
+  int precision;
+
+  /* Read the configuration from command-line arguments and standard
+     input */
+  rc_data *config = mw_read_config(argc, argv);
+  if (!config || mw_get_precision(config, &precision)) {
+    exit(1);
+  }
+
+  if (precision == MW_PRECISION_DOUBLE) {
+    exit(mwd_run_nc(config, argc, argv));
+  }
+  exit(mw_run_nc(config, argc, argv));
 }
+#endif
@@ -31,8 +31,158 @@ extern "C" {
   fprintf(stderr, "Error at line %d of " __FILE__ "\n", __LINE__); \
   return MW_FAILURE; }
 
-/* For double-precision, change this to double */
+/* Fields are stored in single precision unless compiled with
+   -DMW_DOUBLE. The Makefile compiles the simulation both ways into
+   the same program and the "precision" config variable chooses
+   between them at run time, so in double precision every function
+   that depends on "real" is renamed from mw_* to mwd_* by the macros
+   below. The time and the Poynting vector summation are accumulated
+   in double precision either way. */
+#ifdef MW_DOUBLE
+#define real double
+#define MW_NAME(name) mwd_##name
+#else
 #define real float
+#define MW_NAME(name) mw_##name
+#endif
+
+#define mw_subtract MW_NAME(subtract)
+#define mw_scale MW_NAME(scale)
+#define mw_scale_sum MW_NAME(scale_sum)
+#define mw_start MW_NAME(start)
+#define mw_frame MW_NAME(frame)
+#define mw_set_forcing MW_NAME(set_forcing)
+#define mw_set_source MW_NAME(set_source)
+#define mw_apply_sources MW_NAME(apply_sources)
+#define mw_apply_sources_bf16 MW_NAME(apply_sources_bf16)
+#define mw_free_sources MW_NAME(free_sources)
+#define mw_shift_sources MW_NAME(shift_sources)
+#define mw_grow_active MW_NAME(grow_active)
+#define mw_poynting_tm MW_NAME(poynting_tm)
+#define mw_poynting_te MW_NAME(poynting_te)
+#define mw_new_field MW_NAME(new_field)
+#define mw_free_field MW_NAME(free_field)
+#define mw_new_sum MW_NAME(new_sum)
+#define mw_free_sum MW_NAME(free_sum)
+#define mw_new_domain MW_NAME(new_domain)
+#define mw_free_domain MW_NAME(free_domain)
+#define mw_reset_field MW_NAME(reset_field)
+#define mw_shift_field MW_NAME(shift_field)
+#define mw_reset_damping MW_NAME(reset_damping)
+#define mw_add_circle MW_NAME(add_circle)
+#define mw_add_edge MW_NAME(add_edge)
+#define mw_add_gradient MW_NAME(add_gradient)
+#define mw_add_ripple MW_NAME(add_ripple)
+#define mw_add_dish MW_NAME(add_dish)
+#define mw_add_rectangle MW_NAME(add_rectangle)
+#define mw_add_rotated_rectangle MW_NAME(add_rotated_rectangle)
+#define mw_add_wave_packet MW_NAME(add_wave_packet)
+#define mw_add_lens MW_NAME(add_lens)
+#define mw_add_cavity MW_NAME(add_cavity)
+#define mw_add_shapes MW_NAME(add_shapes)
+#define mw_print_field MW_NAME(print_field)
+#define mw_visualize_field MW_NAME(visualize_field)
+#define mw_step MW_NAME(step)
+#define mw_step_ensemble MW_NAME(step_ensemble)
+#define mw_new_ensemble MW_NAME(new_ensemble)
+#define mw_frame_ensemble MW_NAME(frame_ensemble)
+#define mw_free_ensemble MW_NAME(free_ensemble)
+#define mw_init_ensemble_coefficients MW_NAME(init_ensemble_coefficients)
+#define mw_member_filename MW_NAME(member_filename)
+#define mw_init_coefficients MW_NAME(init_coefficients)
+#define mw_update_coefficients MW_NAME(update_coefficients)
+#define mw_init_materials MW_NAME(init_materials)
+#define mw_index_materials MW_NAME(index_materials)
+#define mw_shift_materials MW_NAME(shift_materials)
+#define mw_free_materials MW_NAME(free_materials)
+#define mw_set_conductor MW_NAME(set_conductor)
+#define mw_init_conductors MW_NAME(init_conductors)
+#define mw_shift_conductors MW_NAME(shift_conductors)
+#define mw_free_conductors MW_NAME(free_conductors)
+#define mw_step_tm_E MW_NAME(step_tm_E)
+#define mw_step_tm_B MW_NAME(step_tm_B)
+#define mw_step_te_E MW_NAME(step_te_E)
+#define mw_step_te_B MW_NAME(step_te_B)
+#define mw_step_blocked MW_NAME(step_blocked)
+#define mw_step_streams MW_NAME(step_streams)
+#define mw_step_lod MW_NAME(step_lod)
+#define mw_free_lod MW_NAME(free_lod)
+#define mw_step_bf16 MW_NAME(step_bf16)
+#define mw_free_bf16 MW_NAME(free_bf16)
+#define mw_row_coefficients MW_NAME(row_coefficients)
+#define mw_update_range MW_NAME(update_range)
+#define mw_next_run MW_NAME(next_run)
+#define mw_row_segments MW_NAME(row_segments)
+#define mw_new_cpml MW_NAME(new_cpml)
+#define mw_free_cpml MW_NAME(free_cpml)
+#define mw_cpml_tm_E MW_NAME(cpml_tm_E)
+#define mw_cpml_tm_B MW_NAME(cpml_tm_B)
+#define mw_cpml_te_E MW_NAME(cpml_te_E)
+#define mw_cpml_te_B MW_NAME(cpml_te_B)
+#define mw_wrap_tm_E MW_NAME(wrap_tm_E)
+#define mw_wrap_tm_B MW_NAME(wrap_tm_B)
+#define mw_wrap_te_E MW_NAME(wrap_te_E)
+#define mw_wrap_te_B MW_NAME(wrap_te_B)
+#define mw_split_bloch_sources MW_NAME(split_bloch_sources)
+#define mw_mirror_tm_E MW_NAME(mirror_tm_E)
+#define mw_mirror_tm_B MW_NAME(mirror_tm_B)
+#define mw_mirror_te_E MW_NAME(mirror_te_E)
+#define mw_mirror_te_B MW_NAME(mirror_te_B)
+#define mw_mirror_E_rows MW_NAME(mirror_E_rows)
+#define mw_mirror_B_rows MW_NAME(mirror_B_rows)
+#define mw_full_size MW_NAME(full_size)
+#define mw_unfold MW_NAME(unfold)
+#define mw_parity MW_NAME(parity)
+#define mw_new_mesh MW_NAME(new_mesh)
+#define mw_free_mesh MW_NAME(free_mesh)
+#define mw_grade_axis MW_NAME(grade_axis)
+#define mw_set_mesh MW_NAME(set_mesh)
+#define mw_mesh_index MW_NAME(mesh_index)
+#define mw_mesh_position MW_NAME(mesh_position)
+#define mw_coordinate MW_NAME(coordinate)
+#define mw_new_subgrid MW_NAME(new_subgrid)
+#define mw_free_subgrid MW_NAME(free_subgrid)
+#define mw_patch MW_NAME(patch)
+#define mw_save_subgrid MW_NAME(save_subgrid)
+#define mw_step_subgrid MW_NAME(step_subgrid)
+#define mw_move_window MW_NAME(move_window)
+#define mw_crop_field MW_NAME(crop_field)
+#define mw_crop_materials MW_NAME(crop_materials)
+#define mw_crop_conductors MW_NAME(crop_conductors)
+#define mw_crop_sources MW_NAME(crop_sources)
+#define mw_mpi_split MW_NAME(mpi_split)
+#define mw_mpi_frame MW_NAME(mpi_frame)
+#define mw_mpi_gather_fields MW_NAME(mpi_gather_fields)
+#define mw_mpi_gather_sums MW_NAME(mpi_gather_sums)
+#define mw_count_subnormals MW_NAME(count_subnormals)
+#define mw_report_subnormals MW_NAME(report_subnormals)
+#define mw_select_kernels MW_NAME(select_kernels)
+#define mw_kernels_scalar MW_NAME(kernels_scalar)
+#define mw_kernels_avx2 MW_NAME(kernels_avx2)
+#define mw_kernels_avx512 MW_NAME(kernels_avx512)
+#define mw_kernels_fourth_order MW_NAME(kernels_fourth_order)
+#define mw_kernels_graded MW_NAME(kernels_graded)
+#define mw_nc_init MW_NAME(nc_init)
+#define mw_nc_write_frame MW_NAME(nc_write_frame)
+#define mw_nc_close MW_NAME(nc_close)
+#define mw_gif_init MW_NAME(gif_init)
+#define mw_gif_write_frame MW_NAME(gif_write_frame)
+#define mw_gif_close MW_NAME(gif_close)
+#define mw_gif_write_epsilon MW_NAME(gif_write_epsilon)
+#define mw_susceptibility MW_NAME(susceptibility)
+#define mw_find_boundaries MW_NAME(find_boundaries)
+#define mw_find_boundary_rows MW_NAME(find_boundary_rows)
+#define mw_run_gif MW_NAME(run_gif)
+#define mw_run_nc MW_NAME(run_nc)
+#define mw_run_benchmark MW_NAME(run_benchmark)
+#define mw_run_mpi MW_NAME(run_mpi)
+
+/* The precisions that the "precision" config variable can select;
+   "bf16" stores the fields in bfloat16 but computes in single
+   precision (see mw_bf16.c) */
+#define MW_PRECISION_FLOAT 0
+#define MW_PRECISION_DOUBLE 1
+#define MW_PRECISION_BF16 2
 
 /* Error codes reported by functions */
 #define MW_SUCCESS 0
@@ -50,9 +200,249 @@ extern "C" {
 #define MW_MODE_EZ (1L<<1)
 #define MW_MODE_EXY (1L<<2)
 
+/* The parts of the domain updated by the row functions: the main
+   fields and the parallel simulation in vacuum, which are independent
+   of each other until the scattered field is computed */
+#define MW_PART_MAIN (1L<<0)
+#define MW_PART_VACUUM (1L<<1)
+#define MW_PART_ALL (MW_PART_MAIN | MW_PART_VACUUM)
+
+/* The maximum Courant number, c*dt/(2*dx), for which the standard
+   and the fourth-order stencils are stable in 2D */
+#define MW_COURANT_LIMIT_2 0.70710678118654752
+#define MW_COURANT_LIMIT_4 (6.0/7.0*MW_COURANT_LIMIT_2)
+
+/* The time integrators: the explicit leapfrog scheme of mw_step, and
+   the implicit scheme of mw_step_lod, which is stable for any
+   timestep */
+#define MW_INTEGRATOR_EXPLICIT 0
+#define MW_INTEGRATOR_LOD 1
+
+/* How the E and B fields are stored while they are advanced: as
+   "real", or as bfloat16 by mw_step_bf16 */
+#define MW_STORAGE_REAL 0
+#define MW_STORAGE_BF16 1
+
+/* The edges of the domain that are periodic (see mw_periodic.c)
+   rather than absorbing */
+#define MW_PERIODIC_X (1L<<0)
+#define MW_PERIODIC_Y (1L<<1)
+
+/* The kinds of mirror-symmetry plane that can lie along the left and
+   bottom edges of the domain (see mw_symmetry.c), and the bits
+   returned by mw_parity for quantities that change sign across the
+   plane at x=0 and/or y=0 */
+#define MW_SYMMETRY_NONE 0
+#define MW_SYMMETRY_PEC 1
+#define MW_SYMMETRY_PMC 2
+#define MW_ODD_X (1L<<0)
+#define MW_ODD_Y (1L<<1)
+
+/* The fields are surrounded by MW_HALO rows and columns of ghost
+   cells, so that the stencils, which reach at most two pixels beyond
+   the one being updated, can be applied up to the edge of the domain
+   without testing for it. They are zero, except along periodic edges
+   where they hold copies of the opposite edge. Each row of a field
+   starts on an MW_ALIGN-byte boundary (a cache line, and an AVX-512
+   vector) and the stride between rows is a multiple of MW_ALIGN
+   bytes; the row pointers hide the padding. */
+#define MW_HALO 2
+#define MW_ALIGN 64
+
 /* The number of timesteps in a frame */
 #define MW_MINOR_STEPS 7
 
+/* Where the electric-field row kernels get the damping factor and the
+   prefix to the curl of B: from the Edamping and Eprefix fields, from
+   Edamping and a constant prefix (vacuum or a uniform dielectric), or
+   from a table indexed by the material field */
+#define MW_COEFFICIENTS_FIELD 0
+#define MW_COEFFICIENTS_UNIFORM 1
+#define MW_COEFFICIENTS_INDEXED 2
+#define MW_NCOEFFICIENTS 3
+
+/* Whether the row kernels multiply the fields by the damping factor;
+   in the interior of the domain, away from the absorbing border,
+   Bdamping is 1 and so is Edamping if there are no lossy materials */
+#define MW_UNDAMPED 0
+#define MW_DAMPED 1
+#define MW_NDAMPING 2
+
+/* The maximum number of entries in the material table, which must fit
+   in an mwMaterial */
+#define MW_MAX_MATERIALS 256
+  typedef unsigned char mwMaterial;
+
+/* A field value in bfloat16: the upper 16 bits of a float, with its
+   8-bit exponent but only 8 bits of significand */
+  typedef unsigned short mwBf16;
+
+/* A real refractive index of "inf" (or anything above 1e30) in the
+   shape primitives denotes a perfect electric conductor rather than a
+   dielectric */
+#define MW_IS_CONDUCTOR(nr) ((nr) > 1.0e30)
+
+/* A run of columns i0 to i1-1 in one row */
+  typedef struct {
+    int i0;
+    int i1;
+  } mwRun;
+
+/* The columns of each row in which a field component is updated,
+   excluding the interior of perfect conductors, stored as runs: those
+   in row j are runs[start[j]] to runs[start[j+1]-1]. If start is NULL
+   then there are no conductors and every column is updated. */
+  typedef struct {
+    int *start;
+    mwRun *runs;
+  } mwMask;
+
+/* "Row kernels" each increment one row of the fields between columns
+   i0 and i1-1. The "_below" and "_above" arguments point to the
+   neighbouring rows j-1 and j+1. With MW_COEFFICIENTS_INDEXED,
+   Edamping and Eprefix are the material table and material is the
+   row of indices into it; otherwise material is ignored. The
+   MW_UNDAMPED kernels ignore Edamping or Bdamping. The oscillator
+   forcing is added separately by mw_apply_sources. */
+  typedef void (*mwKernelTmE)(int i0, int i1, real *Ez,
+	      const real *Bx, const real *Bx_below, const real *By_below,
+	      const mwMaterial *material,
+	      const real *Edamping, const real *Eprefix, real Eprefix_const);
+  typedef void (*mwKernelTmB)(int i0, int i1, real *Bx, real *By,
+	      const real *Ez, const real *Ez_above,
+	      const real *Bdamping, real dt_dx);
+  typedef void (*mwKernelTeE)(int i0, int i1, real *Ex, real *Ey,
+	      const real *Bz, const real *Bz_above,
+	      const mwMaterial *material,
+	      const real *Edamping, const real *Eprefix, real Eprefix_const);
+  typedef void (*mwKernelTeB)(int i0, int i1, real *Bz,
+	      const real *Ex, const real *Ex_below, const real *Ey_below,
+	      const real *Bdamping, real dt_dx);
+
+/* A set of row kernels for one instruction set (scalar, AVX2,
+   AVX-512), chosen once at start-up. The kernels are specialized at
+   compile time for damping or not and, for the electric field, for
+   each source of coefficients, so that no loads or arithmetic are
+   wasted on terms known to be one or constant. */
+  typedef struct {
+    const char *name;
+    mwKernelTmE tm_E[MW_NDAMPING][MW_NCOEFFICIENTS];
+    mwKernelTmB tm_B[MW_NDAMPING];
+    mwKernelTeE te_E[MW_NDAMPING][MW_NCOEFFICIENTS];
+    mwKernelTeB te_B[MW_NDAMPING];
+  } mwKernels;
+
+/* Row kernels for the fourth-order stencil, in which each difference
+   of B or E is 9/8 of the difference between the neighbours half a
+   pixel either side minus 1/24 of that between those one and a half
+   pixels either side. They therefore need two more rows: "_above2"
+   and "_below2" point to rows j+2 and j-2. */
+  typedef void (*mwKernelTmE4)(int i0, int i1, real *Ez,
+	      const real *Bx_above, const real *Bx, const real *Bx_below,
+	      const real *Bx_below2, const real *By_below,
+	      const mwMaterial *material,
+	      const real *Edamping, const real *Eprefix, real Eprefix_const);
+  typedef void (*mwKernelTmB4)(int i0, int i1, real *Bx, real *By,
+	      const real *Ez_below, const real *Ez, const real *Ez_above,
+	      const real *Ez_above2, const real *Bdamping, real dt_dx);
+  typedef void (*mwKernelTeE4)(int i0, int i1, real *Ex, real *Ey,
+	      const real *Bz_below, const real *Bz, const real *Bz_above,
+	      const real *Bz_above2, const mwMaterial *material,
+	      const real *Edamping, const real *Eprefix, real Eprefix_const);
+  typedef void (*mwKernelTeB4)(int i0, int i1, real *Bz,
+	      const real *Ex_above, const real *Ex, const real *Ex_below,
+	      const real *Ex_below2, const real *Ey_below,
+	      const real *Bdamping, real dt_dx);
+
+  typedef struct {
+    const char *name;
+    mwKernelTmE4 tm_E[MW_NDAMPING][MW_NCOEFFICIENTS];
+    mwKernelTmB4 tm_B[MW_NDAMPING];
+    mwKernelTeE4 te_E[MW_NDAMPING][MW_NCOEFFICIENTS];
+    mwKernelTeB4 te_B[MW_NDAMPING];
+  } mwKernels4;
+
+/* Row kernels for a graded mesh (see mw_mesh.c), in which each
+   difference across the columns is multiplied by the element of
+   "ratio_x" or "dual_x" for its column and each difference across the
+   rows by the scalar "ratio_y" or "dual_y" for the row: the base pixel
+   spacing dx divided by the distance across which the difference is
+   taken */
+  typedef void (*mwKernelTmEGraded)(int i0, int i1, real *Ez,
+	      const real *Bx, const real *Bx_below, const real *By_below,
+	      const mwMaterial *material,
+	      const real *Edamping, const real *Eprefix, real Eprefix_const,
+	      const real *dual_x, real dual_y);
+  typedef void (*mwKernelTmBGraded)(int i0, int i1, real *Bx, real *By,
+	      const real *Ez, const real *Ez_above,
+	      const real *Bdamping, real dt_dx,
+	      const real *ratio_x, real ratio_y);
+  typedef void (*mwKernelTeEGraded)(int i0, int i1, real *Ex, real *Ey,
+	      const real *Bz, const real *Bz_above,
+	      const mwMaterial *material,
+	      const real *Edamping, const real *Eprefix, real Eprefix_const,
+	      const real *ratio_x, real ratio_y);
+  typedef void (*mwKernelTeBGraded)(int i0, int i1, real *Bz,
+	      const real *Ex, const real *Ex_below, const real *Ey_below,
+	      const real *Bdamping, real dt_dx,
+	      const real *dual_x, real dual_y);
+
+  typedef struct {
+    const char *name;
+    mwKernelTmEGraded tm_E[MW_NDAMPING][MW_NCOEFFICIENTS];
+    mwKernelTmBGraded tm_B[MW_NDAMPING];
+    mwKernelTeEGraded te_E[MW_NDAMPING][MW_NCOEFFICIENTS];
+    mwKernelTeBGraded te_B[MW_NDAMPING];
+  } mwKernelsGraded;
+
+/* The amplitude of the in-phase (I) and quadrature (Q) parts of the
+   oscillator forcing of each electric field component during one
+   timestep */
+  typedef struct {
+    real Ex_I;
+    real Ey_I;
+    real Ez_I;
+    real Ex_Q;
+    real Ey_Q;
+    real Ez_Q;
+  } mwForcing;
+
+/* An oscillator at one pixel, whose forcing of each electric field
+   component is "I" times the in-phase amplitude in mwForcing minus
+   "Q" times the quadrature amplitude. "index" is j*nx+i for pixel
+   (i,j), and mwDomain keeps the sources sorted by index. */
+  typedef struct {
+    int index;
+    real I;
+    real Q;
+  } mwSource;
+
+/* The result of one run of maxwell2d_benchmark: the time taken by
+   the simulation and by its late_frames last frames, the fraction of
+   the final electric field that is subnormal, the Courant number
+   c*dt/(2*dx) and the wavelength at the primary frequency in pixels,
+   the mode, and the final electric field components and Poynting vector
+   summation, converted to double precision so that runs in different
+   precisions can be compared. Each of the nE and nS fields of E and S
+   occupies nx*ny elements, and those of each member of an ensemble
+   follow those of the one before. */
+  typedef struct {
+    double seconds;
+    double late_seconds;
+    double subnormal;
+    double courant;
+    double wavelength;
+    int early_frames;
+    int late_frames;
+    double *E;
+    double *S;
+    int nx;
+    int ny;
+    int mode;
+    int nE;
+    int nS;
+  } mwBenchmark;
+
 /* The mwDomain structure */
   typedef struct {
     real **Ex;
@@ -70,24 +460,35 @@ extern "C" {
     real **epsilon;
     real **Edamping;
     real **Bdamping;
-    real **forcingI;
-    real **forcingQ;
     real **Eprefix;
+    mwMaterial **material;
+    real *material_Edamping;
+    real *material_Eprefix;
+    char *material_rows;
+    unsigned char **conductor;
+    mwMask E_mask;
+    mwMask tm_B_mask;
+    mwMask te_B_mask;
     real **scat_field;
-    real **Poynting_x;
-    real **Poynting_y;
-    real **Poynting_x_scat;
-    real **Poynting_y_scat;
+    double **Poynting_x;
+    double **Poynting_y;
+    double **Poynting_x_scat;
+    double **Poynting_y_scat;
     real **boundaries;
     real *frequencies;
     char *epsilon_plot_file;
     rc_data *config;
-    real Ex_forcingI;
-    real Ey_forcingI;
-    real Ez_forcingI;
-    real Ex_forcingQ;
-    real Ey_forcingQ;
-    real Ez_forcingQ;
+    const mwKernels *kernels;
+    const mwKernels4 *kernels4;
+    const mwKernelsGraded *kernels_graded;
+    void *lod;
+    void *bf16;
+    void *cpml;
+    void *subgrid;
+    void *bloch_partner;
+    void *output;
+    mwForcing forcing;
+    mwSource *sources;
     real Ex_amplitude;
     real Ey_amplitude;
     real Ez_amplitude;
@@ -96,35 +497,116 @@ extern "C" {
     real dt_dx;
     real c;
     real primary_frequency;
-    real time;
+    real bloch_phase_x;
+    real bloch_phase_y;
+    real origin_x;
+    real origin_y;
+    /* The mesh (see mw_mesh.c): the position of each column and row
+       in units of dx, which is simply its index unless the mesh is
+       graded, and dx divided by the spacing between neighbouring
+       columns (ratio) and between the midpoints either side of each
+       column (dual), and likewise for the rows */
+    real *mesh_x;
+    real *mesh_y;
+    real *ratio_x;
+    real *ratio_y;
+    real *dual_x;
+    real *dual_y;
+    real min_spacing;
+    double time;
+    real Eprefix_uniform;
     real plot_E_max;
     real plot_B_max;
     real plot_scat_ratio;
-    real duration;
+    double duration;
     int nx;
     int ny;
     int mode;
     int borderwidth;
+    int cpml_width;
+    int npatches;
+    /* The moving window (see mw_window.c): its speed along y as a
+       fraction of c, the time before it starts to move, and the
+       number of rows it has moved; the shapes are only added to rows
+       from shape_j0 upwards, normally all of them */
+    real window_speed;
+    real window_delay;
+    int window_offset;
+    int shape_j0;
+    /* If the domain is one band of the rows of a larger one divided
+       among MPI processes (see mw_mpi.c), the row of the larger domain
+       that is row 0 of this one, and the number of rows it has;
+       otherwise 0 and ny */
+    int row_offset;
+    int ny_global;
+    int periodic;
+    int bloch;
+    int bloch_quadrature;
+    int symmetry_x;
+    int symmetry_y;
     int cycles;
     int iframe;
     int mag;
     int nfrequencies;
+    int nthreads;
+    int stencil_order;
+    int integrator;
+    int storage;
+    int temporal_blocking;
+    int concurrent_streams;
+    int subnormal_interval;
+    int block_cols;
+    int nsources;
+    int max_sources;
+    int active_i0;
+    int active_i1;
+    int active_j0;
+    int active_j1;
+    int lossless;
+    int material_table;
+    int nmaterials;
+    int member;
+    int nmembers;
   } mwDomain;
 
   /* Functions */
   int mw_subtract(int nx, int ny, real **arg1, real **arg2, real **ans);
   int mw_scale(int nx, int ny, real **arg, real factor);
+  int mw_scale_sum(int nx, int ny, double **arg, double factor);
 
-  int mw_start(int argc, char **argv, mwDomain *domain);
+  rc_data *mw_read_config(int argc, char **argv);
+  int mw_get_precision(rc_data *config, int *precision);
+  char *mw_tuning_file(rc_data *config);
+  int mw_load_tuning(rc_data *config, int nx, int ny, int mode,
+		     int precision);
+  int mw_save_tuning(rc_data *config, int nx, int ny, int mode,
+		     int precision, const char *settings);
+  int mw_start(rc_data *config, mwDomain *domain);
   int mw_frame(mwDomain *domain);
+  int mw_set_forcing(mwDomain *domain);
+  int mw_set_source(mwDomain *domain, int i, int j, real I, real Q);
+  void mw_apply_sources(mwDomain *domain, real **E, int j, int i0, int i1,
+			real fI, real fQ);
+  void mw_apply_sources_bf16(mwDomain *domain, mwBf16 **E, int j,
+			     int i0, int i1, real fI, real fQ);
+  int mw_free_sources(mwDomain *domain);
+  int mw_shift_sources(mwDomain *domain, int nrows);
+  int mw_crop_sources(mwDomain *band, int j0);
+  void mw_grow_active(mwDomain *domain, int nsteps);
+  void mw_poynting_tm(mwDomain *domain, int j);
+  void mw_poynting_te(mwDomain *domain, int j);
 
   int mw_new_field(real ***field, int nx, int ny, int value);
   int mw_free_field(real **field);
+  int mw_new_sum(double ***field, int nx, int ny);
+  int mw_free_sum(double **field);
 
   int mw_new_domain(mwDomain *domain, int nx, int ny, real dx, int mode);
   int mw_free_domain(mwDomain *domain);
 
   int mw_reset_field(real **field, int nx, int ny, real value);
+  int mw_shift_field(real **field, int nx, int ny, int nrows, real value);
+  int mw_crop_field(real ***field, int nx, int ny, int j0, int j1);
   int mw_reset_damping(mwDomain *domain, int borderwidth);
   int mw_add_circle(mwDomain *domain, int nvar, real *var);
   int mw_add_edge(mwDomain *domain, int nvar, real *var);
@@ -136,22 +618,129 @@ extern "C" {
   int mw_add_wave_packet(mwDomain *domain, int nvar, real *var);
   int mw_add_lens(mwDomain *domain, int nvar, real *var);
   int mw_add_cavity(mwDomain *domain, int nvar, real *var);
+  int mw_add_shapes(rc_data *config, mwDomain *domain);
 
   int mw_print_field(FILE *file, real **field, int nx, int ny);
+  int mw_visualize_field(FILE *file, real **field, int nx, int ny);
+
+  int mw_new_ensemble(mwDomain *domain, mwDomain **members, int *nmembers);
+  int mw_frame_ensemble(mwDomain *members, int nmembers);
+  int mw_init_ensemble_coefficients(mwDomain *members, int nmembers);
+  int mw_free_ensemble(mwDomain *members, int nmembers);
+  char *mw_member_filename(const char *filename, mwDomain *member);
 
   int mw_step(mwDomain *domain);
+  int mw_step_ensemble(mwDomain *members, int nmembers, int poynting);
+  int mw_init_coefficients(mwDomain *domain);
+  int mw_update_coefficients(mwDomain *domain, int j0, int j1);
+  int mw_init_materials(mwDomain *domain);
+  void mw_index_materials(mwDomain *domain, int j0, int j1);
+  void mw_shift_materials(mwDomain *domain, int nrows);
+  int mw_crop_materials(mwDomain *band, const mwDomain *domain, int j0);
+  int mw_free_materials(mwDomain *domain);
+  int mw_set_conductor(mwDomain *domain, int i, int j);
+  int mw_init_conductors(mwDomain *domain);
+  void mw_shift_conductors(mwDomain *domain, int nrows);
+  int mw_crop_conductors(mwDomain *band, const mwDomain *domain, int j0);
+  int mw_free_conductors(mwDomain *domain);
+  void mw_step_tm_E(mwDomain *domain, mwForcing *forcing,
+		    int j, int i0, int i1, int parts);
+  void mw_step_tm_B(mwDomain *domain, int j, int i0, int i1, int parts);
+  void mw_step_te_E(mwDomain *domain, mwForcing *forcing,
+		    int j, int i0, int i1, int parts);
+  void mw_step_te_B(mwDomain *domain, int j, int i0, int i1, int parts);
+  int mw_step_blocked(mwDomain *domain, int nsteps);
+  int mw_step_streams(mwDomain *domain, int nsteps);
+  int mw_step_lod(mwDomain *domain, int nsteps);
+  void mw_free_lod(mwDomain *domain);
+  int mw_step_bf16(mwDomain *domain, int nsteps);
+  void mw_free_bf16(mwDomain *domain);
+  int mw_row_coefficients(mwDomain *domain, int j, const mwMaterial **material,
+			  const real **Edamping, const real **Eprefix);
+  int mw_update_range(mwDomain *domain, int first, int j, int *i0, int *i1);
+  int mw_next_run(const mwMask *mask, int j, int i0, int i1,
+		  int *k, int *r0, int *r1);
+  int mw_row_segments(mwDomain *domain, int j, int i0, int i1,
+		      int *s0, int *s1, int *damped);
+  int mw_new_cpml(mwDomain *domain, int width);
+  void mw_free_cpml(mwDomain *domain);
+  void mw_cpml_tm_E(mwDomain *domain, int part, int j, int i0, int i1,
+		    real Eprefix_const);
+  void mw_cpml_tm_B(mwDomain *domain, int part, int j, int i0, int i1);
+  void mw_cpml_te_E(mwDomain *domain, int part, int j, int i0, int i1,
+		    real Eprefix_const);
+  void mw_cpml_te_B(mwDomain *domain, int part, int j, int i0, int i1);
+  void mw_wrap_tm_E(mwDomain *members, int nmembers, int j);
+  void mw_wrap_tm_B(mwDomain *members, int nmembers, int j);
+  void mw_wrap_te_E(mwDomain *members, int nmembers, int j);
+  void mw_wrap_te_B(mwDomain *members, int nmembers, int j);
+  int mw_split_bloch_sources(mwDomain *domain, mwSource **sources);
+  void mw_mirror_tm_E(mwDomain *domain, int j, int parts);
+  void mw_mirror_tm_B(mwDomain *domain, int j, int parts);
+  void mw_mirror_te_E(mwDomain *domain, int j, int parts);
+  void mw_mirror_te_B(mwDomain *domain, int j, int parts);
+  void mw_mirror_E_rows(mwDomain *members, int nmembers);
+  void mw_mirror_B_rows(mwDomain *members, int nmembers);
+  void mw_full_size(const mwDomain *domain, int *nx, int *ny);
+  int mw_unfold(const mwDomain *domain, int axis, int k, int *mirrored);
+  int mw_parity(const mwDomain *domain, int direction, int magnetic);
+  int mw_new_mesh(mwDomain *domain);
+  void mw_free_mesh(mwDomain *domain);
+  int mw_grade_axis(const real *refine, int nrefine, int npixels, real dx,
+		    real grading, real **mesh, int *n);
+  int mw_set_mesh(mwDomain *domain, const real *mesh_x, const real *mesh_y);
+  int mw_mesh_index(const mwDomain *domain, int axis, real position);
+  real mw_mesh_position(const mwDomain *domain, int axis, int k);
+  double mw_coordinate(const mwDomain *domain, int axis, int k);
+  int mw_new_subgrid(mwDomain *domain, int nvar, const real *var);
+  void mw_free_subgrid(mwDomain *domain);
+  mwDomain *mw_patch(mwDomain *domain, int k);
+  void mw_save_subgrid(mwDomain *domain);
+  int mw_step_subgrid(mwDomain *domain);
+  int mw_move_window(mwDomain *domain);
+  int mw_mpi_split(mwDomain *domain, mwDomain *band);
+  int mw_mpi_frame(mwDomain *band);
+  int mw_mpi_gather_fields(mwDomain *band, mwDomain *domain);
+  int mw_mpi_gather_sums(mwDomain *band, mwDomain *domain);
+
+  int mw_select_kernels(mwDomain *domain, char *name);
+  const mwKernels *mw_kernels_scalar();
+  const mwKernels *mw_kernels_avx2();
+  const mwKernels *mw_kernels_avx512();
+  const mwKernels4 *mw_kernels_fourth_order();
+  const mwKernelsGraded *mw_kernels_graded();
+
+  int mw_set_threads(int nthreads);
+  void mw_thread_rows(int ny, int *j0, int *j1);
+  void mw_set_flush_denormals(int flush);
+  void mw_thread_denormals();
+  long mw_count_subnormals(real **field, int nx, int ny);
+  int mw_report_subnormals(FILE *file, mwDomain *domain);
 
   int mw_nc_init(char *filename, mwDomain *domain, int argc, char **argv);
   int mw_nc_write_frame(mwDomain *domain);
-  int mw_nc_close();
+  int mw_nc_close(mwDomain *domain);
 
   int mw_gif_init(char *filename, mwDomain *domain);
   int mw_gif_write_frame(mwDomain *domain);
-  int mw_gif_close();
+  int mw_gif_close(mwDomain *domain);
   int mw_gif_write_epsilon(char *filename, mwDomain *domain);
 
   int mw_susceptibility(real nr, real ni, real *xir, real *xii);
   int mw_find_boundaries(mwDomain *domain);
+  int mw_find_boundary_rows(mwDomain *domain, int j0, int j1);
+
+  /* The bodies of the programs, which are compiled in both
+     precisions; main() calls the mw_* or mwd_* version according to
+     the "precision" config variable */
+  int mw_run_gif(rc_data *config);
+  int mw_run_nc(rc_data *config, int argc, char **argv);
+  int mw_run_benchmark(rc_data *config, mwBenchmark *benchmark);
+  int mw_run_mpi(rc_data *config, int argc, char **argv);
+  int mwd_run_gif(rc_data *config);
+  int mwd_run_nc(rc_data *config, int argc, char **argv);
+  int mwd_run_benchmark(rc_data *config, mwBenchmark *benchmark);
+  int mwd_run_mpi(rc_data *config, int argc, char **argv);
 
 
 #ifdef __cplusplus
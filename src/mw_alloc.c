@@ -18,28 +18,147 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "maxwell.h"
 
+/* The number of elements of "real" in MW_ALIGN bytes; each row of a
+   field is preceded by this many elements, of which the last MW_HALO
+   are ghost cells, so that the first pixel of the row is aligned */
+#define ROW_PAD (MW_ALIGN/sizeof(real))
+
+/* Return the number of elements between the starts of consecutive
+   rows of a field nx pixels wide: the row itself and the padding
+   before it, which includes the ghost cells on the left, followed by
+   at least MW_HALO ghost cells on the right, rounded up to a multiple
+   of MW_ALIGN bytes */
+static
+int
+field_stride(int nx)
+{
+  return ROW_PAD + ((nx + MW_HALO + ROW_PAD - 1)/ROW_PAD)*ROW_PAD;
+}
+
 /* Initialize a matrix of real numbers with a specified size and set
-   every element to "value" */
+   every element to "value". The field is stored in a single aligned
+   buffer, surrounded by MW_HALO rows and columns of ghost cells that
+   are set to zero and only written again along periodic edges;
+   field[j] for j from -MW_HALO to ny+MW_HALO-1 points to the first
+   pixel of each row. The memory is touched in the row bands of
+   mw_reset_field, so that it is placed close to the threads that will
+   use it. */
 int
 mw_new_field(real ***field, int nx, int ny, int value)
+{
+  int stride = field_stride(nx);
+  int j;
+  real **rows;
+  real *buffer;
+  rows = (real**) malloc(sizeof(real*)*(ny+2*MW_HALO));
+  if (!rows) {
+    return MW_FAILURE;
+  }
+  if (posix_memalign((void**) &buffer, MW_ALIGN,
+		     sizeof(real)*stride*(ny+2*MW_HALO))) {
+    free(rows);
+    return MW_FAILURE;
+  }
+  for (j = 0; j < ny+2*MW_HALO; j++) {
+    rows[j] = buffer + j*stride + ROW_PAD;
+  }
+  *field = rows + MW_HALO;
+  for (j = -MW_HALO; j < 0; j++) {
+    memset((*field)[j]-ROW_PAD, 0, sizeof(real)*stride);
+    memset((*field)[ny-1-j]-ROW_PAD, 0, sizeof(real)*stride);
+  }
+#pragma omp parallel
+  {
+    int j, j0, j1;
+    mw_thread_rows(ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      memset((*field)[j]-ROW_PAD, 0, sizeof(real)*stride);
+    }
+  }
+  mw_reset_field(*field, nx, ny, value);
+  return MW_SUCCESS;
+}
+
+/* Move the rows of a field nrows down, discarding the bottom nrows
+   and setting the pixels of the nrows exposed at the top to "value";
+   the rows are contiguous in the buffer, so together with their
+   ghost cells they are moved in one go */
+int
+mw_shift_field(real **field, int nx, int ny, int nrows, real value)
+{
+  int stride = field_stride(nx);
+  int j;
+  if (nrows < ny) {
+    memmove(field[0]-ROW_PAD, field[nrows]-ROW_PAD,
+	    sizeof(real)*stride*(ny-nrows));
+  }
+  else {
+    nrows = ny;
+  }
+  for (j = ny-nrows; j < ny; j++) {
+    int i;
+    memset(field[j]-ROW_PAD, 0, sizeof(real)*stride);
+    for (i = 0; i < nx; i++) {
+      field[j][i] = value;
+    }
+  }
+  return MW_SUCCESS;
+}
+
+/* Replace a field of ny rows with a new one holding only rows j0 to
+   j1-1 of it (see mw_mpi.c), together with as many of the ghost rows
+   and rows beyond them as the old field has; the old field is not
+   freed, since it is still in use by the domain it belongs to */
+int
+mw_crop_field(real ***field, int nx, int ny, int j0, int j1)
+{
+  int stride = field_stride(nx);
+  real **band;
+  int j;
+  MW_CHECK(mw_new_field(&band, nx, j1-j0, 0.0));
+  for (j = -MW_HALO; j < j1-j0+MW_HALO; j++) {
+    if (j0+j >= -MW_HALO && j0+j < ny+MW_HALO) {
+      memcpy(band[j]-ROW_PAD, (*field)[j0+j]-ROW_PAD, sizeof(real)*stride);
+    }
+  }
+  *field = band;
+  return MW_SUCCESS;
+}
+
+/* Initialize a matrix of double-precision numbers with a specified
+   size and set every element to zero, touching the memory from the
+   threads that will update it as mw_reset_field does. These are used
+   for summations, which would lose precision in a field of "real". */
+int
+mw_new_sum(double ***field, int nx, int ny)
 {
   int i;
-  *field = (real**) malloc(sizeof(real*)*ny);
+  *field = (double**) malloc(sizeof(double*)*ny);
   if (!*field) {
     return MW_FAILURE;
   }
-  **field = (real*) malloc(sizeof(real)*ny*nx);
+  **field = (double*) malloc(sizeof(double)*ny*nx);
   if (!**field) {
     return MW_FAILURE;
   }
   for (i = 1; i < ny; i++) {
     (*field)[i] = (*field)[0] + i*nx;
   }
-  mw_reset_field(*field, nx, ny, value);
+#pragma omp parallel
+  {
+    int i, j, j0, j1;
+    mw_thread_rows(ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      for (i = 0; i < nx; i++) {
+	(*field)[j][i] = 0.0;
+      }
+    }
+  }
   return MW_SUCCESS;
 }
 
@@ -74,28 +193,36 @@ mw_new_domain(mwDomain *domain, int nx, int ny, real dx, int mode)
   mw_new_field(&domain->epsilon, nx, ny, 1.0);
   mw_new_field(&domain->Edamping, nx, ny, 0.0);
   mw_new_field(&domain->Bdamping, nx, ny, 1.0);
-  mw_new_field(&domain->forcingI, nx, ny, 0.0);
-  mw_new_field(&domain->forcingQ, nx, ny, 0.0);
   mw_new_field(&domain->boundaries, nx, ny, 0.0);
-  mw_new_field(&domain->Poynting_x, nx, ny, 0.0);
-  mw_new_field(&domain->Poynting_y, nx, ny, 0.0);
+  mw_new_sum(&domain->Poynting_x, nx, ny);
+  mw_new_sum(&domain->Poynting_y, nx, ny);
   if (mode & MW_MODE_VACUUM) {
-    mw_new_field(&domain->Poynting_x_scat, nx, ny, 0.0);
-    mw_new_field(&domain->Poynting_y_scat, nx, ny, 0.0);
+    mw_new_sum(&domain->Poynting_x_scat, nx, ny);
+    mw_new_sum(&domain->Poynting_y_scat, nx, ny);
   }
   domain->Eprefix = NULL;
+  domain->material = NULL;
+  domain->material_Edamping = domain->material_Eprefix = NULL;
+  domain->material_rows = NULL;
+  domain->nmaterials = 0;
+  domain->conductor = NULL;
+  domain->E_mask.start = domain->tm_B_mask.start
+    = domain->te_B_mask.start = NULL;
+  domain->E_mask.runs = domain->tm_B_mask.runs
+    = domain->te_B_mask.runs = NULL;
 
   domain->mode = mode;
   domain->nx = nx;
   domain->ny = ny;
   domain->dx = dx;
+  MW_CHECK(mw_new_mesh(domain));
   domain->c = MW_C;
   domain->dt = 0.8 * dx / domain->c;
   domain->dt_dx = domain->dt/domain->dx;
-  domain->Ez_forcingI = 1.0;
-  domain->Ez_forcingQ = 0.0;
-  domain->Ex_forcingI = domain->Ey_forcingI = 0.0;
-  domain->Ex_forcingQ = domain->Ey_forcingQ = 0.0;
+  domain->forcing.Ez_I = 1.0;
+  domain->forcing.Ez_Q = 0.0;
+  domain->forcing.Ex_I = domain->forcing.Ey_I = 0.0;
+  domain->forcing.Ex_Q = domain->forcing.Ey_Q = 0.0;
   domain->time = 0.0;
   domain->iframe = 0;
   domain->plot_E_max = 1.0e-8;
@@ -105,12 +232,66 @@ mw_new_domain(mwDomain *domain, int nx, int ny, real dx, int mode)
   domain->epsilon_plot_file = NULL;
   domain->frequencies = NULL;
   domain->nfrequencies = 0;
+  domain->borderwidth = 0;
+  domain->stencil_order = 2;
+  domain->kernels4 = NULL;
+  domain->kernels_graded = NULL;
+  domain->integrator = MW_INTEGRATOR_EXPLICIT;
+  domain->storage = MW_STORAGE_REAL;
+  domain->lod = NULL;
+  domain->bf16 = NULL;
+  domain->cpml = NULL;
+  domain->cpml_width = 0;
+  domain->subgrid = NULL;
+  domain->npatches = 0;
+  domain->window_speed = domain->window_delay = 0.0;
+  domain->window_offset = 0;
+  domain->shape_j0 = 0;
+  domain->row_offset = 0;
+  domain->ny_global = ny;
+  domain->periodic = 0;
+  domain->bloch = domain->bloch_quadrature = 0;
+  domain->bloch_phase_x = domain->bloch_phase_y = 0.0;
+  domain->bloch_partner = NULL;
+  domain->symmetry_x = domain->symmetry_y = MW_SYMMETRY_NONE;
+  /* Shapes and oscillators are positioned relative to the centre */
+  domain->origin_x = nx/2.0;
+  domain->origin_y = ny/2.0;
+  domain->temporal_blocking = 0;
+  domain->concurrent_streams = 0;
+  domain->subnormal_interval = 0;
+  domain->block_cols = 512;
+  domain->Eprefix_uniform = 0.0;
+  domain->sources = NULL;
+  domain->nsources = domain->max_sources = 0;
+  /* No pixels are active until an oscillator is added */
+  domain->active_i0 = nx;
+  domain->active_i1 = 0;
+  domain->active_j0 = ny;
+  domain->active_j1 = 0;
+  domain->lossless = 0;
+  domain->material_table = 0;
+  domain->output = NULL;
+  domain->member = 0;
+  domain->nmembers = 1;
   return MW_SUCCESS;
 }
 
 /* Free the memory used to store a matrix field */
 int
 mw_free_field(real **field)
+{
+  if (field) {
+    free(field[-MW_HALO]-ROW_PAD);
+    free(field-MW_HALO);
+  }
+  return MW_SUCCESS;
+}
+
+/* Free the memory used to store a matrix of double-precision
+   numbers */
+int
+mw_free_sum(double **field)
 {
   if (field) {
     if (*field) {
@@ -135,21 +316,53 @@ mw_free_domain(mwDomain *domain)
   mw_free_field(domain->Edamping);
   mw_free_field(domain->Bdamping);
   mw_free_field(domain->Eprefix);
+  mw_free_field(domain->Ex_vacuum);
+  mw_free_field(domain->Ey_vacuum);
+  mw_free_field(domain->Ez_vacuum);
+  mw_free_field(domain->Bx_vacuum);
+  mw_free_field(domain->By_vacuum);
+  mw_free_field(domain->Bz_vacuum);
+  mw_free_field(domain->scat_field);
+  mw_free_field(domain->boundaries);
+  mw_free_sum(domain->Poynting_x);
+  mw_free_sum(domain->Poynting_y);
+  mw_free_sum(domain->Poynting_x_scat);
+  mw_free_sum(domain->Poynting_y_scat);
+  mw_free_materials(domain);
+  mw_free_conductors(domain);
+  mw_free_sources(domain);
+  mw_free_lod(domain);
+  mw_free_bf16(domain);
+  mw_free_cpml(domain);
+  mw_free_subgrid(domain);
+  mw_free_mesh(domain);
   domain->Ex = domain->Ey = domain->Ez = NULL;
   domain->Bx = domain->By = domain->Bz = NULL;
+  domain->Ex_vacuum = domain->Ey_vacuum = domain->Ez_vacuum = NULL;
+  domain->Bx_vacuum = domain->By_vacuum = domain->Bz_vacuum = NULL;
   domain->epsilon = domain->Edamping = domain->Bdamping
     = domain->Eprefix = NULL;
+  domain->scat_field = domain->boundaries = NULL;
+  domain->Poynting_x = domain->Poynting_y = NULL;
+  domain->Poynting_x_scat = domain->Poynting_y_scat = NULL;
   return MW_SUCCESS;
 }
 
-/* Set all the elements of an existing field to a particular value */
+/* Set all the elements of an existing field to a particular
+   value. This is done in parallel using the same row bands as
+   mw_step, so when called on a newly allocated field each page is
+   first touched by the thread that will later update it. */
 int
 mw_reset_field(real **field, int nx, int ny, real value)
 {
-  int i, j;
-  for (j = 0; j < ny; j++) {
-    for (i = 0; i < nx; i++) {
-      field[j][i] = value;
+#pragma omp parallel
+  {
+    int i, j, j0, j1;
+    mw_thread_rows(ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      for (i = 0; i < nx; i++) {
+	field[j][i] = value;
+      }
     }
   }
   return MW_SUCCESS;
@@ -0,0 +1,567 @@
+/* mw_bf16.c -- Advance the fields stored in bfloat16
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* A large domain is limited by the speed at which the fields stream
+   through memory, so with "precision bf16" the E and B fields are
+   advanced in copies stored in bfloat16, half the size of a float.
+   IEEE half precision would be no use here, since B in SI units is
+   around 1e-15 T, far below its smallest normal value; bfloat16 has
+   the same 8-bit exponent as a float, and keeps only the top 8 bits
+   of its significand. The kernels below read each value, do the
+   arithmetic in single precision as mw_step does, and round the
+   result to the nearest bfloat16; the coefficients stay in single
+   precision.
+
+   The timesteps of a frame are taken in the same fused pass as in
+   mw_step, with the same active region, conductor masks and damped
+   segments, and the oscillators are added to the rounded fields. At
+   the end of the frame the copies are converted back into the fields
+   of the domain, from which the Poynting vector is summed and the
+   output is written; the fields of the domain are not otherwise
+   touched, so they must not be changed between frames. Only the
+   plain scheme is supported: the explicit integrator with the
+   standard stencil on a uniform mesh, with "boundary" damping, and
+   no periodic edges, planes of symmetry, subgrid or moving window.
+
+   The kernels here are compiled for the baseline instruction set and
+   spend the memory traffic saved on converting every value, so on one
+   core benchmark_precision.sh found them 0.4-0.5 times the speed of
+   float, both for circle10.cfg and lens.cfg and for a 3000x3000
+   domain that does not fit in cache. The error of the mean Poynting
+   vector relative to double precision was 0.3-0.4%, but that of the
+   final electric field was 1% in the large domain and 8-36% in the
+   small scenes, from the increments of each timestep being rounded
+   away. It is only worth trying where many threads share the memory
+   bandwidth, and then only for time-averaged output. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "maxwell.h"
+#include "mw_kernel.h"
+#include "mw_bf16.h"
+
+/* The fields held in bfloat16, in the domain and then in vacuum */
+#define EZ 0
+#define BX 1
+#define BY 2
+#define EX 3
+#define EY 4
+#define BZ 5
+#define NCOMPONENTS 6
+#define VACUUM NCOMPONENTS
+#define NFIELDS (2*NCOMPONENTS)
+
+/* The bfloat16 copies of the fields, NULL for those not simulated,
+   each of whose rows starts on an MW_ALIGN-byte boundary */
+typedef struct {
+  mwBf16 **field[NFIELDS];
+} bf16State;
+
+/* Return field k of the domain */
+static
+real **
+domain_field(mwDomain *domain, int k)
+{
+  switch (k) {
+  case EZ: return domain->Ez;
+  case BX: return domain->Bx;
+  case BY: return domain->By;
+  case EX: return domain->Ex;
+  case EY: return domain->Ey;
+  case BZ: return domain->Bz;
+  case VACUUM+EZ: return domain->Ez_vacuum;
+  case VACUUM+BX: return domain->Bx_vacuum;
+  case VACUUM+BY: return domain->By_vacuum;
+  case VACUUM+EX: return domain->Ex_vacuum;
+  case VACUUM+EY: return domain->Ey_vacuum;
+  case VACUUM+BZ: return domain->Bz_vacuum;
+  }
+  return NULL;
+}
+
+/* Convert rows j0 to j1-1 and columns i0 to i1-1 of F into H */
+static
+void
+to_bf16(mwBf16 **H, real **F, int i0, int i1, int j0, int j1)
+{
+  int i, j;
+  for (j = j0; j < j1; j++) {
+    for (i = i0; i < i1; i++) {
+      H[j][i] = mw_to_bf16(F[j][i]);
+    }
+  }
+}
+
+/* Convert rows j0 to j1-1 and columns i0 to i1-1 of H into F */
+static
+void
+from_bf16(real **F, mwBf16 **H, int i0, int i1, int j0, int j1)
+{
+  int i, j;
+  for (j = j0; j < j1; j++) {
+    for (i = i0; i < i1; i++) {
+      F[j][i] = mw_from_bf16(H[j][i]);
+    }
+  }
+}
+
+/* Allocate the state, if this has not already been done, and convert
+   the fields of the domain into it. Each thread touches the rows of
+   the band it will later update. */
+static
+int
+init_bf16(mwDomain *domain)
+{
+  int nx = domain->nx, ny = domain->ny;
+  int stride = ((nx*sizeof(mwBf16) + MW_ALIGN - 1)/MW_ALIGN)
+    *MW_ALIGN/sizeof(mwBf16);
+  bf16State *state;
+  int j, k;
+  if (domain->bf16) {
+    return MW_SUCCESS;
+  }
+  state = (bf16State*) calloc(1, sizeof(bf16State));
+  if (!state) {
+    fprintf(stderr, "Error allocating the bfloat16 fields\n");
+    return MW_FAILURE;
+  }
+  domain->bf16 = state;
+  for (k = 0; k < NFIELDS; k++) {
+    mwBf16 *buffer;
+    if (!domain_field(domain, k)) {
+      continue;
+    }
+    state->field[k] = (mwBf16**) malloc(sizeof(mwBf16*)*ny);
+    if (!state->field[k]
+	|| posix_memalign((void**) &buffer, MW_ALIGN,
+			  sizeof(mwBf16)*stride*ny)) {
+      fprintf(stderr, "Error allocating the bfloat16 fields\n");
+      return MW_FAILURE;
+    }
+    for (j = 0; j < ny; j++) {
+      state->field[k][j] = buffer + j*stride;
+    }
+  }
+#pragma omp parallel
+  {
+    int j, j0, j1, k;
+    mw_thread_rows(ny, &j0, &j1);
+    for (k = 0; k < NFIELDS; k++) {
+      if (state->field[k]) {
+	for (j = j0; j < j1; j++) {
+	  memset(state->field[k][j], 0, sizeof(mwBf16)*stride);
+	}
+	to_bf16(state->field[k], domain_field(domain, k), 0, nx, j0, j1);
+      }
+    }
+  }
+  return MW_SUCCESS;
+}
+
+/* Free the bfloat16 fields */
+void
+mw_free_bf16(mwDomain *domain)
+{
+  bf16State *state = (bf16State*) domain->bf16;
+  int k;
+  if (!state) {
+    return;
+  }
+  for (k = 0; k < NFIELDS; k++) {
+    if (state->field[k]) {
+      free(*state->field[k]);
+      free(state->field[k]);
+    }
+  }
+  free(state);
+  domain->bf16 = NULL;
+}
+
+/* The row kernels, as in mw_kernel.c but reading and writing
+   bfloat16; COEFFICIENTS sets the damping and prefix of element i */
+
+/* Increment one row of Ez */
+MW_INLINE
+void
+tm_E(int i0, int i1, mwBf16 *restrict Ez,
+     const mwBf16 *restrict Bx, const mwBf16 *restrict Bx_below,
+     const mwBf16 *restrict By_below, const mwMaterial *restrict material,
+     const real *restrict Edamping, const real *restrict Eprefix,
+     real Eprefix_const, int coefficients, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping, prefix;
+    COEFFICIENTS(i, damping, prefix);
+    Ez[i] = mw_to_bf16(damping*mw_from_bf16(Ez[i])
+		       + prefix*(mw_from_bf16(By_below[i])
+				 - mw_from_bf16(By_below[i-1])
+				 - mw_from_bf16(Bx[i-1])
+				 + mw_from_bf16(Bx_below[i-1])));
+  }
+}
+
+/* Increment one row of Bx and By */
+MW_INLINE
+void
+tm_B(int i0, int i1, mwBf16 *restrict Bx, mwBf16 *restrict By,
+     const mwBf16 *restrict Ez, const mwBf16 *restrict Ez_above,
+     const real *restrict Bdamping, real dt_dx, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping = damped ? Bdamping[i] : 1.0;
+    real Ez_i1 = mw_from_bf16(Ez[i+1]);
+    real Ez_above_i = mw_from_bf16(Ez_above[i]);
+    real Ez_above_i1 = mw_from_bf16(Ez_above[i+1]);
+    Bx[i] = mw_to_bf16(damping*mw_from_bf16(Bx[i])
+		       - dt_dx*(Ez_above_i1 - Ez_i1));
+    By[i] = mw_to_bf16(damping*mw_from_bf16(By[i])
+		       - dt_dx*(Ez_above_i - Ez_above_i1));
+  }
+}
+
+/* Increment one row of Ex and Ey */
+MW_INLINE
+void
+te_E(int i0, int i1, mwBf16 *restrict Ex, mwBf16 *restrict Ey,
+     const mwBf16 *restrict Bz, const mwBf16 *restrict Bz_above,
+     const mwMaterial *restrict material,
+     const real *restrict Edamping, const real *restrict Eprefix,
+     real Eprefix_const, int coefficients, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping, prefix;
+    real Bz_i1 = mw_from_bf16(Bz[i+1]);
+    real Bz_above_i = mw_from_bf16(Bz_above[i]);
+    real Bz_above_i1 = mw_from_bf16(Bz_above[i+1]);
+    COEFFICIENTS(i, damping, prefix);
+    Ex[i] = mw_to_bf16(damping*mw_from_bf16(Ex[i])
+		       + prefix*(Bz_above_i1 - Bz_i1));
+    Ey[i] = mw_to_bf16(damping*mw_from_bf16(Ey[i])
+		       + prefix*(Bz_above_i - Bz_above_i1));
+  }
+}
+
+/* Increment one row of Bz */
+MW_INLINE
+void
+te_B(int i0, int i1, mwBf16 *restrict Bz,
+     const mwBf16 *restrict Ex, const mwBf16 *restrict Ex_below,
+     const mwBf16 *restrict Ey_below,
+     const real *restrict Bdamping, real dt_dx, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping = damped ? Bdamping[i] : 1.0;
+    Bz[i] = mw_to_bf16(damping*mw_from_bf16(Bz[i])
+		       - dt_dx*(mw_from_bf16(Ey_below[i])
+				- mw_from_bf16(Ey_below[i-1])
+				- mw_from_bf16(Ex[i-1])
+				+ mw_from_bf16(Ex_below[i-1])));
+  }
+}
+
+/* Call the electric-field kernel "kernel" with the arguments given
+   followed by "coefficients" and "damped" as constants, so that each
+   combination is compiled separately as in mw_kernel.h */
+#define SPECIALIZE_E(kernel, coefficients, damped, ...)			\
+  if (damped == MW_DAMPED) {						\
+    if (coefficients == MW_COEFFICIENTS_UNIFORM) {			\
+      kernel(__VA_ARGS__, MW_COEFFICIENTS_UNIFORM, 1);			\
+    }									\
+    else if (coefficients == MW_COEFFICIENTS_INDEXED) {		\
+      kernel(__VA_ARGS__, MW_COEFFICIENTS_INDEXED, 1);			\
+    }									\
+    else {								\
+      kernel(__VA_ARGS__, MW_COEFFICIENTS_FIELD, 1);			\
+    }									\
+  }									\
+  else if (coefficients == MW_COEFFICIENTS_UNIFORM) {			\
+    kernel(__VA_ARGS__, MW_COEFFICIENTS_UNIFORM, 0);			\
+  }									\
+  else if (coefficients == MW_COEFFICIENTS_INDEXED) {			\
+    kernel(__VA_ARGS__, MW_COEFFICIENTS_INDEXED, 0);			\
+  }									\
+  else {								\
+    kernel(__VA_ARGS__, MW_COEFFICIENTS_FIELD, 0);			\
+  }
+
+/* Likewise for a magnetic-field kernel, which only has "damped" */
+#define SPECIALIZE_B(kernel, damped, ...)				\
+  if (damped == MW_DAMPED) {						\
+    kernel(__VA_ARGS__, 1);						\
+  }									\
+  else {								\
+    kernel(__VA_ARGS__, 0);						\
+  }
+
+/* The following four functions increment row j of the fields of one
+   polarization, in the domain and then in vacuum if it is being
+   simulated, skipping the same rows, columns and conductors as the
+   functions of the same name in mw_step.c */
+
+/* Increment row j of the Ez component */
+static
+void
+step_tm_E(mwDomain *domain, bf16State *state, int j)
+{
+  real dt = domain->dt;
+  const mwMaterial *material;
+  const real *Edamping, *Eprefix;
+  int coefficients, i0 = 0, i1 = domain->nx;
+  int k, n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 1, j, &i0, &i1)) {
+    return;
+  }
+  coefficients = mw_row_coefficients(domain, j, &material,
+				     &Edamping, &Eprefix);
+  run = -1;
+  while (mw_next_run(&domain->E_mask, j, i0, i1, &run, &r0, &r1)) {
+    mwBf16 **Ez = state->field[EZ];
+    mwBf16 **Bx = state->field[BX], **By = state->field[BY];
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      /* Lossy materials are damped even in the interior */
+      int damping = domain->lossless ? damped[k] : MW_DAMPED;
+      SPECIALIZE_E(tm_E, coefficients, damping,
+		   s0[k], s1[k], Ez[j], Bx[j], Bx[j-1], By[j-1],
+		   material, Edamping, Eprefix, domain->Eprefix_uniform);
+    }
+    mw_apply_sources_bf16(domain, Ez, j, r0, r1,
+			  dt*domain->forcing.Ez_I, dt*domain->forcing.Ez_Q);
+  }
+  if (domain->mode & MW_MODE_VACUUM) {
+    real Eprefix_vacuum = 0.5*dt*domain->c*domain->c/domain->dx;
+    mwBf16 **Ez = state->field[VACUUM+EZ];
+    mwBf16 **Bx = state->field[VACUUM+BX], **By = state->field[VACUUM+BY];
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      SPECIALIZE_E(tm_E, MW_COEFFICIENTS_UNIFORM, damped[k],
+		   s0[k], s1[k], Ez[j], Bx[j], Bx[j-1], By[j-1],
+		   NULL, domain->Bdamping[j], NULL, Eprefix_vacuum);
+    }
+    mw_apply_sources_bf16(domain, Ez, j, i0, i1,
+			  dt*domain->forcing.Ez_I, dt*domain->forcing.Ez_Q);
+  }
+}
+
+/* Increment row j of the Bx and By components */
+static
+void
+step_tm_B(mwDomain *domain, bf16State *state, int j)
+{
+  real dt_dx = 0.5*domain->dt/domain->dx;
+  int i0 = 0, i1 = domain->nx;
+  int k, n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 0, j, &i0, &i1)) {
+    return;
+  }
+  run = -1;
+  while (mw_next_run(&domain->tm_B_mask, j, i0, i1, &run, &r0, &r1)) {
+    mwBf16 **Ez = state->field[EZ];
+    mwBf16 **Bx = state->field[BX], **By = state->field[BY];
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      SPECIALIZE_B(tm_B, damped[k], s0[k], s1[k], Bx[j], By[j],
+		   Ez[j], Ez[j+1], domain->Bdamping[j], dt_dx);
+    }
+  }
+  if (domain->mode & MW_MODE_VACUUM) {
+    mwBf16 **Ez = state->field[VACUUM+EZ];
+    mwBf16 **Bx = state->field[VACUUM+BX], **By = state->field[VACUUM+BY];
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      SPECIALIZE_B(tm_B, damped[k], s0[k], s1[k], Bx[j], By[j],
+		   Ez[j], Ez[j+1], domain->Bdamping[j], dt_dx);
+    }
+  }
+}
+
+/* Increment row j of the Ex and Ey components */
+static
+void
+step_te_E(mwDomain *domain, bf16State *state, int j)
+{
+  real dt = domain->dt;
+  const mwMaterial *material;
+  const real *Edamping, *Eprefix;
+  int coefficients, i0 = 0, i1 = domain->nx;
+  int k, n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 0, j, &i0, &i1)) {
+    return;
+  }
+  coefficients = mw_row_coefficients(domain, j, &material,
+				     &Edamping, &Eprefix);
+  run = -1;
+  while (mw_next_run(&domain->E_mask, j, i0, i1, &run, &r0, &r1)) {
+    mwBf16 **Ex = state->field[EX], **Ey = state->field[EY];
+    mwBf16 **Bz = state->field[BZ];
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      int damping = domain->lossless ? damped[k] : MW_DAMPED;
+      SPECIALIZE_E(te_E, coefficients, damping,
+		   s0[k], s1[k], Ex[j], Ey[j], Bz[j], Bz[j+1],
+		   material, Edamping, Eprefix, domain->Eprefix_uniform);
+    }
+    mw_apply_sources_bf16(domain, Ex, j, r0, r1,
+			  dt*domain->forcing.Ex_I, dt*domain->forcing.Ex_Q);
+    mw_apply_sources_bf16(domain, Ey, j, r0, r1,
+			  dt*domain->forcing.Ey_I, dt*domain->forcing.Ey_Q);
+  }
+  if (domain->mode & MW_MODE_VACUUM) {
+    real Eprefix_vacuum = 0.5*dt*domain->c*domain->c/domain->dx;
+    mwBf16 **Ex = state->field[VACUUM+EX], **Ey = state->field[VACUUM+EY];
+    mwBf16 **Bz = state->field[VACUUM+BZ];
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      SPECIALIZE_E(te_E, MW_COEFFICIENTS_UNIFORM, damped[k],
+		   s0[k], s1[k], Ex[j], Ey[j], Bz[j], Bz[j+1],
+		   NULL, domain->Bdamping[j], NULL, Eprefix_vacuum);
+    }
+    mw_apply_sources_bf16(domain, Ex, j, i0, i1,
+			  dt*domain->forcing.Ex_I, dt*domain->forcing.Ex_Q);
+    mw_apply_sources_bf16(domain, Ey, j, i0, i1,
+			  dt*domain->forcing.Ey_I, dt*domain->forcing.Ey_Q);
+  }
+}
+
+/* Increment row j of the Bz component */
+static
+void
+step_te_B(mwDomain *domain, bf16State *state, int j)
+{
+  real dt_dx = 0.5*domain->dt/domain->dx;
+  int i0 = 0, i1 = domain->nx;
+  int k, n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 1, j, &i0, &i1)) {
+    return;
+  }
+  run = -1;
+  while (mw_next_run(&domain->te_B_mask, j, i0, i1, &run, &r0, &r1)) {
+    mwBf16 **Ex = state->field[EX], **Ey = state->field[EY];
+    mwBf16 **Bz = state->field[BZ];
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      SPECIALIZE_B(te_B, damped[k], s0[k], s1[k], Bz[j],
+		   Ex[j], Ex[j-1], Ey[j-1], domain->Bdamping[j], dt_dx);
+    }
+  }
+  if (domain->mode & MW_MODE_VACUUM) {
+    mwBf16 **Ex = state->field[VACUUM+EX], **Ey = state->field[VACUUM+EY];
+    mwBf16 **Bz = state->field[VACUUM+BZ];
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    for (k = 0; k < n; k++) {
+      SPECIALIZE_B(te_B, damped[k], s0[k], s1[k], Bz[j],
+		   Ex[j], Ex[j-1], Ey[j-1], domain->Bdamping[j], dt_dx);
+    }
+  }
+}
+
+/* Move the bfloat16 fields forward one timestep in the single pass
+   through memory of step() in mw_step.c: in each band of rows the E
+   field is incremented in row j and then the B field in the row that
+   depends on it (j-1 for Bx/By, j for Bz), leaving the B rows at the
+   bottom of the band that depend on E in the band below until every
+   thread has finished */
+static
+void
+step(mwDomain *domain, bf16State *state)
+{
+  int tm = domain->mode & MW_MODE_EZ;
+  int te = domain->mode & MW_MODE_EXY;
+#pragma omp parallel if (domain->ny >= 2*domain->nthreads)
+  {
+    int j, j0, j1;
+    mw_thread_rows(domain->ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      if (tm) {
+	step_tm_E(domain, state, j);
+      }
+      if (te) {
+	step_te_E(domain, state, j);
+      }
+      if (j > j0) {
+	if (tm) {
+	  step_tm_B(domain, state, j-1);
+	}
+	if (te) {
+	  step_te_B(domain, state, j);
+	}
+      }
+    }
+#pragma omp barrier
+    if (j0 > 0) {
+      if (tm) {
+	step_tm_B(domain, state, j0-1);
+      }
+      if (te) {
+	step_te_B(domain, state, j0);
+      }
+    }
+  }
+}
+
+/* Move the E and B fields forward nsteps timesteps in bfloat16,
+   updating the forcing each timestep, then convert them back into
+   the fields of the domain */
+int
+mw_step_bf16(mwDomain *domain, int nsteps)
+{
+  bf16State *state;
+  int l;
+
+  MW_CHECK(mw_init_coefficients(domain));
+  MW_CHECK(init_bf16(domain));
+  state = (bf16State*) domain->bf16;
+
+  for (l = 0; l < nsteps; l++) {
+    mw_set_forcing(domain);
+    mw_grow_active(domain, 1);
+    step(domain, state);
+    domain->time += domain->dt;
+  }
+
+  /* Outside the active region both copies are still zero */
+  if (domain->active_i0 < domain->active_i1) {
+#pragma omp parallel
+    {
+      int j0, j1, k;
+      mw_thread_rows(domain->ny, &j0, &j1);
+      if (j0 < domain->active_j0) {
+	j0 = domain->active_j0;
+      }
+      if (j1 > domain->active_j1) {
+	j1 = domain->active_j1;
+      }
+      for (k = 0; k < NFIELDS; k++) {
+	if (state->field[k]) {
+	  from_bf16(domain_field(domain, k), state->field[k],
+		    domain->active_i0, domain->active_i1, j0, j1);
+	}
+      }
+    }
+  }
+  return MW_SUCCESS;
+}
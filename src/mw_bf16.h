@@ -0,0 +1,54 @@
+/* mw_bf16.h -- Conversions between float and bfloat16
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MW_BF16_H
+#define _MW_BF16_H 1
+
+#include <stdint.h>
+
+/* The bits of a float */
+typedef union {
+  float f;
+  uint32_t u;
+} mwFloatBits;
+
+/* Return the float that a bfloat16 value stands for, which is exact */
+static inline
+float
+mw_from_bf16(mwBf16 h)
+{
+  mwFloatBits x;
+  x.u = ((uint32_t) h) << 16;
+  return x.f;
+}
+
+/* Return the bfloat16 value nearest to "f", rounding halfway cases
+   to even; the rounding carries into the exponent where necessary,
+   so values just below a power of two round up to it */
+static inline
+mwBf16
+mw_to_bf16(float f)
+{
+  mwFloatBits x;
+  x.f = f;
+  x.u += 0x7fff + ((x.u >> 16) & 1);
+  return (mwBf16) (x.u >> 16);
+}
+
+#endif
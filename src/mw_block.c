@@ -0,0 +1,217 @@
+/* mw_block.c -- Advance the simulation several timesteps at a time
+   with temporal blocking
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk> 
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* When the domain is larger than the cache, calling mw_step
+   repeatedly streams every field through main memory on each
+   timestep. Here instead each thread advances its band of rows
+   through all the timesteps of a frame in one pass:
+
+   1. Each band is advanced as a trapezoid in (row, time) that loses
+      one row at each internal edge per timestep, so that it depends
+      only on values within the band. Within the trapezoid the rows
+      are visited as a wavefront: at position s, timestep t updates E
+      in row s-2t and B in row s-2t-1, so only about 2*nsteps rows
+      need to be in cache at once. If the rows are long, the columns
+      are also divided into strips that are skewed in the same way.
+
+   2. After all threads have finished, the inverted triangles between
+      neighbouring bands are filled in, one timestep at a time.
+
+   Because each value is stored only once, the triangles rely on the
+   trapezoids having left the rows at their edges at exactly the
+   timestep at which the triangle needs them. The E field of Ez
+   depends on B in rows j-1 and j, and Bx/By on Ez in rows j and j+1,
+   while for Ex/Ey and Bz the dependencies are the other way round,
+   hence the trapezoids of the two polarizations differ by one row for
+   the E field. The results are identical to calling mw_step
+   repeatedly. */
+
+#include "maxwell.h"
+
+/* Polarizations */
+#define TM 0
+#define TE 1
+
+/* The number of extra rows by which the trapezoid for the E field of
+   each polarization extends below and above that of the B field */
+static const int E_extra_below[2] = { 0, 1 };
+static const int E_extra_above[2] = { 1, 0 };
+
+/* Find the range of rows [*r0,*r1) of the E field (if is_E) or B
+   field of polarization "pol" at timestep t of the trapezoid for the
+   band [j0,j1) of a domain with ny rows. The trapezoid only shrinks at
+   edges that are internal to the domain. */
+static
+void
+trapezoid_rows(int pol, int is_E, int t, int j0, int j1, int ny,
+	       int *r0, int *r1)
+{
+  *r0 = j0 + t;
+  *r1 = j1 - t;
+  if (is_E) {
+    *r0 -= E_extra_below[pol];
+    *r1 += E_extra_above[pol];
+  }
+  if (j0 == 0) {
+    *r0 = 0;
+  }
+  if (j1 == ny) {
+    *r1 = ny;
+  }
+}
+
+/* Increment row j of the E field of polarization pol between
+   columns i0 and i1-1 */
+static
+void
+step_E(mwDomain *domain, int pol, mwForcing *forcing, int j, int i0, int i1)
+{
+  if (pol == TM) {
+    mw_step_tm_E(domain, forcing, j, i0, i1, MW_PART_ALL);
+  }
+  else {
+    mw_step_te_E(domain, forcing, j, i0, i1, MW_PART_ALL);
+  }
+}
+
+/* Increment row j of the B field of polarization pol between
+   columns i0 and i1-1 */
+static
+void
+step_B(mwDomain *domain, int pol, int j, int i0, int i1)
+{
+  if (pol == TM) {
+    mw_step_tm_B(domain, j, i0, i1, MW_PART_ALL);
+  }
+  else {
+    mw_step_te_B(domain, j, i0, i1, MW_PART_ALL);
+  }
+}
+
+/* Advance the trapezoid of the band of rows [j0,j1) through nsteps
+   timesteps, with forcing[t-1] being the forcing for timestep t */
+static
+void
+advance_trapezoid(mwDomain *domain, mwForcing *forcing, int nsteps,
+		  int j0, int j1)
+{
+  int width = domain->block_cols;
+  int c0, s, t, pol;
+  if (width <= 0) {
+    width = domain->nx + 2*nsteps + 1;
+  }
+  /* Loop over strips of columns in skewed coordinates */
+  for (c0 = 0; c0 - 2*nsteps - 1 < domain->nx; c0 += width) {
+    /* Wavefront over rows */
+    for (s = j0 - 1; s < j1 + 2*nsteps + 1; s++) {
+      for (t = 1; t <= nsteps; t++) {
+	int jE = s - 2*t;
+	int jB = jE - 1;
+	int iE = c0 - 2*t;
+	int iB = iE - 1;
+	for (pol = TM; pol <= TE; pol++) {
+	  int r0, r1;
+	  if (!(domain->mode & (pol == TM ? MW_MODE_EZ : MW_MODE_EXY))) {
+	    continue;
+	  }
+	  trapezoid_rows(pol, 1, t, j0, j1, domain->ny, &r0, &r1);
+	  if (jE >= r0 && jE < r1) {
+	    step_E(domain, pol, forcing+t-1, jE, iE, iE+width);
+	  }
+	  trapezoid_rows(pol, 0, t, j0, j1, domain->ny, &r0, &r1);
+	  if (jB >= r0 && jB < r1) {
+	    step_B(domain, pol, jB, iB, iB+width);
+	  }
+	}
+      }
+    }
+  }
+}
+
+/* Fill in the inverted triangle between the trapezoid of the band
+   below row b and the trapezoid of the band starting at row b */
+static
+void
+advance_triangle(mwDomain *domain, mwForcing *forcing, int nsteps, int b)
+{
+  int t, pol, j;
+  for (t = 1; t <= nsteps; t++) {
+    for (pol = TM; pol <= TE; pol++) {
+      if (!(domain->mode & (pol == TM ? MW_MODE_EZ : MW_MODE_EXY))) {
+	continue;
+      }
+      for (j = b - t + E_extra_above[pol]; j < b + t - E_extra_below[pol];
+	   j++) {
+	step_E(domain, pol, forcing+t-1, j, 0, domain->nx);
+      }
+      for (j = b - t; j < b + t; j++) {
+	step_B(domain, pol, j, 0, domain->nx);
+      }
+    }
+  }
+}
+
+/* Move the E and B fields forward nsteps timesteps with temporal
+   blocking, updating the forcing each timestep. If the bands of rows
+   belonging to each thread are too narrow for the trapezoids, or the
+   fourth-order stencil is in use (which would need trapezoids twice
+   as steep), then mw_step is simply called nsteps times. */
+int
+mw_step_blocked(mwDomain *domain, int nsteps)
+{
+  mwForcing forcing[MW_MINOR_STEPS];
+  int l;
+
+  if (nsteps > MW_MINOR_STEPS || domain->kernels4
+      || domain->ny < domain->nthreads*(2*nsteps+2)) {
+    for (l = 0; l < nsteps; l++) {
+      mw_set_forcing(domain);
+      MW_CHECK(mw_step(domain));
+    }
+    return MW_SUCCESS;
+  }
+
+  MW_CHECK(mw_init_coefficients(domain));
+
+  /* Compute the forcing for each timestep in advance */
+  for (l = 0; l < nsteps; l++) {
+    mw_set_forcing(domain);
+    forcing[l] = domain->forcing;
+    domain->time += domain->dt;
+  }
+
+  /* The active region is enlarged for all the timesteps at once, so
+     in earlier timesteps some pixels that are still zero are
+     updated */
+  mw_grow_active(domain, nsteps);
+
+#pragma omp parallel
+  {
+    int j0, j1;
+    mw_thread_rows(domain->ny, &j0, &j1);
+    advance_trapezoid(domain, forcing, nsteps, j0, j1);
+#pragma omp barrier
+    if (j0 > 0) {
+      advance_triangle(domain, forcing, nsteps, j0);
+    }
+  }
+
+  return MW_SUCCESS;
+}
@@ -22,6 +22,7 @@
 
 /* Return the maximum of the nine numbers entered, but incremented by
    1.0 if they are all the same */
+static
 real
 get_max(real r1, real r2, real r3, real r4, real r5,
 	real r6, real r7, real r8, real r9)
@@ -44,17 +45,20 @@ get_max(real r1, real r2, real r3, real r4, real r5,
   return rmax;
 }
 
-/* Set the domain->boundaries matrix to contain ones and zeros
-   demarking the edges of the regions of different dielectric
-   constant */
+/* Set rows j0 to j1-1 of the domain->boundaries matrix to contain
+   ones and zeros demarking the edges of the regions of different
+   dielectric constant */
 int
-mw_find_boundaries(mwDomain *domain)
+mw_find_boundary_rows(mwDomain *domain, int j0, int j1)
 {
   int i, j;
-  /* Assume the domain is already set to zeros */
+  /* Assume the rows are already set to zeros */
+  if (j0 < 1) {
+    j0 = 1;
+  }
 
   /* Decide if each pixel should be set as a boundary */
-  for (j = 1; j < domain->ny-2; j++) {
+  for (j = j0; j < j1 && j < domain->ny-2; j++) {
     for (i = 1; i < domain->nx-2; i++) {
       real emax = get_max(domain->epsilon[j-1][i-1],
 			  domain->epsilon[j-1][i],
@@ -71,5 +75,28 @@ mw_find_boundaries(mwDomain *domain)
     }
   }
 
+  /* Perfect conductors do not change epsilon, so their edges are the
+     conductor pixels with a neighbour that is not a conductor */
+  if (domain->conductor) {
+    unsigned char **conductor = domain->conductor;
+    for (j = j0; j < j1 && j < domain->ny-1; j++) {
+      for (i = 1; i < domain->nx-1; i++) {
+	if (conductor[j][i]
+	    && !(conductor[j-1][i] && conductor[j+1][i]
+		 && conductor[j][i-1] && conductor[j][i+1])) {
+	  domain->boundaries[j][i] = 1.0;
+	}
+      }
+    }
+  }
+
   return MW_SUCCESS;
 }
+
+/* Set the whole of the domain->boundaries matrix, which is assumed
+   to be already set to zeros */
+int
+mw_find_boundaries(mwDomain *domain)
+{
+  return mw_find_boundary_rows(domain, 0, domain->ny);
+}
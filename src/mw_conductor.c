@@ -0,0 +1,270 @@
+/* mw_conductor.c -- Perfect electric conductors, whose interiors are
+   excluded from the field updates
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "maxwell.h"
+
+/* Metal used to be represented by a dielectric with a very large
+   refractive index, which still costs a full update of every pixel
+   inside it. A perfect electric conductor instead holds the electric
+   field at its pixels at zero, simply by never updating it, and a
+   magnetic-field component whose neighbouring electric field is all
+   inside a conductor never changes either. Each row of the three
+   masks below is a list of the runs of columns that do need to be
+   updated, so the conductor interiors cost nothing. */
+
+/* The fields that the masks apply to */
+#define MASK_E 0
+#define MASK_TM_B 1
+#define MASK_TE_B 2
+
+/* Mark pixel (i,j) as a perfect electric conductor, allocating the
+   conductor field the first time */
+int
+mw_set_conductor(mwDomain *domain, int i, int j)
+{
+  if (!domain->conductor) {
+    int k;
+    domain->conductor = (unsigned char**)
+      malloc(sizeof(unsigned char*)*domain->ny);
+    if (domain->conductor) {
+      *domain->conductor = (unsigned char*)
+	calloc(domain->nx*domain->ny, sizeof(unsigned char));
+    }
+    if (!domain->conductor || !*domain->conductor) {
+      fprintf(stderr, "Error allocating the conductor field\n");
+      return MW_FAILURE;
+    }
+    for (k = 1; k < domain->ny; k++) {
+      domain->conductor[k] = domain->conductor[0] + k*domain->nx;
+    }
+  }
+  domain->conductor[j][i] = 1;
+  return MW_SUCCESS;
+}
+
+/* Return column (or row) i of a domain n pixels across, wrapped
+   around if the edges are "periodic", or -1 if it is outside the
+   domain */
+static
+int
+neighbour(int n, int periodic, int i)
+{
+  if (i >= 0 && i < n) {
+    return i;
+  }
+  return periodic ? (i+n)%n : -1;
+}
+
+/* Return 1 if the field of the specified kind at pixel (i,j) never
+   changes, 0 otherwise. Ez, Ex and Ey are held at zero inside a
+   conductor. Bx and By at (i,j) depend on Ez at (i+1,j), (i,j+1) and
+   (i+1,j+1), and Bz at (i,j) on Ex and Ey at (i-1,j), (i,j-1) and
+   (i-1,j-1), so they stay at zero if all those pixels are in a
+   conductor, where those beyond a periodic edge are at the opposite
+   edge. */
+static
+int
+frozen(mwDomain *domain, int kind, int i, int j)
+{
+  unsigned char **conductor = domain->conductor;
+  int step = (kind == MASK_TM_B) ? 1 : -1;
+  int in, jn;
+  if (kind == MASK_E) {
+    return conductor[j][i];
+  }
+  in = neighbour(domain->nx, domain->periodic & MW_PERIODIC_X, i+step);
+  jn = neighbour(domain->ny, domain->periodic & MW_PERIODIC_Y, j+step);
+  return in >= 0 && jn >= 0
+    && conductor[j][in] && conductor[jn][i] && conductor[jn][in];
+}
+
+/* Find the runs of columns in row j in which the field of the
+   specified kind is updated, storing them in "runs" if it is not
+   NULL, and return the number of them */
+static
+int
+row_runs(mwDomain *domain, int kind, int j, mwRun *runs)
+{
+  int i = 0, n = 0;
+  while (i < domain->nx) {
+    int i0;
+    while (i < domain->nx && frozen(domain, kind, i, j)) {
+      i++;
+    }
+    i0 = i;
+    while (i < domain->nx && !frozen(domain, kind, i, j)) {
+      i++;
+    }
+    if (i > i0) {
+      if (runs) {
+	runs[n].i0 = i0;
+	runs[n].i1 = i;
+      }
+      n++;
+    }
+  }
+  return n;
+}
+
+/* Build the mask for the field of the specified kind */
+static
+int
+init_mask(mwDomain *domain, int kind, mwMask *mask)
+{
+  int j;
+  mask->start = (int*) malloc(sizeof(int)*(domain->ny+1));
+  if (!mask->start) {
+    fprintf(stderr, "Error allocating the conductor mask\n");
+    return MW_FAILURE;
+  }
+  mask->start[0] = 0;
+  for (j = 0; j < domain->ny; j++) {
+    mask->start[j+1] = mask->start[j] + row_runs(domain, kind, j, NULL);
+  }
+  /* A row entirely inside a conductor has no runs, so allocate at
+     least one to avoid a zero-sized allocation */
+  mask->runs = (mwRun*) malloc(sizeof(mwRun)*(mask->start[domain->ny]+1));
+  if (!mask->runs) {
+    fprintf(stderr, "Error allocating the conductor mask\n");
+    return MW_FAILURE;
+  }
+  for (j = 0; j < domain->ny; j++) {
+    row_runs(domain, kind, j, mask->runs + mask->start[j]);
+  }
+  return MW_SUCCESS;
+}
+
+/* Free a mask, after which every column is updated */
+static
+void
+free_mask(mwMask *mask)
+{
+  if (mask->start) {
+    free(mask->start);
+  }
+  if (mask->runs) {
+    free(mask->runs);
+  }
+  mask->start = NULL;
+  mask->runs = NULL;
+}
+
+/* Build the masks from the conductor field, if there are any
+   conductors */
+int
+mw_init_conductors(mwDomain *domain)
+{
+  free_mask(&domain->E_mask);
+  free_mask(&domain->tm_B_mask);
+  free_mask(&domain->te_B_mask);
+  if (!domain->conductor) {
+    return MW_SUCCESS;
+  }
+  MW_CHECK(init_mask(domain, MASK_E, &domain->E_mask));
+  MW_CHECK(init_mask(domain, MASK_TM_B, &domain->tm_B_mask));
+  MW_CHECK(init_mask(domain, MASK_TE_B, &domain->te_B_mask));
+  return MW_SUCCESS;
+}
+
+/* Move the rows of the conductor field nrows down, as mw_shift_field
+   does for the fields, leaving the rows exposed at the top free of
+   conductors; the masks must then be rebuilt with
+   mw_init_conductors */
+void
+mw_shift_conductors(mwDomain *domain, int nrows)
+{
+  int nx = domain->nx, ny = domain->ny;
+  if (!domain->conductor) {
+    return;
+  }
+  if (nrows < ny) {
+    memmove(domain->conductor[0], domain->conductor[nrows],
+	    sizeof(unsigned char)*nx*(ny-nrows));
+  }
+  else {
+    nrows = ny;
+  }
+  memset(domain->conductor[ny-nrows], 0, sizeof(unsigned char)*nx*nrows);
+}
+
+/* Remove all the conductors */
+int
+mw_free_conductors(mwDomain *domain)
+{
+  free_mask(&domain->E_mask);
+  free_mask(&domain->tm_B_mask);
+  free_mask(&domain->te_B_mask);
+  if (domain->conductor) {
+    free(*domain->conductor);
+    free(domain->conductor);
+  }
+  domain->conductor = NULL;
+  return MW_SUCCESS;
+}
+
+/* Give "band", a copy of "domain" holding only its rows j0 to
+   j0+band->ny-1 (see mw_mpi.c), its own conductor field and masks
+   holding those rows. The masks are copied rather than rebuilt, since
+   those of the rows at the edges of the band depend on the conductors
+   in the rows beyond them. */
+int
+mw_crop_conductors(mwDomain *band, const mwDomain *domain, int j0)
+{
+  const mwMask *masks[3];
+  mwMask *band_masks[3];
+  int nx = band->nx, ny = band->ny;
+  int j, k;
+  if (!domain->conductor) {
+    return MW_SUCCESS;
+  }
+  band->conductor = NULL;
+  band->E_mask.start = band->tm_B_mask.start = band->te_B_mask.start = NULL;
+  band->E_mask.runs = band->tm_B_mask.runs = band->te_B_mask.runs = NULL;
+  /* Allocate the field, then overwrite the pixel this sets */
+  MW_CHECK(mw_set_conductor(band, 0, 0));
+  memcpy(*band->conductor, domain->conductor[j0],
+	 sizeof(unsigned char)*nx*ny);
+
+  masks[0] = &domain->E_mask;
+  masks[1] = &domain->tm_B_mask;
+  masks[2] = &domain->te_B_mask;
+  band_masks[0] = &band->E_mask;
+  band_masks[1] = &band->tm_B_mask;
+  band_masks[2] = &band->te_B_mask;
+  for (k = 0; k < 3; k++) {
+    const mwMask *mask = masks[k];
+    mwMask *band_mask = band_masks[k];
+    int first = mask->start[j0];
+    int nruns = mask->start[j0+ny] - first;
+    band_mask->start = (int*) malloc(sizeof(int)*(ny+1));
+    band_mask->runs = (mwRun*) malloc(sizeof(mwRun)*(nruns+1));
+    if (!band_mask->start || !band_mask->runs) {
+      fprintf(stderr, "Error allocating the conductor mask\n");
+      return MW_FAILURE;
+    }
+    for (j = 0; j <= ny; j++) {
+      band_mask->start[j] = mask->start[j0+j] - first;
+    }
+    memcpy(band_mask->runs, mask->runs+first, sizeof(mwRun)*nruns);
+  }
+  return MW_SUCCESS;
+}
@@ -0,0 +1,398 @@
+/* mw_cpml.c -- Convolutional perfectly matched layer at the edges of
+   the domain
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* The damping border set up by mw_reset_damping multiplies B by a
+   factor that falls gradually towards the edge, but any change of
+   impedance reflects, so a border of a few pixels reflects a few
+   percent of an incident wave. A perfectly matched layer instead
+   stretches the coordinate normal to the edge into the complex plane,
+   which in the continuous equations absorbs a wave at any angle
+   without reflection. In the convolutional form (CPML) each spatial
+   derivative d/dx across the layer is replaced by d/dx + psi, where
+   psi is an auxiliary field updated each timestep as
+
+     psi = b*psi + a*d/dx
+
+   with b = exp(-(sigma+alpha)*dt) and a = sigma/(sigma+alpha)*(b-1).
+   The conductivity sigma rises as the cube of the depth into the
+   layer, and the small "complex frequency shift" alpha, which falls
+   to zero at the outer edge, stops evanescent and very low-frequency
+   waves from growing. A layer of 10 pixels reflects about -90 dB of
+   a pulse with 20 pixels per wavelength and -45 dB of one with 10,
+   where a damping border of the same width reflects -10 to -20 dB.
+
+   The row kernels know nothing of the layer: the functions here are
+   called by the row functions in mw_step.c just after a kernel has
+   incremented a run of columns, and add the psi terms to the columns
+   within the layer using the same neighbours as the kernel, and on a
+   graded mesh (see mw_mesh.c) the same ratio of dx to the spacing.
+   The psi fields are only stored within the layer: those of the
+   x-derivatives in two strips down the left and right edges, and
+   those of the y-derivatives in two strips across the top and
+   bottom. There is no layer across a periodic edge or along a plane
+   of symmetry, although the strips are still allocated. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "maxwell.h"
+
+/* The psi fields, one for each derivative across the layer that
+   appears in the update of a component */
+#define PSI_EZ_X 0
+#define PSI_EZ_Y 1
+#define PSI_BX_Y 2
+#define PSI_BY_X 3
+#define PSI_EX_Y 4
+#define PSI_EY_X 5
+#define PSI_BZ_X 6
+#define PSI_BZ_Y 7
+#define NPSI 8
+
+/* The grading of sigma with depth into the layer */
+#define ORDER 3
+
+/* The weights of the fourth-order differences, as in mw_kernel4.c */
+#define C1 ((real) (9.0/8.0))
+#define C2 ((real) (1.0/24.0))
+
+typedef struct {
+  /* The thickness of the layer in pixels */
+  int width;
+  /* The coefficients for each column of a strip (or row, since the
+     layer is the same on all four edges), for the components at the
+     corners of the pixels [0] and half way along their sides [1] */
+  real *b[2];
+  real *a[2];
+  /* The psi fields of the main domain [0] and of the parallel
+     simulation in vacuum [1]; those of the x-derivatives have 2*width
+     columns and ny rows, and those of the y-derivatives nx columns
+     and 2*width rows */
+  real **psi[2][NPSI];
+  /* Whether each psi field is of an x-derivative */
+  int along_x[NPSI];
+} cpmlState;
+
+/* Return the index into a strip of the layer of column (or row) i of
+   a domain n pixels across, or -1 if it is not in the layer, the
+   edges are "periodic" or i is near a plane of symmetry at the first
+   edge. The outer edges of the layer are at columns 0 and n-1, where
+   the fields at the corners of the pixels are held at zero. */
+static
+int
+strip_index(int n, int width, int periodic, int symmetry, int i)
+{
+  if (periodic) {
+    return -1;
+  }
+  else if (i < width) {
+    return symmetry ? -1 : i;
+  }
+  else if (i >= n-1-width) {
+    return i-(n-1-width)+width;
+  }
+  return -1;
+}
+
+/* The difference f(i)-f(i-1) along a row, centred at i-1/2, or the
+   fourth-order equivalent */
+static
+real
+x_diff(int order4, const real *row, int i)
+{
+  real d = row[i] - row[i-1];
+  if (order4) {
+    d = C1*d - C2*(row[i+1] - row[i-2]);
+  }
+  return d;
+}
+
+/* The difference f(j)-f(j-1) down column i, centred at j-1/2, or the
+   fourth-order equivalent */
+static
+real
+y_diff(int order4, real **f, int j, int i)
+{
+  real d = f[j][i] - f[j-1][i];
+  if (order4) {
+    d = C1*d - C2*(f[j+1][i] - f[j-2][i]);
+  }
+  return d;
+}
+
+/* Update element k of row j of "psi", the psi field of an
+   x-derivative d at the corners of the pixels (half=0) or half way
+   along their sides (half=1), and return it */
+static
+real
+psi_x(cpmlState *state, real **psi, int half, int j, int k, real d)
+{
+  return psi[j][k] = state->b[half][k]*psi[j][k] + state->a[half][k]*d;
+}
+
+/* Execute "body" for each column i from i0 to i1-1 that is in the
+   left or right strip of the layer, with k its index into the
+   strip */
+#define FOR_X_STRIPS(domain, state, i0, i1, body)			\
+  {									\
+    int w = (state)->width;						\
+    int ranges[2][2] = {{0, w}, {(domain)->nx-1-w, (domain)->nx-1}};	\
+    int r = (domain)->symmetry_x ? 1 : 0;				\
+    for ( ; r < 2 && !((domain)->periodic & MW_PERIODIC_X); r++) {	\
+      int lo = ranges[r][0] > (i0) ? ranges[r][0] : (i0);		\
+      int hi = ranges[r][1] < (i1) ? ranges[r][1] : (i1);		\
+      int i;								\
+      for (i = lo; i < hi; i++) {					\
+	int k = i - ranges[r][0] + r*w;					\
+	body;								\
+      }									\
+    }									\
+  }
+
+/* Add the psi terms to row j, columns i0 to i1-1, of Ez, whose
+   prefix to the curl of B is Eprefix_const if it is non-zero and
+   otherwise is taken from the Eprefix field */
+void
+mw_cpml_tm_E(mwDomain *domain, int part, int j, int i0, int i1,
+	     real Eprefix_const)
+{
+  cpmlState *state = (cpmlState*) domain->cpml;
+  int p = (part == MW_PART_VACUUM);
+  int order4 = (domain->kernels4 != NULL);
+  real **Ez = p ? domain->Ez_vacuum : domain->Ez;
+  real **Bx = p ? domain->Bx_vacuum : domain->Bx;
+  real **By = p ? domain->By_vacuum : domain->By;
+  real **psi = state->psi[p][PSI_EZ_X];
+  int ky = strip_index(domain->ny, state->width,
+			domain->periodic & MW_PERIODIC_Y,
+			domain->symmetry_y, j);
+  int i;
+  FOR_X_STRIPS(domain, state, i0, i1, {
+      real prefix = Eprefix_const ? Eprefix_const : domain->Eprefix[j][i];
+      Ez[j][i] += prefix*psi_x(state, psi, 0, j, k, domain->dual_x[i]
+			       *x_diff(order4, By[j-1], i));
+    });
+  if (ky >= 0) {
+    real b = state->b[0][ky], a = state->a[0][ky];
+    real *psi_row = state->psi[p][PSI_EZ_Y][ky];
+    for (i = i0; i < i1; i++) {
+      real prefix = Eprefix_const ? Eprefix_const : domain->Eprefix[j][i];
+      psi_row[i] = b*psi_row[i]
+	- a*domain->dual_y[j]*y_diff(order4, Bx, j, i-1);
+      Ez[j][i] += prefix*psi_row[i];
+    }
+  }
+}
+
+/* Add the psi terms to row j, columns i0 to i1-1, of Bx and By */
+void
+mw_cpml_tm_B(mwDomain *domain, int part, int j, int i0, int i1)
+{
+  cpmlState *state = (cpmlState*) domain->cpml;
+  int p = (part == MW_PART_VACUUM);
+  int order4 = (domain->kernels4 != NULL);
+  real dt_dx = 0.5*domain->dt/domain->dx;
+  real **Ez = p ? domain->Ez_vacuum : domain->Ez;
+  real **Bx = p ? domain->Bx_vacuum : domain->Bx;
+  real **By = p ? domain->By_vacuum : domain->By;
+  real **psi = state->psi[p][PSI_BY_X];
+  int ky = strip_index(domain->ny, state->width,
+			domain->periodic & MW_PERIODIC_Y,
+			domain->symmetry_y, j);
+  int i;
+  FOR_X_STRIPS(domain, state, i0, i1, {
+      By[j][i] += dt_dx*psi_x(state, psi, 1, j, k, domain->ratio_x[i]
+			      *x_diff(order4, Ez[j+1], i+1));
+    });
+  if (ky >= 0) {
+    real b = state->b[1][ky], a = state->a[1][ky];
+    real *psi_row = state->psi[p][PSI_BX_Y][ky];
+    for (i = i0; i < i1; i++) {
+      psi_row[i] = b*psi_row[i]
+	+ a*domain->ratio_y[j]*y_diff(order4, Ez, j+1, i+1);
+      Bx[j][i] -= dt_dx*psi_row[i];
+    }
+  }
+}
+
+/* Add the psi terms to row j, columns i0 to i1-1, of Ex and Ey */
+void
+mw_cpml_te_E(mwDomain *domain, int part, int j, int i0, int i1,
+	     real Eprefix_const)
+{
+  cpmlState *state = (cpmlState*) domain->cpml;
+  int p = (part == MW_PART_VACUUM);
+  int order4 = (domain->kernels4 != NULL);
+  real **Ex = p ? domain->Ex_vacuum : domain->Ex;
+  real **Ey = p ? domain->Ey_vacuum : domain->Ey;
+  real **Bz = p ? domain->Bz_vacuum : domain->Bz;
+  real **psi = state->psi[p][PSI_EY_X];
+  int ky = strip_index(domain->ny, state->width,
+			domain->periodic & MW_PERIODIC_Y,
+			domain->symmetry_y, j);
+  int i;
+  FOR_X_STRIPS(domain, state, i0, i1, {
+      real prefix = Eprefix_const ? Eprefix_const : domain->Eprefix[j][i];
+      Ey[j][i] -= prefix*psi_x(state, psi, 1, j, k, domain->ratio_x[i]
+			       *x_diff(order4, Bz[j+1], i+1));
+    });
+  if (ky >= 0) {
+    real b = state->b[1][ky], a = state->a[1][ky];
+    real *psi_row = state->psi[p][PSI_EX_Y][ky];
+    for (i = i0; i < i1; i++) {
+      real prefix = Eprefix_const ? Eprefix_const : domain->Eprefix[j][i];
+      psi_row[i] = b*psi_row[i]
+	+ a*domain->ratio_y[j]*y_diff(order4, Bz, j+1, i+1);
+      Ex[j][i] += prefix*psi_row[i];
+    }
+  }
+}
+
+/* Add the psi terms to row j, columns i0 to i1-1, of Bz */
+void
+mw_cpml_te_B(mwDomain *domain, int part, int j, int i0, int i1)
+{
+  cpmlState *state = (cpmlState*) domain->cpml;
+  int p = (part == MW_PART_VACUUM);
+  int order4 = (domain->kernels4 != NULL);
+  real dt_dx = 0.5*domain->dt/domain->dx;
+  real **Ex = p ? domain->Ex_vacuum : domain->Ex;
+  real **Ey = p ? domain->Ey_vacuum : domain->Ey;
+  real **Bz = p ? domain->Bz_vacuum : domain->Bz;
+  real **psi = state->psi[p][PSI_BZ_X];
+  int ky = strip_index(domain->ny, state->width,
+			domain->periodic & MW_PERIODIC_Y,
+			domain->symmetry_y, j);
+  int i;
+  FOR_X_STRIPS(domain, state, i0, i1, {
+      Bz[j][i] -= dt_dx*psi_x(state, psi, 0, j, k, domain->dual_x[i]
+			      *x_diff(order4, Ey[j-1], i));
+    });
+  if (ky >= 0) {
+    real b = state->b[0][ky], a = state->a[0][ky];
+    real *psi_row = state->psi[p][PSI_BZ_Y][ky];
+    for (i = i0; i < i1; i++) {
+      psi_row[i] = b*psi_row[i]
+	- a*domain->dual_y[j]*y_diff(order4, Ex, j, i-1);
+      Bz[j][i] -= dt_dx*psi_row[i];
+    }
+  }
+}
+
+/* Set up a CPML "width" pixels thick on all four edges of the domain,
+   which should then have no damping border. This must be called once
+   the timestep and the primary frequency are known; the psi fields
+   start at zero. */
+int
+mw_new_cpml(mwDomain *domain, int width)
+{
+  cpmlState *state;
+  /* The time over which each update of E or B advances the fields */
+  real dt = 0.5*domain->dt;
+  /* The conductivity at the outer edge that minimizes the reflection
+     from the discretized layer, and the complex frequency shift at
+     the inner edge, both expressed as rates */
+  real sigma_max = 0.8*(ORDER+1)*domain->c/domain->dx;
+  real alpha_max = M_PI*domain->primary_frequency;
+  int half, k, p, l;
+
+  if (width < 1 || domain->nx < 2*width+2 || domain->ny < 2*width+2) {
+    fprintf(stderr, "A CPML %d pixels wide does not fit in a %dx%d domain\n",
+	    width, domain->nx, domain->ny);
+    return MW_FAILURE;
+  }
+  mw_free_cpml(domain);
+  state = (cpmlState*) calloc(1, sizeof(cpmlState));
+  if (!state) {
+    fprintf(stderr, "Error allocating the CPML\n");
+    return MW_FAILURE;
+  }
+  domain->cpml = state;
+  state->width = width;
+
+  for (half = 0; half < 2; half++) {
+    state->b[half] = (real*) malloc(sizeof(real)*2*width);
+    state->a[half] = (real*) malloc(sizeof(real)*2*width);
+    if (!state->b[half] || !state->a[half]) {
+      fprintf(stderr, "Error allocating the CPML\n");
+      return MW_FAILURE;
+    }
+    for (k = 0; k < 2*width; k++) {
+      /* The depth into the layer, from 0 at its inner edge to 1 at
+	 the edge of the domain */
+      real depth = k < width ? (width-k-0.5*half)/width
+	: (k-width+0.5*half)/width;
+      real sigma = sigma_max*pow(depth, ORDER);
+      real alpha = alpha_max*(1.0-depth);
+      real b = exp(-(sigma+alpha)*dt);
+      state->b[half][k] = b;
+      state->a[half][k] = sigma > 0.0 ? sigma/(sigma+alpha)*(b-1.0) : 0.0;
+    }
+  }
+
+  state->along_x[PSI_EZ_X] = state->along_x[PSI_BY_X]
+    = state->along_x[PSI_EY_X] = state->along_x[PSI_BZ_X] = 1;
+  for (p = 0; p < 2; p++) {
+    if (p == 1 && !(domain->mode & MW_MODE_VACUUM)) {
+      break;
+    }
+    for (l = 0; l < NPSI; l++) {
+      int tm = (l <= PSI_BY_X);
+      int status;
+      if (!(domain->mode & (tm ? MW_MODE_EZ : MW_MODE_EXY))) {
+	continue;
+      }
+      if (state->along_x[l]) {
+	status = mw_new_field(&state->psi[p][l], 2*width, domain->ny, 0.0);
+      }
+      else {
+	status = mw_new_field(&state->psi[p][l], domain->nx, 2*width, 0.0);
+      }
+      if (status != MW_SUCCESS) {
+	fprintf(stderr, "Error allocating the CPML\n");
+	return MW_FAILURE;
+      }
+    }
+  }
+  domain->cpml_width = width;
+  return MW_SUCCESS;
+}
+
+/* Free the CPML of a domain, if it has one */
+void
+mw_free_cpml(mwDomain *domain)
+{
+  cpmlState *state = (cpmlState*) domain->cpml;
+  int half, p, l;
+  if (!state) {
+    return;
+  }
+  for (half = 0; half < 2; half++) {
+    free(state->b[half]);
+    free(state->a[half]);
+  }
+  for (p = 0; p < 2; p++) {
+    for (l = 0; l < NPSI; l++) {
+      mw_free_field(state->psi[p][l]);
+    }
+  }
+  free(state);
+  domain->cpml = NULL;
+}
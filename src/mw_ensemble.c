@@ -0,0 +1,363 @@
+/* mw_ensemble.c -- Run several simulations of the same scene at once,
+   differing only in the frequency or amplitude of the oscillators
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "maxwell.h"
+
+/* A frequency or amplitude sweep runs the same scene many times. The
+   members of an ensemble share everything that describes the scene
+   (epsilon, the damping and prefix coefficients, the material table,
+   the conductors and the oscillators), and each has its own
+   electromagnetic fields, Poynting vector summation and output file.
+   mw_frame_ensemble advances each row in all the members in turn, so
+   the coefficients of the row are read from memory once for the
+   whole ensemble. The damping of lossy materials depends on the
+   frequency, so a member of a lossy scene whose frequency differs
+   from that of the first member computes its own coefficients.
+
+   If the edges of the domain are Bloch-periodic (see mw_periodic.c)
+   then each member has a partner holding the imaginary part of its
+   fields, which shares its coefficients. The partners are stored after
+   the members in the same array, so the ensemble of n members
+   occupies 2n domains, but the caller still sees n. */
+
+/* Allocate the fields that a member of an ensemble does not share
+   with the first member */
+static
+int
+new_member_fields(mwDomain *member)
+{
+  int nx = member->nx, ny = member->ny;
+  int status = MW_SUCCESS;
+  member->Ex = member->Ey = member->Ez = NULL;
+  member->Bx = member->By = member->Bz = NULL;
+  member->Ex_vacuum = member->Ey_vacuum = member->Ez_vacuum = NULL;
+  member->Bx_vacuum = member->By_vacuum = member->Bz_vacuum = NULL;
+  member->scat_field = NULL;
+  member->Poynting_x_scat = member->Poynting_y_scat = NULL;
+  if (member->mode & MW_MODE_EXY) {
+    status |= mw_new_field(&member->Ex, nx, ny, 0.0);
+    status |= mw_new_field(&member->Ey, nx, ny, 0.0);
+    status |= mw_new_field(&member->Bz, nx, ny, 0.0);
+  }
+  if (member->mode & MW_MODE_EZ) {
+    status |= mw_new_field(&member->Ez, nx, ny, 0.0);
+    status |= mw_new_field(&member->Bx, nx, ny, 0.0);
+    status |= mw_new_field(&member->By, nx, ny, 0.0);
+  }
+  if (member->cpml) {
+    /* The psi fields of the CPML evolve with the fields */
+    member->cpml = NULL;
+    status |= mw_new_cpml(member, member->cpml_width);
+  }
+  if (member->mode & MW_MODE_VACUUM) {
+    if (member->mode & MW_MODE_EXY) {
+      status |= mw_new_field(&member->Ex_vacuum, nx, ny, 0.0);
+      status |= mw_new_field(&member->Ey_vacuum, nx, ny, 0.0);
+      status |= mw_new_field(&member->Bz_vacuum, nx, ny, 0.0);
+    }
+    if (member->mode & MW_MODE_EZ) {
+      status |= mw_new_field(&member->Ez_vacuum, nx, ny, 0.0);
+      status |= mw_new_field(&member->Bx_vacuum, nx, ny, 0.0);
+      status |= mw_new_field(&member->By_vacuum, nx, ny, 0.0);
+    }
+    status |= mw_new_field(&member->scat_field, nx, ny, 0.0);
+    status |= mw_new_sum(&member->Poynting_x_scat, nx, ny);
+    status |= mw_new_sum(&member->Poynting_y_scat, nx, ny);
+  }
+  status |= mw_new_sum(&member->Poynting_x, nx, ny);
+  status |= mw_new_sum(&member->Poynting_y, nx, ny);
+  if (status != MW_SUCCESS) {
+    fprintf(stderr, "Error allocating the fields of ensemble member %d\n",
+	    member->member);
+    return MW_FAILURE;
+  }
+  return MW_SUCCESS;
+}
+
+/* Give a member its own copy of the imaginary part of the
+   susceptibility, from which mw_init_coefficients will compute its
+   own coefficients */
+static
+int
+own_coefficients(mwDomain *member, real **Edamping)
+{
+  int j;
+  if (mw_new_field(&member->Edamping, member->nx, member->ny, 0.0)) {
+    fprintf(stderr, "Error allocating the coefficients of ensemble member %d\n",
+	    member->member);
+    return MW_FAILURE;
+  }
+  for (j = 0; j < member->ny; j++) {
+    memcpy(member->Edamping[j], Edamping[j], sizeof(real)*member->nx);
+  }
+  return MW_SUCCESS;
+}
+
+/* Share the coefficients computed by mw_init_coefficients for the
+   first member "leader" with "member" */
+static
+void
+share_coefficients(mwDomain *member, mwDomain *leader)
+{
+  member->Edamping = leader->Edamping;
+  member->Eprefix = leader->Eprefix;
+  member->Eprefix_uniform = leader->Eprefix_uniform;
+  member->lossless = leader->lossless;
+  member->material = leader->material;
+  member->material_Edamping = leader->material_Edamping;
+  member->material_Eprefix = leader->material_Eprefix;
+  member->material_rows = leader->material_rows;
+  member->nmaterials = leader->nmaterials;
+  member->E_mask = leader->E_mask;
+  member->tm_B_mask = leader->tm_B_mask;
+  member->te_B_mask = leader->te_B_mask;
+}
+
+/* Return 1 if any material in the domain absorbs, 0 otherwise; this
+   must be called before mw_init_coefficients converts Edamping from
+   the imaginary part of the susceptibility to a damping factor */
+static
+int
+is_lossy(mwDomain *domain)
+{
+  int i, j;
+  for (j = 0; j < domain->ny; j++) {
+    for (i = 0; i < domain->nx; i++) {
+      if (domain->Edamping[j][i] != 0.0) {
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Create an ensemble from a domain initialized by mw_start, according
+   to the "ensemble_frequency" and "ensemble_amplitude" config
+   vectors, which give the frequency and the factor by which the
+   amplitude of the oscillators is multiplied in each member. The
+   members are returned in a newly allocated array "members", of which
+   the first takes over the fields of "domain". Without either vector
+   there is one member identical to "domain". */
+int
+mw_new_ensemble(mwDomain *domain, mwDomain **members, int *nmembers)
+{
+  rc_real *frequency, *amplitude;
+  int nfrequency = 0, namplitude = 0;
+  int n = 1, m, lossy = 0;
+  mwDomain *ensemble;
+  mwSource *partner_sources = NULL;
+
+  frequency = rc_get_real_vector(domain->config, "ensemble_frequency",
+				 &nfrequency);
+  amplitude = rc_get_real_vector(domain->config, "ensemble_amplitude",
+				 &namplitude);
+  if (frequency && amplitude && nfrequency != namplitude) {
+    fprintf(stderr, "Config variables \"ensemble_frequency\" and \"ensemble_amplitude\" must have the same length\n");
+    return MW_FAILURE;
+  }
+  if (frequency && nfrequency > 0) {
+    n = nfrequency;
+  }
+  else if (amplitude && namplitude > 0) {
+    n = namplitude;
+  }
+
+  ensemble = (mwDomain*) malloc(sizeof(mwDomain)*(domain->bloch ? 2*n : n));
+  if (!ensemble) {
+    fprintf(stderr, "Error allocating the ensemble\n");
+    return MW_FAILURE;
+  }
+  if (n > 1 && domain->subgrid) {
+    fprintf(stderr, "An ensemble cannot have subgrid patches\n");
+    return MW_FAILURE;
+  }
+  if (n > 1 && domain->window_speed > 0.0) {
+    fprintf(stderr, "An ensemble cannot have a moving window\n");
+    return MW_FAILURE;
+  }
+  if (frequency && n > 1) {
+    lossy = is_lossy(domain);
+  }
+  if (domain->bloch) {
+    /* Give the oscillators their Bloch phase before they are shared */
+    MW_CHECK(mw_split_bloch_sources(domain, &partner_sources));
+  }
+
+  for (m = 0; m < n; m++) {
+    mwDomain *member = ensemble+m;
+    *member = *domain;
+    member->member = m;
+    member->nmembers = n;
+    if (frequency) {
+      /* Each member oscillates at a single frequency, replacing any
+	 "frequencies" vector */
+      member->primary_frequency = frequency[m];
+      member->nfrequencies = 0;
+    }
+    if (amplitude) {
+      member->Ex_amplitude *= amplitude[m];
+      member->Ey_amplitude *= amplitude[m];
+      member->Ez_amplitude *= amplitude[m];
+    }
+    if (m > 0) {
+      MW_CHECK(new_member_fields(member));
+      if (lossy && frequency[m] != frequency[0]) {
+	MW_CHECK(own_coefficients(member, domain->Edamping));
+      }
+    }
+  }
+
+  if (domain->bloch) {
+    for (m = 0; m < n; m++) {
+      mwDomain *partner = ensemble+n+m;
+      *partner = ensemble[m];
+      MW_CHECK(new_member_fields(partner));
+      partner->sources = partner_sources;
+      partner->max_sources = partner->nsources;
+      partner->bloch_quadrature = 1;
+      partner->bloch_partner = ensemble+m;
+      ensemble[m].bloch_partner = partner;
+    }
+  }
+
+  if (frequency) {
+    free(frequency);
+  }
+  if (amplitude) {
+    free(amplitude);
+  }
+  *members = ensemble;
+  *nmembers = n;
+  return MW_SUCCESS;
+}
+
+/* Compute the coefficients of the members of an ensemble, if this has
+   not already been done: those of the first member, which the others
+   share unless they have their own copy of Edamping. Like
+   mw_init_coefficients this is done before the first timestep rather
+   than by mw_new_ensemble, since until then Edamping still holds the
+   imaginary part of the susceptibility that mw_nc_init writes out. */
+int
+mw_init_ensemble_coefficients(mwDomain *members, int nmembers)
+{
+  int m;
+  MW_CHECK(mw_init_coefficients(members));
+  for (m = 1; m < nmembers; m++) {
+    if (members[m].Edamping == members->Edamping) {
+      share_coefficients(members+m, members);
+    }
+    else {
+      MW_CHECK(mw_init_coefficients(members+m));
+    }
+  }
+  if (members->bloch) {
+    for (m = 0; m < nmembers; m++) {
+      share_coefficients(members+nmembers+m, members+m);
+    }
+  }
+  return MW_SUCCESS;
+}
+
+/* Free the fields allocated by new_member_fields */
+static
+void
+free_member_fields(mwDomain *member)
+{
+  mw_free_field(member->Ex);
+  mw_free_field(member->Ey);
+  mw_free_field(member->Ez);
+  mw_free_field(member->Bx);
+  mw_free_field(member->By);
+  mw_free_field(member->Bz);
+  mw_free_field(member->Ex_vacuum);
+  mw_free_field(member->Ey_vacuum);
+  mw_free_field(member->Ez_vacuum);
+  mw_free_field(member->Bx_vacuum);
+  mw_free_field(member->By_vacuum);
+  mw_free_field(member->Bz_vacuum);
+  mw_free_field(member->scat_field);
+  mw_free_sum(member->Poynting_x);
+  mw_free_sum(member->Poynting_y);
+  mw_free_sum(member->Poynting_x_scat);
+  mw_free_sum(member->Poynting_y_scat);
+  mw_free_lod(member);
+  mw_free_bf16(member);
+  mw_free_cpml(member);
+}
+
+/* Free an ensemble created by mw_new_ensemble, including the fields
+   of its first member and the Bloch partners */
+int
+mw_free_ensemble(mwDomain *members, int nmembers)
+{
+  int m;
+  if (members->bloch) {
+    /* The partners share their coefficients and oscillators */
+    free(members[nmembers].sources);
+    for (m = 0; m < nmembers; m++) {
+      free_member_fields(members+nmembers+m);
+    }
+  }
+  for (m = 1; m < nmembers; m++) {
+    mwDomain *member = members+m;
+    free_member_fields(member);
+    if (member->Edamping != members->Edamping) {
+      mw_free_field(member->Edamping);
+      mw_free_field(member->Eprefix);
+      mw_free_materials(member);
+      /* Free the masks but not the conductor field, which is shared */
+      member->conductor = NULL;
+      mw_free_conductors(member);
+    }
+  }
+  mw_free_domain(members);
+  free(members);
+  return MW_SUCCESS;
+}
+
+/* Return the name of the file to which "member" should write its
+   output: "filename" itself if there is only one member, otherwise
+   with the index of the member inserted before the extension, so that
+   "maxwell.nc" becomes "maxwell_0.nc", "maxwell_1.nc" and so on. The
+   result should be freed with free(). */
+char *
+mw_member_filename(const char *filename, mwDomain *member)
+{
+  const char *dot = strrchr(filename, '.');
+  const char *slash = strrchr(filename, '/');
+  char *name = (char*) malloc(strlen(filename) + 16);
+  int stem;
+  if (!name) {
+    fprintf(stderr, "Error allocating a file name\n");
+    return NULL;
+  }
+  if (member->nmembers <= 1) {
+    strcpy(name, filename);
+    return name;
+  }
+  if (!dot || (slash && dot < slash)) {
+    dot = filename + strlen(filename);
+  }
+  stem = dot - filename;
+  sprintf(name, "%.*s_%d%s", stem, filename, member->member, dot);
+  return name;
+}
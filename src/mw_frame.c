@@ -20,111 +20,229 @@
 #include <math.h>
 #include "maxwell.h"
 
-/* Run a "frame" of the simulation (usually 7 timesteps) and calculate
-   the Poynting vector summation */
+/* Set the amplitude of the oscillator forcing for the timestep
+   starting at the current time */
 int
-mw_frame(mwDomain *domain)
+mw_set_forcing(mwDomain *domain)
 {
-  int i, j, l;
-  /* The Poynting vector calculation is multiplied by 0.5 because of
-     the need to use B-field values at two points on the grid, and is
-     divided by the magnetic constant to yield the correct units */
-  real POYNTING_FACTOR = 0.5 / (4.0 * M_PI * 1.0e-7);
-
-  /* Run simulation forward several timesteps, updating the "forcing"
-     each time */
-  for (l = 0; l < MW_MINOR_STEPS; l++) {
-    if (domain->time*domain->primary_frequency < domain->cycles) {
-      real oscillatorI = 0.0, oscillatorQ = 0.0;
-      if (domain->nfrequencies == 0) {
-	/* Only a primary_frequency has been assigned */
-	oscillatorI = sin(domain->time*domain->primary_frequency*2.0*M_PI);
-	oscillatorQ = cos(domain->time*domain->primary_frequency*2.0*M_PI);
-      }
-      else {
-	/* The "frequencies" vector is treated in groups of three,
-	   with the first element being the frequency, the second the
-	   amplitude scaling and the third the phase offset in
-	   degrees */
-	int ifreq;
-	for (ifreq = 0; ifreq < domain->nfrequencies; ifreq++) {
-	  oscillatorI += domain->frequencies[ifreq*3+1]
-	    *sin(2.0*M_PI*(domain->time*domain->frequencies[ifreq*3]
-			   +domain->frequencies[ifreq*3+2]));
-	  oscillatorQ += domain->frequencies[ifreq*3+1]
-	    *cos(2.0*M_PI*(domain->time*domain->frequencies[ifreq*3]
-			   +domain->frequencies[ifreq*3+2]));
-	}
-      }
-      domain->Ex_forcingI = domain->Ex_amplitude*oscillatorI;
-      domain->Ey_forcingI = domain->Ey_amplitude*oscillatorI;
-      domain->Ez_forcingI = domain->Ez_amplitude*oscillatorI;
-      domain->Ex_forcingQ = domain->Ex_amplitude*oscillatorQ;
-      domain->Ey_forcingQ = domain->Ey_amplitude*oscillatorQ;
-      domain->Ez_forcingQ = domain->Ez_amplitude*oscillatorQ;
+  if (domain->time*domain->primary_frequency < domain->cycles) {
+    real oscillatorI = 0.0, oscillatorQ = 0.0;
+    if (domain->nfrequencies == 0) {
+      /* Only a primary_frequency has been assigned */
+      oscillatorI = sin(domain->time*domain->primary_frequency*2.0*M_PI);
+      oscillatorQ = cos(domain->time*domain->primary_frequency*2.0*M_PI);
     }
     else {
-      domain->Ex_forcingI = 0.0;
-      domain->Ey_forcingI = 0.0;
-      domain->Ez_forcingI = 0.0;
-      domain->Ex_forcingQ = 0.0;
-      domain->Ey_forcingQ = 0.0;
-      domain->Ez_forcingQ = 0.0;
+      /* The "frequencies" vector is treated in groups of three,
+	 with the first element being the frequency, the second the
+	 amplitude scaling and the third the phase offset in
+	 degrees */
+      int ifreq;
+      for (ifreq = 0; ifreq < domain->nfrequencies; ifreq++) {
+	oscillatorI += domain->frequencies[ifreq*3+1]
+	  *sin(2.0*M_PI*(domain->time*domain->frequencies[ifreq*3]
+			 +domain->frequencies[ifreq*3+2]));
+	oscillatorQ += domain->frequencies[ifreq*3+1]
+	  *cos(2.0*M_PI*(domain->time*domain->frequencies[ifreq*3]
+			 +domain->frequencies[ifreq*3+2]));
+      }
     }
-    MW_CHECK(mw_step(domain));
+    domain->forcing.Ex_I = domain->Ex_amplitude*oscillatorI;
+    domain->forcing.Ey_I = domain->Ey_amplitude*oscillatorI;
+    domain->forcing.Ez_I = domain->Ez_amplitude*oscillatorI;
+    domain->forcing.Ex_Q = domain->Ex_amplitude*oscillatorQ;
+    domain->forcing.Ey_Q = domain->Ey_amplitude*oscillatorQ;
+    domain->forcing.Ez_Q = domain->Ez_amplitude*oscillatorQ;
+  }
+  else {
+    domain->forcing.Ex_I = 0.0;
+    domain->forcing.Ey_I = 0.0;
+    domain->forcing.Ez_I = 0.0;
+    domain->forcing.Ex_Q = 0.0;
+    domain->forcing.Ey_Q = 0.0;
+    domain->forcing.Ez_Q = 0.0;
   }
+  return MW_SUCCESS;
+}
 
-  /* Calculate the Poynting vector */
-  if (domain->mode & MW_MODE_EZ) {
-    for (j = 1; j < domain->ny-1; j++) {
-      for (i = 1; i < domain->nx-1; i++) {
-	domain->Poynting_x[j][i] -= POYNTING_FACTOR*domain->Ez[j][i]
-	  *(domain->By[j-1][i-1]+domain->By[j-1][i]);
-	domain->Poynting_y[j][i] += POYNTING_FACTOR*domain->Ez[j][i]
-	  *(domain->Bx[j-1][i-1]+domain->Bx[j][i-1]);
-      }
+/* The Poynting vector calculation is multiplied by 0.5 because of
+   the need to use B-field values at two points on the grid, and is
+   divided by the magnetic constant to yield the correct units */
+static const real POYNTING_FACTOR = 0.5 / (4.0 * M_PI * 1.0e-7);
+
+/* Set i0 and i1-1 to the first and last columns of the Poynting
+   vector summation, "first" and nx-2 unless the left and right edges
+   are periodic, in which case every column is included */
+static
+void
+poynting_columns(mwDomain *domain, int first, int *i0, int *i1)
+{
+  if (domain->periodic & MW_PERIODIC_X) {
+    *i0 = 0;
+    *i1 = domain->nx;
+  }
+  else {
+    *i0 = first;
+    *i1 = domain->nx-1;
+  }
+}
+
+/* Add the contribution of the Ez, Bx and By components to row j of
+   the Poynting vector summation, skipping rows at the edge of the
+   domain and rows where the fields are still zero; in a band of a
+   larger domain (see mw_mpi.c) only the edges of the larger domain
+   are skipped */
+void
+mw_poynting_tm(mwDomain *domain, int j)
+{
+  int row = j + domain->row_offset;
+  int i, i0, i1;
+  if (row < 1 || row >= domain->ny_global-1
+      || j < domain->active_j0 || j-1 >= domain->active_j1) {
+    return;
+  }
+  poynting_columns(domain, 1, &i0, &i1);
+  for (i = i0; i < i1; i++) {
+    domain->Poynting_x[j][i] -= POYNTING_FACTOR*domain->Ez[j][i]
+      *(domain->By[j-1][i-1]+domain->By[j-1][i]);
+    domain->Poynting_y[j][i] += POYNTING_FACTOR*domain->Ez[j][i]
+      *(domain->Bx[j-1][i-1]+domain->Bx[j][i-1]);
+  }
+  if (domain->mode & MW_MODE_VACUUM) {
+    for (i = i0; i < i1; i++) {
+      domain->Poynting_x_scat[j][i] -= POYNTING_FACTOR
+	*(domain->Ez[j][i]-domain->Ez_vacuum[j][i])
+	*(domain->By[j-1][i-1]-domain->By_vacuum[j-1][i-1]
+	  +domain->By[j-1][i]-domain->By_vacuum[j-1][i]);
+      domain->Poynting_y_scat[j][i] += POYNTING_FACTOR
+	*(domain->Ez[j][i]-domain->Ez_vacuum[j][i])
+	*(domain->Bx[j-1][i-1]-domain->Bx_vacuum[j-1][i-1]
+	  +domain->Bx[j][i-1]-domain->Bx_vacuum[j][i-1]);
     }
-    if (domain->mode & MW_MODE_VACUUM) {
-      for (j = 1; j < domain->ny-1; j++) {
-	for (i = 1; i < domain->nx-1; i++) {
-	  domain->Poynting_x_scat[j][i] -= POYNTING_FACTOR
-	    *(domain->Ez[j][i]-domain->Ez_vacuum[j][i])
-	    *(domain->By[j-1][i-1]-domain->By_vacuum[j-1][i-1]
-	      +domain->By[j-1][i]-domain->By_vacuum[j-1][i]);
-	  domain->Poynting_y_scat[j][i] += POYNTING_FACTOR
-	    *(domain->Ez[j][i]-domain->Ez_vacuum[j][i])
-	    *(domain->Bx[j-1][i-1]-domain->Bx_vacuum[j-1][i-1]
-	      +domain->Bx[j][i-1]-domain->Bx_vacuum[j][i-1]);
-	}
-      }
+  }
+}
+
+/* Add the contribution of the Ex, Ey and Bz components to row j of
+   the Poynting vector summation, skipping rows at the edge of the
+   domain and rows where the fields are still zero */
+void
+mw_poynting_te(mwDomain *domain, int j)
+{
+  int row = j + domain->row_offset;
+  int i, i0, i1;
+  if (j < 0 || row >= domain->ny_global-1
+      || j+1 < domain->active_j0 || j >= domain->active_j1) {
+    return;
+  }
+  poynting_columns(domain, 0, &i0, &i1);
+  for (i = i0; i < i1; i++) {
+    domain->Poynting_x[j][i] += POYNTING_FACTOR*domain->Ey[j][i]
+      *(domain->Bz[j+1][i]+domain->Bz[j+1][i+1]);
+    domain->Poynting_y[j][i] -= POYNTING_FACTOR*domain->Ex[j][i]
+      *(domain->Bz[j][i+1]+domain->Bz[j+1][i+1]);
+  }
+  if (domain->mode & MW_MODE_VACUUM && row > 0) {
+    poynting_columns(domain, 1, &i0, &i1);
+    for (i = i0; i < i1; i++) {
+      domain->Poynting_x_scat[j][i] += POYNTING_FACTOR
+	*(domain->Ey[j][i]-domain->Ey_vacuum[j][i])
+	*(domain->Bz[j+1][i]-domain->Bz_vacuum[j+1][i]
+	  +domain->Bz[j+1][i+1]-domain->Bz_vacuum[j+1][i+1]);
+      domain->Poynting_y_scat[j][i] -= POYNTING_FACTOR
+	*(domain->Ex[j][i]-domain->Ex_vacuum[j][i])
+	*(domain->Bz[j][i+1]-domain->Bz_vacuum[j][i+1]
+	  +domain->Bz[j+1][i+1]-domain->Bz_vacuum[j+1][i+1]);
     }
   }
+}
 
-  if (domain->mode & MW_MODE_EXY) {
-    for (j = 0; j < domain->ny-1; j++) {
-      for (i = 0; i < domain->nx-1; i++) {
-	domain->Poynting_x[j][i] += POYNTING_FACTOR*domain->Ey[j][i]
-	  *(domain->Bz[j+1][i]+domain->By[j+1][i+1]);
-	domain->Poynting_y[j][i] -= POYNTING_FACTOR*domain->Ex[j][i]
-	  *(domain->Bz[j][i+1]+domain->Bz[j+1][i+1]);
-      }
+/* Run a "frame" (usually 7 timesteps) of each of the nmembers
+   simulations in "members" and calculate the Poynting vector
+   summation. If the edges are Bloch-periodic then the Bloch partners
+   of the members follow them in the array, and are run too. */
+int
+mw_frame_ensemble(mwDomain *members, int nmembers)
+{
+  int l, m;
+
+  MW_CHECK(mw_init_ensemble_coefficients(members, nmembers));
+  if (members->bloch) {
+    if (!members->bloch_partner) {
+      fprintf(stderr, "Bloch-periodic edges need the partners created by mw_new_ensemble\n");
+      return MW_FAILURE;
     }
-    if (domain->mode & MW_MODE_VACUUM) {
-      for (j = 1; j < domain->ny-1; j++) {
-	for (i = 1; i < domain->nx-1; i++) {
-	  domain->Poynting_x_scat[j][i] += POYNTING_FACTOR
-	    *(domain->Ey[j][i]-domain->Ey_vacuum[j][i])
-	    *(domain->Bz[j+1][i]-domain->Bz_vacuum[j+1][i]
-	      +domain->Bz[j+1][i+1]-domain->Bz_vacuum[j+1][i+1]);
-	  domain->Poynting_y_scat[j][i] -= POYNTING_FACTOR
-	    *(domain->Ex[j][i]-domain->Ex_vacuum[j][i])
-	    *(domain->Bz[j][i+1]-domain->Bz_vacuum[j][i+1]
-	      +domain->Bz[j+1][i+1]-domain->Bz_vacuum[j+1][i+1]);
+    nmembers *= 2;
+  }
+
+  if (members->integrator == MW_INTEGRATOR_LOD
+      || members->temporal_blocking || members->concurrent_streams
+      || members->storage == MW_STORAGE_BF16) {
+    /* Advance the domain through all the timesteps of the frame with
+       the implicit scheme, or each part of it while it is in cache,
+       or each of its streams on a separate group of threads, or in
+       bfloat16, then calculate the Poynting vector, each thread
+       working on its own band of rows */
+    for (m = 0; m < nmembers; m++) {
+      mwDomain *domain = members+m;
+      if (domain->integrator == MW_INTEGRATOR_LOD) {
+	MW_CHECK(mw_step_lod(domain, MW_MINOR_STEPS));
+      }
+      else if (domain->storage == MW_STORAGE_BF16) {
+	MW_CHECK(mw_step_bf16(domain, MW_MINOR_STEPS));
+      }
+      else if (domain->temporal_blocking) {
+	MW_CHECK(mw_step_blocked(domain, MW_MINOR_STEPS));
+      }
+      else {
+	MW_CHECK(mw_step_streams(domain, MW_MINOR_STEPS));
+      }
+#pragma omp parallel
+      {
+	int j, j0, j1;
+	mw_thread_rows(domain->ny, &j0, &j1);
+	for (j = j0; j < j1; j++) {
+	  if (domain->mode & MW_MODE_EZ) {
+	    mw_poynting_tm(domain, j);
+	  }
+	  if (domain->mode & MW_MODE_EXY) {
+	    mw_poynting_te(domain, j);
+	  }
 	}
       }
     }
   }
+  else {
+    /* Run simulation forward several timesteps, updating the
+       "forcing" each time. The Poynting vector is calculated in the
+       same pass through memory as the last timestep. */
+    for (l = 0; l < MW_MINOR_STEPS; l++) {
+      for (m = 0; m < nmembers; m++) {
+	mw_set_forcing(members+m);
+      }
+      MW_CHECK(mw_step_ensemble(members, nmembers, l == MW_MINOR_STEPS-1));
+    }
+  }
 
-  domain->iframe++;
+  for (m = 0; m < nmembers; m++) {
+    mwDomain *domain = members+m;
+    domain->iframe++;
+    if (domain->subnormal_interval > 0
+	&& domain->iframe % domain->subnormal_interval == 0) {
+      mw_report_subnormals(stderr, domain);
+    }
+  }
+
+  /* A moving window is only possible without an ensemble */
+  if (members->window_speed > 0.0) {
+    MW_CHECK(mw_move_window(members));
+  }
   return MW_SUCCESS;
 }
+
+/* Run a "frame" of the simulation (usually 7 timesteps) and calculate
+   the Poynting vector summation */
+int
+mw_frame(mwDomain *domain)
+{
+  return mw_frame_ensemble(domain, 1);
+}
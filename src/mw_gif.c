@@ -39,10 +39,16 @@
   AsmGifAnimDelay = 10,
   AsmGifAnimUserWait = FALSE;
 
-static GifFileType *gif_file; 
 static ColorMapObject *color_map;
-static GifByteType *gif_line = NULL;
-static int gif_mag = 1;
+
+/* The state of an animated gif file being written, stored in the
+   "output" member of the domain so that the members of an ensemble
+   can each write their own file */
+typedef struct {
+  GifFileType *gif_file;
+  GifByteType *gif_line;
+  int gif_mag;
+} gifFile;
 
 /* Initialize animated gif file of name "filename" */
 int
@@ -51,18 +57,28 @@ mw_gif_init(char *filename, mwDomain *domain)
   int gif_file_id;
   int width;
   int height;
+  int nx, ny;
   unsigned char ExtStr[3];
+  gifFile *gif = (gifFile*) calloc(1, sizeof(gifFile));
+  if (!gif) {
+    fprintf(stderr, "Error allocating the gif file state\n");
+    return MW_FAILURE;
+  }
+  domain->output = gif;
 
-  gif_mag = domain->mag;
-  if (gif_mag > MAX_MAG) {
-    gif_mag = MAX_MAG;
+  gif->gif_mag = domain->mag;
+  if (gif->gif_mag > MAX_MAG) {
+    gif->gif_mag = MAX_MAG;
   }
-  else if (gif_mag <= 0) {
-    gif_mag = 1;
+  else if (gif->gif_mag <= 0) {
+    gif->gif_mag = 1;
   }
 
-  width = gif_mag*(1 + (domain->mode & MW_MODE_VACUUM))*domain->nx;
-  height = gif_mag*domain->ny;
+  /* If the domain is half or a quarter of a symmetric scene then the
+     full scene is shown */
+  mw_full_size(domain, &nx, &ny);
+  width = gif->gif_mag*(1 + (domain->mode & MW_MODE_VACUUM))*nx;
+  height = gif->gif_mag*ny;
 
   /*
   ExtStr[0] = AsmGifAnimNumIters % 256;
@@ -88,25 +104,25 @@ mw_gif_init(char *filename, mwDomain *domain)
   }
 
   EGifSetGifVersion("89a");
-  if ((gif_file = EGifOpenFileHandle(gif_file_id)) == NULL) {
+  if ((gif->gif_file = EGifOpenFileHandle(gif_file_id)) == NULL) {
     return MW_FAILURE;
   }
 
-  if (EGifPutScreenDesc(gif_file, width, height,
+  if (EGifPutScreenDesc(gif->gif_file, width, height,
  			color_map->BitsPerPixel,
 			0, color_map) == GIF_ERROR) {
     return MW_FAILURE;
   }
 
-  if ((gif_line = malloc(width*sizeof(GifByteType))) == NULL) {
+  if ((gif->gif_line = malloc(width*sizeof(GifByteType))) == NULL) {
     return MW_FAILURE;
   }
 
-  EGifPutExtensionFirst(gif_file, APPLICATION_EXT_FUNC_CODE,
+  EGifPutExtensionFirst(gif->gif_file, APPLICATION_EXT_FUNC_CODE,
 			strlen(GIF_ASM_NAME), GIF_ASM_NAME);
-  EGifPutExtensionLast(gif_file, APPLICATION_EXT_FUNC_CODE,
+  EGifPutExtensionLast(gif->gif_file, APPLICATION_EXT_FUNC_CODE,
 		       3, ExtStr);
-  EGifPutExtension(gif_file, COMMENT_EXT_FUNC_CODE,
+  EGifPutExtension(gif->gif_file, COMMENT_EXT_FUNC_CODE,
 		   strlen(COMMENT_GIF_ASM), COMMENT_GIF_ASM);
 
   return MW_SUCCESS;
@@ -116,22 +132,35 @@ mw_gif_init(char *filename, mwDomain *domain)
 int
 mw_gif_write_frame(mwDomain *domain)
 {
+  gifFile *gif = (gifFile*) domain->output;
   real **field, **vac;
-  real plot_max, scat_max;
-  int width = gif_mag*(1 + (domain->mode & MW_MODE_VACUUM))*domain->nx;
-  int height = gif_mag*domain->ny;
-  int i, j, k;
+  real plot_max, scat_max, sign;
+  int nx, ny, width, height, parity;
+  int i, j, k, ir, jr, mirrored_x, mirrored_y;
   unsigned char ExtStr[4] = { 0x04, 0x00, 0x00, 0xff };
 
+  mw_full_size(domain, &nx, &ny);
+  width = gif->gif_mag*(1 + (domain->mode & MW_MODE_VACUUM))*nx;
+  height = gif->gif_mag*ny;
+
   ExtStr[0] = AsmGifAnimUserWait ? 0x06 : 0x04;
   ExtStr[1] = AsmGifAnimDelay % 256;
   ExtStr[2] = AsmGifAnimDelay / 256;
   ExtStr[3] = 0xff;
 
-  EGifPutExtension(gif_file, GRAPHICS_EXT_FUNC_CODE,
+  EGifPutExtension(gif->gif_file, GRAPHICS_EXT_FUNC_CODE,
 		   4, ExtStr);
 
-  if (EGifPutImageDesc(gif_file, 0, 0, width, height,
+  /* Record how far a moving window has moved in a comment */
+  if (domain->window_speed > 0.0) {
+    char comment[64];
+    snprintf(comment, sizeof(comment), "window_offset %g m",
+	     domain->window_offset*domain->dx);
+    EGifPutExtension(gif->gif_file, COMMENT_EXT_FUNC_CODE,
+		     strlen(comment), comment);
+  }
+
+  if (EGifPutImageDesc(gif->gif_file, 0, 0, width, height,
 		       FALSE, NULL) == GIF_ERROR) {
     return MW_FAILURE;
   }
@@ -141,18 +170,27 @@ mw_gif_write_frame(mwDomain *domain)
     plot_max = domain->plot_E_max;
     vac = domain->Ez_vacuum;
     scat_max = domain->plot_E_max*domain->plot_scat_ratio;
+    parity = mw_parity(domain, 2, 0);
   }
   else {
     field = domain->Bz;
     plot_max = domain->plot_B_max;
     vac = domain->Bz_vacuum;
     scat_max = domain->plot_B_max*domain->plot_scat_ratio;
+    parity = mw_parity(domain, 2, 1);
   }
 
-  for (j = domain->ny-1; j >= 0; j--) {
-    for (i = 0; i < domain->nx; i++) {
-      real value = HALF_JET_SIZE*(1.0+field[j][i]/plot_max);
-      if (domain->boundaries[j][i] > 0.0) {
+  /* Pixels beyond a plane of symmetry are the mirror images of those
+     inside (see mw_symmetry.c) */
+  for (j = ny-1; j >= 0; j--) {
+    jr = mw_unfold(domain, 1, j, &mirrored_y);
+    for (i = 0; i < nx; i++) {
+      real value;
+      ir = mw_unfold(domain, 0, i, &mirrored_x);
+      sign = ((mirrored_x && (parity & MW_ODD_X))
+	      ^ (mirrored_y && (parity & MW_ODD_Y))) ? -1.0 : 1.0;
+      value = HALF_JET_SIZE*(1.0+sign*field[jr][ir]/plot_max);
+      if (domain->boundaries[jr][ir] > 0.0) {
 	value = JET_SIZE-1;
       }
       else if (value < 0.0) {
@@ -161,24 +199,24 @@ mw_gif_write_frame(mwDomain *domain)
       else if (value >= JET_SIZE-1) {
 	value = JET_SIZE-2;
       }
-      for (k = 0; k < gif_mag; k++) {
-	gif_line[i*gif_mag + k] = (GifByteType) value;
+      for (k = 0; k < gif->gif_mag; k++) {
+	gif->gif_line[i*gif->gif_mag + k] = (GifByteType) value;
       }
       if (domain->mode & MW_MODE_VACUUM) {
-	value = HALF_JET_SIZE*(1.0+(field[j][i]-vac[j][i])/scat_max);
+	value = HALF_JET_SIZE*(1.0+sign*(field[jr][ir]-vac[jr][ir])/scat_max);
 	if (value < 0.0) {
 	  value = 0;
 	}
 	else if (value >= JET_SIZE-1) {
 	  value = JET_SIZE-2;
 	}
-	for (k = 0; k < gif_mag; k++) {
-	  gif_line[(i+domain->nx)*gif_mag+k] = (GifByteType) value;
+	for (k = 0; k < gif->gif_mag; k++) {
+	  gif->gif_line[(i+nx)*gif->gif_mag+k] = (GifByteType) value;
 	}
       }
     }
-    for (k = 0; k < gif_mag; k++) {
-      if (EGifPutLine(gif_file, gif_line, width) == GIF_ERROR) {
+    for (k = 0; k < gif->gif_mag; k++) {
+      if (EGifPutLine(gif->gif_file, gif->gif_line, width) == GIF_ERROR) {
 	return MW_FAILURE;
       }
     }  
@@ -188,12 +226,17 @@ mw_gif_write_frame(mwDomain *domain)
 
 /* Close the gif file */      
 int
-mw_gif_close()
+mw_gif_close(mwDomain *domain)
 {
-  if (EGifCloseFile(gif_file) == GIF_ERROR) {
-    return MW_FAILURE;
+  gifFile *gif = (gifFile*) domain->output;
+  int status = MW_SUCCESS;
+  if (EGifCloseFile(gif->gif_file) == GIF_ERROR) {
+    status = MW_FAILURE;
   }
-  return MW_SUCCESS;
+  free(gif->gif_line);
+  free(gif);
+  domain->output = NULL;
+  return status;
 }
 
 /* Write a gif file containing the dielectric constant field */
@@ -205,7 +248,7 @@ mw_gif_write_epsilon(char *filename, mwDomain *domain)
   int file_id;
   int width;
   int height;
-  int i, j, k;
+  int i, j, k, nx, ny, ir, jr, mirrored;
   int mag = domain->mag;
   if (mag > MAX_MAG) {
     mag = MAX_MAG;
@@ -214,8 +257,9 @@ mw_gif_write_epsilon(char *filename, mwDomain *domain)
     mag = 1;
   }
 
-  width = mag*domain->nx;
-  height = mag*domain->ny;
+  mw_full_size(domain, &nx, &ny);
+  width = mag*nx;
+  height = mag*ny;
  
   MW_CHECK(!(color_map = MakeMapObject(JET_SIZE, JetPalette)));
 
@@ -240,10 +284,17 @@ mw_gif_write_epsilon(char *filename, mwDomain *domain)
   MW_CHECK(EGifPutImageDesc(file, 0, 0, width, height,
 			    FALSE, NULL) == GIF_ERROR);
 
-  for (j = domain->ny-1; j >= 0; j--) {
-    for (i = 0; i < domain->nx; i++) {
-      real value = JET_SIZE*domain->epsilon[j][i]/4.0;
-      if (value < 0.0) {
+  for (j = ny-1; j >= 0; j--) {
+    jr = mw_unfold(domain, 1, j, &mirrored);
+    for (i = 0; i < nx; i++) {
+      real value;
+      ir = mw_unfold(domain, 0, i, &mirrored);
+      value = JET_SIZE*domain->epsilon[jr][ir]/4.0;
+      if (domain->conductor && domain->conductor[jr][ir]) {
+	/* Show perfect conductors in the top colour */
+	value = JET_SIZE-2;
+      }
+      else if (value < 0.0) {
 	value = 0;
       }
       else if (value >= JET_SIZE-1) {
@@ -0,0 +1,172 @@
+/* mw_kernel.c -- Scalar row kernels and selection of the kernels
+   appropriate for the instruction set of the processor
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk> 
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <strings.h>
+#include "maxwell.h"
+#include "mw_kernel.h"
+
+#define KERNEL(name) name
+
+/* Increment one row of Ez */
+MW_INLINE
+void
+tm_E(int i0, int i1, real *restrict Ez,
+     const real *restrict Bx, const real *restrict Bx_below,
+     const real *restrict By_below, const mwMaterial *restrict material,
+     const real *restrict Edamping, const real *restrict Eprefix,
+     real Eprefix_const, int coefficients, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping, prefix;
+    COEFFICIENTS(i, damping, prefix);
+    Ez[i] = damping*Ez[i] + prefix*(By_below[i] - By_below[i-1]
+				    - Bx[i-1] + Bx_below[i-1]);
+  }
+}
+
+/* Increment one row of Bx and By */
+MW_INLINE
+void
+tm_B(int i0, int i1, real *restrict Bx, real *restrict By,
+     const real *restrict Ez, const real *restrict Ez_above,
+     const real *restrict Bdamping, real dt_dx, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping = damped ? Bdamping[i] : 1.0;
+    Bx[i] = damping*Bx[i] - dt_dx*(Ez_above[i+1] - Ez[i+1]);
+    By[i] = damping*By[i] - dt_dx*(Ez_above[i] - Ez_above[i+1]);
+  }
+}
+
+/* Increment one row of Ex and Ey */
+MW_INLINE
+void
+te_E(int i0, int i1, real *restrict Ex, real *restrict Ey,
+     const real *restrict Bz, const real *restrict Bz_above,
+     const mwMaterial *restrict material,
+     const real *restrict Edamping, const real *restrict Eprefix,
+     real Eprefix_const, int coefficients, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping, prefix;
+    COEFFICIENTS(i, damping, prefix);
+    Ex[i] = damping*Ex[i] + prefix*(Bz_above[i+1] - Bz[i+1]);
+    Ey[i] = damping*Ey[i] + prefix*(Bz_above[i] - Bz_above[i+1]);
+  }
+}
+
+/* Increment one row of Bz */
+MW_INLINE
+void
+te_B(int i0, int i1, real *restrict Bz,
+     const real *restrict Ex, const real *restrict Ex_below,
+     const real *restrict Ey_below,
+     const real *restrict Bdamping, real dt_dx, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping = damped ? Bdamping[i] : 1.0;
+    Bz[i] = damping*Bz[i]
+      - dt_dx*(Ey_below[i] - Ey_below[i-1] - Ex[i-1] + Ex_below[i-1]);
+  }
+}
+
+MW_VARIANTS
+
+/* Return the portable kernels, which rely on the compiler to
+   vectorize them if it can */
+const mwKernels *
+mw_kernels_scalar()
+{
+  static const mwKernels kernels = MW_KERNELS("scalar");
+  return &kernels;
+}
+
+/* Return 1 if the processor (and operating system) supports the named
+   instruction set, 0 otherwise */
+static
+int
+cpu_supports(char *name)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if (strcasecmp(name, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  }
+  else if (strcasecmp(name, "avx512") == 0) {
+    return __builtin_cpu_supports("avx512f");
+  }
+#endif
+  return 0;
+}
+
+/* Choose the row kernels to use in mw_step. If name is NULL or
+   "auto" then the fastest kernels supported by both this build and
+   the processor are used; otherwise name may be "scalar", "avx2" or
+   "avx512" to force a particular choice, which is useful for
+   comparing them. */
+int
+mw_select_kernels(mwDomain *domain, char *name)
+{
+  const mwKernels *kernels = NULL;
+  if (!name || strcasecmp(name, "auto") == 0) {
+    if (cpu_supports("avx512")) {
+      kernels = mw_kernels_avx512();
+    }
+    if (!kernels && cpu_supports("avx2")) {
+      kernels = mw_kernels_avx2();
+    }
+    if (!kernels) {
+      kernels = mw_kernels_scalar();
+    }
+  }
+  else if (strcasecmp(name, "scalar") == 0) {
+    kernels = mw_kernels_scalar();
+  }
+  else if (strcasecmp(name, "avx2") == 0
+	   || strcasecmp(name, "avx512") == 0) {
+    if (!cpu_supports(name)) {
+      fprintf(stderr, "This processor does not support \"%s\" kernels\n",
+	      name);
+      return MW_FAILURE;
+    }
+    if (strcasecmp(name, "avx2") == 0) {
+      kernels = mw_kernels_avx2();
+    }
+    else {
+      kernels = mw_kernels_avx512();
+    }
+    if (!kernels) {
+      fprintf(stderr, "Support for \"%s\" kernels was not compiled in\n",
+	      name);
+      return MW_FAILURE;
+    }
+  }
+  else {
+    fprintf(stderr, "Config variable \"kernel\" must be \"auto\", \"scalar\", \"avx2\" or \"avx512\"\n");
+    return MW_FAILURE;
+  }
+  domain->kernels = kernels;
+  return MW_SUCCESS;
+}
@@ -0,0 +1,132 @@
+/* mw_kernel.h -- Macros to generate the variants of the row kernels
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk> 
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MW_KERNEL_H
+#define _MW_KERNEL_H 1
+
+/* Each instruction set defines KERNEL(name) to append its own suffix
+   to "name", and writes generic versions of the kernels, KERNEL(tm_E),
+   KERNEL(tm_B), KERNEL(te_E) and KERNEL(te_B), which take the extra
+   argument "damped" and, for the electric field, "coefficients".
+   These are always inlined into the variants generated below, in
+   which the extra arguments are constants, so the compiler removes
+   the unused terms. */
+
+#define MW_INLINE static inline __attribute__((always_inline))
+
+/* In the scalar kernels, set the damping factor and the prefix to
+   the curl of B for element i of the row, according to
+   "coefficients" (MW_COEFFICIENTS_*) and "damped" */
+#define COEFFICIENTS(i, damping, prefix)				\
+  if (coefficients == MW_COEFFICIENTS_INDEXED) {			\
+    damping = damped ? Edamping[material[i]] : 1.0;			\
+    prefix = Eprefix[material[i]];					\
+  }									\
+  else {								\
+    damping = damped ? Edamping[i] : 1.0;				\
+    if (coefficients == MW_COEFFICIENTS_UNIFORM) {			\
+      prefix = Eprefix_const;						\
+    }									\
+    else {								\
+      prefix = Eprefix[i];						\
+    }									\
+  }
+
+#define MW_TM_E_VARIANT(variant, coefficients, damped)			\
+  static void								\
+  KERNEL(variant)(int i0, int i1, real *Ez,				\
+		  const real *Bx, const real *Bx_below,			\
+		  const real *By_below, const mwMaterial *material,	\
+		  const real *Edamping, const real *Eprefix,		\
+		  real Eprefix_const)					\
+  {									\
+    KERNEL(tm_E)(i0, i1, Ez, Bx, Bx_below, By_below, material,		\
+		 Edamping, Eprefix, Eprefix_const, coefficients, damped); \
+  }
+
+#define MW_TE_E_VARIANT(variant, coefficients, damped)			\
+  static void								\
+  KERNEL(variant)(int i0, int i1, real *Ex, real *Ey,			\
+		  const real *Bz, const real *Bz_above,			\
+		  const mwMaterial *material,				\
+		  const real *Edamping, const real *Eprefix,		\
+		  real Eprefix_const)					\
+  {									\
+    KERNEL(te_E)(i0, i1, Ex, Ey, Bz, Bz_above, material, Edamping,	\
+		 Eprefix, Eprefix_const, coefficients, damped);		\
+  }
+
+#define MW_TM_B_VARIANT(variant, damped)				\
+  static void								\
+  KERNEL(variant)(int i0, int i1, real *Bx, real *By,			\
+		  const real *Ez, const real *Ez_above,			\
+		  const real *Bdamping, real dt_dx)			\
+  {									\
+    KERNEL(tm_B)(i0, i1, Bx, By, Ez, Ez_above, Bdamping, dt_dx,	\
+		 damped);						\
+  }
+
+#define MW_TE_B_VARIANT(variant, damped)				\
+  static void								\
+  KERNEL(variant)(int i0, int i1, real *Bz,				\
+		  const real *Ex, const real *Ex_below,			\
+		  const real *Ey_below,					\
+		  const real *Bdamping, real dt_dx)			\
+  {									\
+    KERNEL(te_B)(i0, i1, Bz, Ex, Ex_below, Ey_below, Bdamping, dt_dx,	\
+		 damped);						\
+  }
+
+/* Generate the variants of both electric-field kernels for one kind
+   of damping */
+#define MW_E_VARIANTS(suffix, damped)					\
+  MW_TM_E_VARIANT(tm_E_##suffix##_field, MW_COEFFICIENTS_FIELD, damped)	\
+  MW_TM_E_VARIANT(tm_E_##suffix##_uniform, MW_COEFFICIENTS_UNIFORM,	\
+		  damped)						\
+  MW_TM_E_VARIANT(tm_E_##suffix##_indexed, MW_COEFFICIENTS_INDEXED,	\
+		  damped)						\
+  MW_TE_E_VARIANT(te_E_##suffix##_field, MW_COEFFICIENTS_FIELD, damped)	\
+  MW_TE_E_VARIANT(te_E_##suffix##_uniform, MW_COEFFICIENTS_UNIFORM,	\
+		  damped)						\
+  MW_TE_E_VARIANT(te_E_##suffix##_indexed, MW_COEFFICIENTS_INDEXED,	\
+		  damped)
+
+/* Generate all the variants of the kernels */
+#define MW_VARIANTS							\
+  MW_E_VARIANTS(undamped, 0)						\
+  MW_E_VARIANTS(damped, 1)						\
+  MW_TM_B_VARIANT(tm_B_undamped, 0)					\
+  MW_TM_B_VARIANT(tm_B_damped, 1)					\
+  MW_TE_B_VARIANT(te_B_undamped, 0)					\
+  MW_TE_B_VARIANT(te_B_damped, 1)
+
+#define MW_E_TABLE(pol, damping)					\
+  { KERNEL(pol##_E_##damping##_field),					\
+    KERNEL(pol##_E_##damping##_uniform),				\
+    KERNEL(pol##_E_##damping##_indexed) }
+
+/* Initializer for an mwKernels structure named "name" */
+#define MW_KERNELS(name)						\
+  { name,								\
+    { MW_E_TABLE(tm, undamped), MW_E_TABLE(tm, damped) },		\
+    { KERNEL(tm_B_undamped), KERNEL(tm_B_damped) },			\
+    { MW_E_TABLE(te, undamped), MW_E_TABLE(te, damped) },		\
+    { KERNEL(te_B_undamped), KERNEL(te_B_damped) } }
+
+#endif
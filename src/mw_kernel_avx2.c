@@ -0,0 +1,90 @@
+/* mw_kernel_avx2.c -- Row kernels using AVX2 and FMA instructions
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk> 
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stddef.h>
+#include "maxwell.h"
+#include "mw_kernel.h"
+
+/* This file must be compiled with -mavx2 -mfma; otherwise it provides
+   no kernels and mw_select_kernels will not choose it */
+#if defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+#ifdef MW_DOUBLE
+#define VEC __m256d
+#define VLEN 4
+#define VLOAD(p) _mm256_loadu_pd(p)
+#define VLOADA(p) _mm256_load_pd(p)
+#define VSTOREA(p,v) _mm256_store_pd(p,v)
+#define VSTOREM(p,m,v) _mm256_maskstore_pd(p,m,v)
+#define VMASK(l0,l1)							\
+  _mm256_and_si256(_mm256_cmpgt_epi64(_mm256_setr_epi64x(0, 1, 2, 3),	\
+				      _mm256_set1_epi64x((l0)-1)),	\
+		   _mm256_cmpgt_epi64(_mm256_set1_epi64x(l1),		\
+				      _mm256_setr_epi64x(0, 1, 2, 3)))
+#define VSET1(x) _mm256_set1_pd(x)
+#define VADD(a,b) _mm256_add_pd(a,b)
+#define VSUB(a,b) _mm256_sub_pd(a,b)
+#define VMUL(a,b) _mm256_mul_pd(a,b)
+#define VFMADD(a,b,c) _mm256_fmadd_pd(a,b,c)
+#define VFNMADD(a,b,c) _mm256_fnmadd_pd(a,b,c)
+#define VGATHER(t,m) \
+  _mm256_i32gather_pd(t, _mm_cvtepu8_epi32(_mm_loadu_si32(m)), 8)
+#else
+#define VEC __m256
+#define VLEN 8
+#define VLOAD(p) _mm256_loadu_ps(p)
+#define VLOADA(p) _mm256_load_ps(p)
+#define VSTOREA(p,v) _mm256_store_ps(p,v)
+#define VSTOREM(p,m,v) _mm256_maskstore_ps(p,m,v)
+#define LANES _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+#define VMASK(l0,l1)							\
+  _mm256_and_si256(_mm256_cmpgt_epi32(LANES, _mm256_set1_epi32((l0)-1)), \
+		   _mm256_cmpgt_epi32(_mm256_set1_epi32(l1), LANES))
+#define VSET1(x) _mm256_set1_ps(x)
+#define VADD(a,b) _mm256_add_ps(a,b)
+#define VSUB(a,b) _mm256_sub_ps(a,b)
+#define VMUL(a,b) _mm256_mul_ps(a,b)
+#define VFMADD(a,b,c) _mm256_fmadd_ps(a,b,c)
+#define VFNMADD(a,b,c) _mm256_fnmadd_ps(a,b,c)
+#define VGATHER(t,m) \
+  _mm256_i32gather_ps(t, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (m))),\
+		      4)
+#endif
+#define KERNEL(name) name##_avx2
+
+#include "mw_kernel_simd.h"
+
+const mwKernels *
+mw_kernels_avx2()
+{
+  static const mwKernels kernels = MW_KERNELS("avx2");
+  return &kernels;
+}
+
+#else
+
+const mwKernels *
+mw_kernels_avx2()
+{
+  return NULL;
+}
+
+#endif
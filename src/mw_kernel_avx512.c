@@ -0,0 +1,84 @@
+/* mw_kernel_avx512.c -- Row kernels using AVX-512 instructions
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk> 
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stddef.h>
+#include "maxwell.h"
+#include "mw_kernel.h"
+
+/* This file must be compiled with -mavx512f; otherwise it provides
+   no kernels and mw_select_kernels will not choose it */
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+#ifdef MW_DOUBLE
+#define VEC __m512d
+#define VLEN 8
+#define VLOAD(p) _mm512_loadu_pd(p)
+#define VLOADA(p) _mm512_load_pd(p)
+#define VSTOREA(p,v) _mm512_store_pd(p,v)
+#define VSTOREM(p,m,v) _mm512_mask_store_pd(p,m,v)
+#define VMASK(l0,l1) ((__mmask8) (((1u << (l1)) - 1) & ~((1u << (l0)) - 1)))
+#define VSET1(x) _mm512_set1_pd(x)
+#define VADD(a,b) _mm512_add_pd(a,b)
+#define VSUB(a,b) _mm512_sub_pd(a,b)
+#define VMUL(a,b) _mm512_mul_pd(a,b)
+#define VFMADD(a,b,c) _mm512_fmadd_pd(a,b,c)
+#define VFNMADD(a,b,c) _mm512_fnmadd_pd(a,b,c)
+#define VGATHER(t,m) \
+  _mm512_i32gather_pd(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (m))), \
+		      t, 8)
+#else
+#define VEC __m512
+#define VLEN 16
+#define VLOAD(p) _mm512_loadu_ps(p)
+#define VLOADA(p) _mm512_load_ps(p)
+#define VSTOREA(p,v) _mm512_store_ps(p,v)
+#define VSTOREM(p,m,v) _mm512_mask_store_ps(p,m,v)
+#define VMASK(l0,l1) ((__mmask16) (((1u << (l1)) - 1) & ~((1u << (l0)) - 1)))
+#define VSET1(x) _mm512_set1_ps(x)
+#define VADD(a,b) _mm512_add_ps(a,b)
+#define VSUB(a,b) _mm512_sub_ps(a,b)
+#define VMUL(a,b) _mm512_mul_ps(a,b)
+#define VFMADD(a,b,c) _mm512_fmadd_ps(a,b,c)
+#define VFNMADD(a,b,c) _mm512_fnmadd_ps(a,b,c)
+#define VGATHER(t,m) \
+  _mm512_i32gather_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (m))), \
+		      t, 4)
+#endif
+#define KERNEL(name) name##_avx512
+
+#include "mw_kernel_simd.h"
+
+const mwKernels *
+mw_kernels_avx512()
+{
+  static const mwKernels kernels = MW_KERNELS("avx512");
+  return &kernels;
+}
+
+#else
+
+const mwKernels *
+mw_kernels_avx512()
+{
+  return NULL;
+}
+
+#endif
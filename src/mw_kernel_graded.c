@@ -0,0 +1,200 @@
+/* mw_kernel_graded.c -- Row kernels for a graded mesh
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* On a graded mesh (see mw_mesh.c) the columns and rows are not
+   evenly spaced, so each difference of the standard kernels is
+   multiplied by the base pixel spacing dx divided by the distance
+   across which it is taken. The prefixes Eprefix and dt_dx are those
+   of the base spacing, so on a uniform mesh these kernels give the
+   same result as the standard ones. A difference across a column is
+   taken between the neighbouring components at the midpoints either
+   side of it, and is multiplied by dual_x[i] for column i; one
+   between two columns, centred half way along the side of a pixel,
+   is multiplied by ratio_x[i] for the side from column i to i+1. The
+   same is true of the rows, for which the factor is a scalar. There
+   is only a portable version, which the compiler may vectorize. */
+
+#include "maxwell.h"
+#include "mw_kernel.h"
+
+#define KERNEL(name) name##_graded
+
+/* Increment one row of Ez */
+MW_INLINE
+void
+tm_E_graded(int i0, int i1, real *restrict Ez,
+	    const real *restrict Bx, const real *restrict Bx_below,
+	    const real *restrict By_below, const mwMaterial *restrict material,
+	    const real *restrict Edamping, const real *restrict Eprefix,
+	    real Eprefix_const, const real *restrict dual_x, real dual_y,
+	    int coefficients, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping, prefix;
+    COEFFICIENTS(i, damping, prefix);
+    Ez[i] = damping*Ez[i]
+      + prefix*(dual_x[i]*(By_below[i] - By_below[i-1])
+		- dual_y*(Bx[i-1] - Bx_below[i-1]));
+  }
+}
+
+/* Increment one row of Bx and By */
+MW_INLINE
+void
+tm_B_graded(int i0, int i1, real *restrict Bx, real *restrict By,
+	    const real *restrict Ez, const real *restrict Ez_above,
+	    const real *restrict Bdamping, real dt_dx,
+	    const real *restrict ratio_x, real ratio_y, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping = damped ? Bdamping[i] : 1.0;
+    Bx[i] = damping*Bx[i] - dt_dx*ratio_y*(Ez_above[i+1] - Ez[i+1]);
+    By[i] = damping*By[i] - dt_dx*ratio_x[i]*(Ez_above[i] - Ez_above[i+1]);
+  }
+}
+
+/* Increment one row of Ex and Ey */
+MW_INLINE
+void
+te_E_graded(int i0, int i1, real *restrict Ex, real *restrict Ey,
+	    const real *restrict Bz, const real *restrict Bz_above,
+	    const mwMaterial *restrict material,
+	    const real *restrict Edamping, const real *restrict Eprefix,
+	    real Eprefix_const, const real *restrict ratio_x, real ratio_y,
+	    int coefficients, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping, prefix;
+    COEFFICIENTS(i, damping, prefix);
+    Ex[i] = damping*Ex[i] + prefix*ratio_y*(Bz_above[i+1] - Bz[i+1]);
+    Ey[i] = damping*Ey[i] + prefix*ratio_x[i]*(Bz_above[i] - Bz_above[i+1]);
+  }
+}
+
+/* Increment one row of Bz */
+MW_INLINE
+void
+te_B_graded(int i0, int i1, real *restrict Bz,
+	    const real *restrict Ex, const real *restrict Ex_below,
+	    const real *restrict Ey_below,
+	    const real *restrict Bdamping, real dt_dx,
+	    const real *restrict dual_x, real dual_y, int damped)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    real damping = damped ? Bdamping[i] : 1.0;
+    Bz[i] = damping*Bz[i]
+      - dt_dx*(dual_x[i]*(Ey_below[i] - Ey_below[i-1])
+	       - dual_y*(Ex[i-1] - Ex_below[i-1]));
+  }
+}
+
+/* The variants, as generated by MW_VARIANTS for the standard
+   kernels */
+#define TM_E_GRADED_VARIANT(variant, coefficients, damped)		\
+  static void								\
+  KERNEL(variant)(int i0, int i1, real *Ez,				\
+		  const real *Bx, const real *Bx_below,			\
+		  const real *By_below, const mwMaterial *material,	\
+		  const real *Edamping, const real *Eprefix,		\
+		  real Eprefix_const, const real *dual_x, real dual_y)	\
+  {									\
+    tm_E_graded(i0, i1, Ez, Bx, Bx_below, By_below, material,		\
+		Edamping, Eprefix, Eprefix_const, dual_x, dual_y,	\
+		coefficients, damped);					\
+  }
+
+#define TE_E_GRADED_VARIANT(variant, coefficients, damped)		\
+  static void								\
+  KERNEL(variant)(int i0, int i1, real *Ex, real *Ey,			\
+		  const real *Bz, const real *Bz_above,			\
+		  const mwMaterial *material,				\
+		  const real *Edamping, const real *Eprefix,		\
+		  real Eprefix_const, const real *ratio_x, real ratio_y) \
+  {									\
+    te_E_graded(i0, i1, Ex, Ey, Bz, Bz_above, material, Edamping,	\
+		Eprefix, Eprefix_const, ratio_x, ratio_y,		\
+		coefficients, damped);					\
+  }
+
+#define E_GRADED_VARIANTS(suffix, damped)				\
+  TM_E_GRADED_VARIANT(tm_E_##suffix##_field, MW_COEFFICIENTS_FIELD, damped) \
+  TM_E_GRADED_VARIANT(tm_E_##suffix##_uniform, MW_COEFFICIENTS_UNIFORM, \
+		      damped)						\
+  TM_E_GRADED_VARIANT(tm_E_##suffix##_indexed, MW_COEFFICIENTS_INDEXED, \
+		      damped)						\
+  TE_E_GRADED_VARIANT(te_E_##suffix##_field, MW_COEFFICIENTS_FIELD, damped) \
+  TE_E_GRADED_VARIANT(te_E_##suffix##_uniform, MW_COEFFICIENTS_UNIFORM, \
+		      damped)						\
+  TE_E_GRADED_VARIANT(te_E_##suffix##_indexed, MW_COEFFICIENTS_INDEXED, \
+		      damped)
+
+E_GRADED_VARIANTS(undamped, 0)
+E_GRADED_VARIANTS(damped, 1)
+
+static void
+KERNEL(tm_B_undamped)(int i0, int i1, real *Bx, real *By,
+		      const real *Ez, const real *Ez_above,
+		      const real *Bdamping, real dt_dx,
+		      const real *ratio_x, real ratio_y)
+{
+  tm_B_graded(i0, i1, Bx, By, Ez, Ez_above, Bdamping, dt_dx,
+	      ratio_x, ratio_y, 0);
+}
+
+static void
+KERNEL(tm_B_damped)(int i0, int i1, real *Bx, real *By,
+		    const real *Ez, const real *Ez_above,
+		    const real *Bdamping, real dt_dx,
+		    const real *ratio_x, real ratio_y)
+{
+  tm_B_graded(i0, i1, Bx, By, Ez, Ez_above, Bdamping, dt_dx,
+	      ratio_x, ratio_y, 1);
+}
+
+static void
+KERNEL(te_B_undamped)(int i0, int i1, real *Bz,
+		      const real *Ex, const real *Ex_below,
+		      const real *Ey_below, const real *Bdamping, real dt_dx,
+		      const real *dual_x, real dual_y)
+{
+  te_B_graded(i0, i1, Bz, Ex, Ex_below, Ey_below, Bdamping, dt_dx,
+	      dual_x, dual_y, 0);
+}
+
+static void
+KERNEL(te_B_damped)(int i0, int i1, real *Bz,
+		    const real *Ex, const real *Ex_below,
+		    const real *Ey_below, const real *Bdamping, real dt_dx,
+		    const real *dual_x, real dual_y)
+{
+  te_B_graded(i0, i1, Bz, Ex, Ex_below, Ey_below, Bdamping, dt_dx,
+	      dual_x, dual_y, 1);
+}
+
+/* Return the kernels for a graded mesh */
+const mwKernelsGraded *
+mw_kernels_graded()
+{
+  static const mwKernelsGraded kernels = MW_KERNELS("graded");
+  return &kernels;
+}
@@ -0,0 +1,180 @@
+/* mw_kernel_simd.h -- Row kernels written with SIMD intrinsics
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk> 
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* This file is included by mw_kernel_avx2.c and mw_kernel_avx512.c
+   after they have defined the following macros for their instruction
+   set and for the type "real":
+
+     VEC            the vector type
+     VLEN           the number of reals in VEC
+     VLOAD(p)       unaligned load from p
+     VLOADA(p)      aligned load from p
+     VSTOREA(p,v)   aligned store of v to p
+     VSTOREM(p,m,v) aligned store of the lanes of v selected by the
+                    mask m to p
+     VMASK(l0,l1)   the mask selecting lanes l0 to l1-1
+     VSET1(x)       broadcast the scalar x
+     VADD(a,b)      a+b
+     VSUB(a,b)      a-b
+     VMUL(a,b)      a*b
+     VFMADD(a,b,c)  a*b+c
+     VFNMADD(a,b,c) c-a*b
+     VGATHER(t,m)   load t[m[0]], t[m[1]]... where m points to VLEN
+                    mwMaterial indices
+     KERNEL(name)   the name of a kernel with the instruction set
+                    appended
+
+   Each row starts on an MW_ALIGN-byte boundary, so the kernels work
+   in vectors of VLEN columns starting at multiples of VLEN, loading
+   and storing the element being updated with aligned instructions.
+   The vectors at either end of the range of columns may straddle it;
+   they are computed in full, which is safe since the reads stay
+   within the padding and ghost cells of the row, but only the lanes
+   in the range are stored. Every column is then computed by the same
+   instructions however the row is divided into segments, so the
+   results do not depend on the active region, the blocking or the
+   number of threads. The generic kernels are expanded into their
+   variants by the macros in mw_kernel.h. */
+
+/* The first column of the vector containing column i0 */
+#define VFIRST(i0) ((i0) - (i0)%VLEN)
+
+/* Store v to the vector at p holding columns i to i+VLEN-1, or only
+   to those of its lanes in columns i0 to i1-1 if it straddles either
+   end of the range */
+#define VSTORE_RANGE(p, v)						\
+  if (i >= i0 && i+VLEN <= i1) {					\
+    VSTOREA(p, v);							\
+  }									\
+  else {								\
+    VSTOREM(p, VMASK(i0 > i ? i0-i : 0, i1-i < VLEN ? i1-i : VLEN), v);	\
+  }
+
+/* Load the damping factors and the prefixes to the curl of B for
+   elements i to i+VLEN-1 of the row, according to "coefficients"
+   (MW_COEFFICIENTS_*); for MW_COEFFICIENTS_UNIFORM the prefix is left
+   as the constant, and if not "damped" the damping is not loaded */
+#define VCOEFFICIENTS(i, damping, prefix)				\
+  if (coefficients == MW_COEFFICIENTS_INDEXED) {			\
+    if (damped) {							\
+      damping = VGATHER(Edamping, material+(i));			\
+    }									\
+    prefix = VGATHER(Eprefix, material+(i));				\
+  }									\
+  else {								\
+    if (damped) {							\
+      damping = VLOADA(Edamping+(i));					\
+    }									\
+    if (coefficients == MW_COEFFICIENTS_FIELD) {			\
+      prefix = VLOADA(Eprefix+(i));					\
+    }									\
+  }
+
+/* damping*x, or x if not "damped" */
+#define VDAMP(damping, x) (damped ? VMUL(damping, x) : (x))
+
+/* Increment one row of Ez */
+MW_INLINE
+void
+KERNEL(tm_E)(int i0, int i1, real *restrict Ez,
+	     const real *restrict Bx, const real *restrict Bx_below,
+	     const real *restrict By_below,
+	     const mwMaterial *restrict material,
+	     const real *restrict Edamping, const real *restrict Eprefix,
+	     real Eprefix_const, int coefficients, int damped)
+{
+  VEC vprefix = VSET1(Eprefix_const);
+  int i;
+  for (i = VFIRST(i0); i < i1; i += VLEN) {
+    VEC curl = VSUB(VADD(VSUB(VLOADA(By_below+i), VLOAD(By_below+i-1)),
+			 VLOAD(Bx_below+i-1)), VLOAD(Bx+i-1));
+    VEC damping = VSET1(1.0);
+    VCOEFFICIENTS(i, damping, vprefix);
+    VSTORE_RANGE(Ez+i, VFMADD(vprefix, curl, VDAMP(damping, VLOADA(Ez+i))));
+  }
+}
+
+/* Increment one row of Bx and By */
+MW_INLINE
+void
+KERNEL(tm_B)(int i0, int i1, real *restrict Bx, real *restrict By,
+	     const real *restrict Ez, const real *restrict Ez_above,
+	     const real *restrict Bdamping, real dt_dx, int damped)
+{
+  VEC vdt_dx = VSET1(dt_dx);
+  int i;
+  for (i = VFIRST(i0); i < i1; i += VLEN) {
+    VEC damping = VSET1(1.0);
+    VEC Ez_above_right = VLOAD(Ez_above+i+1);
+    if (damped) {
+      damping = VLOADA(Bdamping+i);
+    }
+    VSTORE_RANGE(Bx+i, VFNMADD(vdt_dx, VSUB(Ez_above_right, VLOAD(Ez+i+1)),
+			       VDAMP(damping, VLOADA(Bx+i))));
+    VSTORE_RANGE(By+i, VFNMADD(vdt_dx, VSUB(VLOADA(Ez_above+i),
+					    Ez_above_right),
+			       VDAMP(damping, VLOADA(By+i))));
+  }
+}
+
+/* Increment one row of Ex and Ey */
+MW_INLINE
+void
+KERNEL(te_E)(int i0, int i1, real *restrict Ex, real *restrict Ey,
+	     const real *restrict Bz, const real *restrict Bz_above,
+	     const mwMaterial *restrict material,
+	     const real *restrict Edamping, const real *restrict Eprefix,
+	     real Eprefix_const, int coefficients, int damped)
+{
+  VEC vprefix = VSET1(Eprefix_const);
+  int i;
+  for (i = VFIRST(i0); i < i1; i += VLEN) {
+    VEC Bz_above_right = VLOAD(Bz_above+i+1);
+    VEC damping = VSET1(1.0);
+    VCOEFFICIENTS(i, damping, vprefix);
+    VSTORE_RANGE(Ex+i, VFMADD(vprefix, VSUB(Bz_above_right, VLOAD(Bz+i+1)),
+			      VDAMP(damping, VLOADA(Ex+i))));
+    VSTORE_RANGE(Ey+i, VFMADD(vprefix, VSUB(VLOADA(Bz_above+i),
+					    Bz_above_right),
+			      VDAMP(damping, VLOADA(Ey+i))));
+  }
+}
+
+/* Increment one row of Bz */
+MW_INLINE
+void
+KERNEL(te_B)(int i0, int i1, real *restrict Bz,
+	     const real *restrict Ex, const real *restrict Ex_below,
+	     const real *restrict Ey_below,
+	     const real *restrict Bdamping, real dt_dx, int damped)
+{
+  VEC vdt_dx = VSET1(dt_dx);
+  int i;
+  for (i = VFIRST(i0); i < i1; i += VLEN) {
+    VEC curl = VSUB(VADD(VSUB(VLOADA(Ey_below+i), VLOAD(Ey_below+i-1)),
+			 VLOAD(Ex_below+i-1)), VLOAD(Ex+i-1));
+    VEC damping = VSET1(1.0);
+    if (damped) {
+      damping = VLOADA(Bdamping+i);
+    }
+    VSTORE_RANGE(Bz+i, VFNMADD(vdt_dx, curl, VDAMP(damping, VLOADA(Bz+i))));
+  }
+}
+
+MW_VARIANTS
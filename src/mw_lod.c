@@ -0,0 +1,489 @@
+/* mw_lod.c -- Advance the fields with the unconditionally stable
+   locally one-dimensional (LOD) implicit scheme
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* The explicit scheme of mw_step is only stable if a wave crosses
+   less than about a pixel per timestep, so a scene with a few very
+   fine features needs a tiny timestep everywhere. The LOD scheme
+   splits each timestep into two stages: in the first, only the
+   derivatives along x are kept and the fields are advanced with the
+   Crank-Nicolson (trapezoidal) rule, and in the second the same is
+   done along y. In each stage the field "u" (Ez for TM, Bz for TE)
+   and the component "v" coupled to it along that direction obey
+
+     u' - u = (s*alpha/2) D-(v' + v)
+     v' - v = (s*beta/2) D+(u' + u)
+
+   along every row (or column), where D- and D+ are the differences
+   with the neighbour behind and in front, alpha and beta are the
+   coefficients of the explicit updates (the prefix to the curl of B
+   for an electric field, dt/(2*dx) for a magnetic one) and s is the
+   sign of the curl. Eliminating v' leaves a tridiagonal system for u'
+   along each line, after which v' follows directly. Each stage
+   conserves energy whatever the timestep, so the scheme is stable for
+   any "timestep_factor"; but it is only first-order accurate in time
+   and the phase error grows with the timestep, so it suits scenes in
+   which the fine features rather than the wavelength set the pixel
+   size.
+
+   The lines are solved in batches of BATCH, copied into work arrays
+   laid out with the batch index varying fastest, so that the Thomas
+   algorithm proceeds along all the lines of a batch at once and the
+   compiler can vectorize it; the batches are shared among the
+   threads. The fields at the edges of the domain are held at zero, as
+   in the explicit scheme, and so are the electric fields inside
+   perfect conductors and the magnetic fields that the masks freeze. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "maxwell.h"
+
+/* The number of lines solved together */
+#define BATCH 16
+
+/* The masks expanded into one flag per pixel, 1 where the field is
+   updated; NULL if there are no conductors */
+#define FLAGS_E 0
+#define FLAGS_TM_B 1
+#define FLAGS_TE_B 2
+typedef struct {
+  unsigned char **updated[3];
+} lodState;
+
+/* One of the systems advanced by the LOD scheme: "u" is solved for
+   implicitly and v_x or v_y, the component coupled to it along x or
+   y, is updated from it. The coefficients are taken from the alpha
+   and beta fields, or if these are NULL are alpha_const and
+   beta_const; they are located at u and v respectively. The sign of
+   the curl is "sign" along x and the opposite along y. */
+typedef struct {
+  real **u;
+  real **v_x;
+  real **v_y;
+  real **alpha;
+  real **beta;
+  real alpha_const;
+  real beta_const;
+  unsigned char **u_updated;
+  unsigned char **v_updated;
+  real sign;
+} lodSystem;
+
+/* Expand "mask" into a field of flags */
+static
+int
+expand_mask(const mwMask *mask, int nx, int ny, unsigned char ***flags)
+{
+  int j, k, i;
+  *flags = NULL;
+  if (!mask->start) {
+    return MW_SUCCESS;
+  }
+  *flags = (unsigned char**) malloc(sizeof(unsigned char*)*ny);
+  if (!*flags || !(**flags = (unsigned char*) calloc(nx*ny, 1))) {
+    fprintf(stderr, "Error allocating the flags of the implicit scheme\n");
+    return MW_FAILURE;
+  }
+  for (j = 0; j < ny; j++) {
+    (*flags)[j] = (*flags)[0] + j*nx;
+    for (k = mask->start[j]; k < mask->start[j+1]; k++) {
+      for (i = mask->runs[k].i0; i < mask->runs[k].i1; i++) {
+	(*flags)[j][i] = 1;
+      }
+    }
+  }
+  return MW_SUCCESS;
+}
+
+/* Allocate the state of the scheme, if this has not already been
+   done */
+static
+int
+init_lod(mwDomain *domain)
+{
+  lodState *state;
+  if (domain->lod) {
+    return MW_SUCCESS;
+  }
+  state = (lodState*) calloc(1, sizeof(lodState));
+  if (!state) {
+    fprintf(stderr, "Error allocating the state of the implicit scheme\n");
+    return MW_FAILURE;
+  }
+  domain->lod = state;
+  MW_CHECK(expand_mask(&domain->E_mask, domain->nx, domain->ny,
+		       state->updated + FLAGS_E));
+  MW_CHECK(expand_mask(&domain->tm_B_mask, domain->nx, domain->ny,
+		       state->updated + FLAGS_TM_B));
+  MW_CHECK(expand_mask(&domain->te_B_mask, domain->nx, domain->ny,
+		       state->updated + FLAGS_TE_B));
+  return MW_SUCCESS;
+}
+
+/* Free the state of the scheme */
+void
+mw_free_lod(mwDomain *domain)
+{
+  lodState *state = (lodState*) domain->lod;
+  int k;
+  if (!state) {
+    return;
+  }
+  for (k = 0; k < 3; k++) {
+    if (state->updated[k]) {
+      free(*state->updated[k]);
+      free(state->updated[k]);
+    }
+  }
+  free(state);
+  domain->lod = NULL;
+}
+
+/* Copy element k of lines l0 to l1-1 of "field" into dest[k*BATCH+w]
+   for the w'th line, where a line is a row (along_x) or a column, and
+   "offset" is added to the index of the line. If "field" is NULL then
+   "value" is copied instead. If "flags" is not NULL, elements whose
+   flag is zero are set to zero, and so are the unused lanes of the
+   batch. */
+static
+void
+gather(real **field, real value, unsigned char **flags, int along_x,
+       int l0, int l1, int offset, int n, real *dest)
+{
+  int k, w;
+  for (w = l1-l0; w < BATCH; w++) {
+    for (k = 0; k < n; k++) {
+      dest[k*BATCH+w] = 0.0;
+    }
+  }
+  if (along_x) {
+    for (w = 0; w < l1-l0; w++) {
+      int j = l0+w+offset;
+      for (k = 0; k < n; k++) {
+	real x = field ? field[j][k] : value;
+	dest[k*BATCH+w] = (flags && !flags[j][k]) ? 0.0 : x;
+      }
+    }
+  }
+  else {
+    for (k = 0; k < n; k++) {
+      for (w = 0; w < l1-l0; w++) {
+	int i = l0+w+offset;
+	real x = field ? field[k][i] : value;
+	dest[k*BATCH+w] = (flags && !flags[k][i]) ? 0.0 : x;
+      }
+    }
+  }
+}
+
+/* Copy elements k0 to k1-1 of the lines in "src" back into "field",
+   the reverse of gather() */
+static
+void
+scatter(real **field, int along_x, int l0, int l1, int offset,
+	int k0, int k1, const real *src)
+{
+  int k, w;
+  if (along_x) {
+    for (w = 0; w < l1-l0; w++) {
+      int j = l0+w+offset;
+      for (k = k0; k < k1; k++) {
+	field[j][k] = src[k*BATCH+w];
+      }
+    }
+  }
+  else {
+    for (k = k0; k < k1; k++) {
+      for (w = 0; w < l1-l0; w++) {
+	field[k][l0+w+offset] = src[k*BATCH+w];
+      }
+    }
+  }
+}
+
+/* Advance lines l0 to l1-1 (at most BATCH of them) of "system" through
+   one stage, where each line is n pixels long; "work" must have room
+   for 6*n*BATCH reals */
+static
+void
+advance_lines(const lodSystem *system, int along_x, int l0, int l1,
+	      int n, real *work)
+{
+  real *u = work, *v = u + n*BATCH;
+  real *alpha = v + n*BATCH, *beta = alpha + n*BATCH;
+  real *d = beta + n*BATCH, *c = d + n*BATCH;
+  real **v_field = along_x ? system->v_x : system->v_y;
+  real sign = along_x ? system->sign : -system->sign;
+  int k, w;
+
+  /* The masked pixels get zero coefficients, so that u stays at its
+     current value (zero) and v does not change */
+  gather(system->u, 0.0, NULL, along_x, l0, l1, 0, n, u);
+  gather(v_field, 0.0, NULL, along_x, l0, l1, -1, n, v);
+  gather(system->alpha, system->alpha_const, system->u_updated,
+	 along_x, l0, l1, 0, n, alpha);
+  gather(system->beta, system->beta_const, system->v_updated,
+	 along_x, l0, l1, -1, n, beta);
+
+  /* Build the tridiagonal system for u[1] to u[n-2], u[0] and u[n-1]
+     being held at zero, and eliminate the lower diagonal (the forward
+     sweep of the Thomas algorithm), leaving the right-hand side in d
+     and the upper diagonal in c */
+  for (w = 0; w < BATCH; w++) {
+    c[w] = d[w] = 0.0;
+  }
+  for (k = 1; k < n-1; k++) {
+    real *uk = u + k*BATCH, *vk = v + k*BATCH;
+    real *ak = alpha + k*BATCH, *bk = beta + k*BATCH;
+    real *ck = c + k*BATCH, *dk = d + k*BATCH;
+    for (w = 0; w < BATCH; w++) {
+      real lower = -0.25*ak[w]*bk[w-BATCH];
+      real upper = -0.25*ak[w]*bk[w];
+      real rhs = uk[w] + sign*ak[w]*(vk[w] - vk[w-BATCH])
+	- upper*(uk[w+BATCH] - uk[w]) + lower*(uk[w] - uk[w-BATCH]);
+      real pivot = 1.0 - lower - upper - lower*ck[w-BATCH];
+      ck[w] = upper/pivot;
+      dk[w] = (rhs - lower*dk[w-BATCH])/pivot;
+    }
+  }
+
+  /* Back-substitute, leaving u' in d */
+  for (w = 0; w < BATCH; w++) {
+    d[(n-1)*BATCH+w] = 0.0;
+  }
+  for (k = n-2; k > 0; k--) {
+    real *ck = c + k*BATCH, *dk = d + k*BATCH;
+    for (w = 0; w < BATCH; w++) {
+      dk[w] -= ck[w]*dk[w+BATCH];
+    }
+  }
+
+  /* Update v from the mean of u and u' */
+  for (k = 0; k < n-1; k++) {
+    real *uk = u + k*BATCH, *vk = v + k*BATCH;
+    real *bk = beta + k*BATCH, *dk = d + k*BATCH;
+    for (w = 0; w < BATCH; w++) {
+      vk[w] += 0.5*sign*bk[w]*(dk[w+BATCH] + uk[w+BATCH] - dk[w] - uk[w]);
+    }
+  }
+
+  scatter(system->u, along_x, l0, l1, 0, 1, n-1, d);
+  scatter(v_field, along_x, l0, l1, -1, 0, n-1, v);
+}
+
+/* Advance "system" through one stage along x or y, sharing the
+   batches of lines among the threads of the enclosing parallel
+   region */
+static
+void
+stage(mwDomain *domain, const lodSystem *system, int along_x, real *work)
+{
+  int nlines = along_x ? domain->ny : domain->nx;
+  int n = along_x ? domain->nx : domain->ny;
+  int l0;
+#pragma omp for schedule(static)
+  for (l0 = 1; l0 < nlines-1; l0 += BATCH) {
+    int l1 = l0+BATCH < nlines-1 ? l0+BATCH : nlines-1;
+    advance_lines(system, along_x, l0, l1, n, work);
+  }
+}
+
+/* Multiply columns i0 to i1-1 of a row of "field" by "damping" */
+static
+void
+damp(real *field, const real *damping, int i0, int i1)
+{
+  int i;
+  for (i = i0; i < i1; i++) {
+    field[i] *= damping[i];
+  }
+}
+
+/* Damp row j of a field by "damping", which is 1 outside the
+   absorbing border unless "everywhere" is true */
+static
+void
+damp_row(mwDomain *domain, real **field, real **damping, int j,
+	 int everywhere)
+{
+  int border = domain->borderwidth;
+  if (!field) {
+    return;
+  }
+  if (everywhere || j < border || j >= domain->ny-border) {
+    damp(field[j], damping[j], 0, domain->nx);
+  }
+  else {
+    damp(field[j], damping[j], 0, border);
+    damp(field[j], damping[j], domain->nx-border, domain->nx);
+  }
+}
+
+/* Add the oscillator forcing to row j of "field" (if not NULL),
+   except inside the conductors of "mask" (if not NULL) */
+static
+void
+force_row(mwDomain *domain, real **field, const mwMask *mask, int j,
+	  real fI, real fQ)
+{
+  int k;
+  if (!field) {
+    return;
+  }
+  if (!mask || !mask->start) {
+    mw_apply_sources(domain, field, j, 0, domain->nx, fI, fQ);
+    return;
+  }
+  for (k = mask->start[j]; k < mask->start[j+1]; k++) {
+    mw_apply_sources(domain, field, j, mask->runs[k].i0, mask->runs[k].i1,
+		     fI, fQ);
+  }
+}
+
+/* Move the E and B fields forward nsteps timesteps with the LOD
+   scheme, updating the forcing each timestep. The damping of the
+   absorbing border and of lossy materials is applied as a factor at
+   the start of each timestep and the oscillator forcing is then
+   added, before the two stages. The scheme couples every pixel of a
+   row or column in each stage, so the active region is not used. */
+int
+mw_step_lod(mwDomain *domain, int nsteps)
+{
+  mwForcing forcing[MW_MINOR_STEPS];
+  lodSystem system[4];
+  lodState *state;
+  real dt = domain->dt;
+  real dt_dx = 0.5*domain->dt/domain->dx;
+  real Eprefix_vacuum = 0.5*dt*domain->c*domain->c/domain->dx;
+  int nsystems = 0, n, l, status = MW_SUCCESS;
+
+  if (nsteps > MW_MINOR_STEPS) {
+    fprintf(stderr, "Too many timesteps for mw_step_lod\n");
+    return MW_FAILURE;
+  }
+  MW_CHECK(mw_init_coefficients(domain));
+  MW_CHECK(init_lod(domain));
+  state = (lodState*) domain->lod;
+
+  /* Compute the forcing for each timestep in advance */
+  for (l = 0; l < nsteps; l++) {
+    mw_set_forcing(domain);
+    forcing[l] = domain->forcing;
+    domain->time += dt;
+  }
+  domain->active_i0 = domain->active_j0 = 0;
+  domain->active_i1 = domain->nx;
+  domain->active_j1 = domain->ny;
+
+  /* List the systems: Ez with By and Bx, and Bz with Ey and Ex, in
+     the domain and in vacuum */
+  memset(system, 0, sizeof(system));
+  if (domain->mode & MW_MODE_EZ) {
+    lodSystem *s = system + nsystems++;
+    s->u = domain->Ez;
+    s->v_x = domain->By;
+    s->v_y = domain->Bx;
+    s->alpha = domain->Eprefix;
+    s->beta_const = dt_dx;
+    s->u_updated = state->updated[FLAGS_E];
+    s->v_updated = state->updated[FLAGS_TM_B];
+    s->sign = 1.0;
+    if (domain->mode & MW_MODE_VACUUM) {
+      s = system + nsystems++;
+      s->u = domain->Ez_vacuum;
+      s->v_x = domain->By_vacuum;
+      s->v_y = domain->Bx_vacuum;
+      s->alpha_const = Eprefix_vacuum;
+      s->beta_const = dt_dx;
+      s->sign = 1.0;
+    }
+  }
+  if (domain->mode & MW_MODE_EXY) {
+    lodSystem *s = system + nsystems++;
+    s->u = domain->Bz;
+    s->v_x = domain->Ey;
+    s->v_y = domain->Ex;
+    s->alpha_const = dt_dx;
+    s->beta = domain->Eprefix;
+    s->u_updated = state->updated[FLAGS_TE_B];
+    s->v_updated = state->updated[FLAGS_E];
+    s->sign = -1.0;
+    if (domain->mode & MW_MODE_VACUUM) {
+      s = system + nsystems++;
+      s->u = domain->Bz_vacuum;
+      s->v_x = domain->Ey_vacuum;
+      s->v_y = domain->Ex_vacuum;
+      s->alpha_const = dt_dx;
+      s->beta_const = Eprefix_vacuum;
+      s->sign = -1.0;
+    }
+  }
+  n = domain->nx > domain->ny ? domain->nx : domain->ny;
+
+#pragma omp parallel
+  {
+    real *work = (real*) malloc(sizeof(real)*6*n*BATCH);
+    int j, k, t;
+    if (!work) {
+#pragma omp atomic write
+      status = MW_FAILURE;
+    }
+#pragma omp barrier
+    for (t = 0; t < nsteps && status == MW_SUCCESS; t++) {
+#pragma omp for schedule(static)
+      for (j = 0; j < domain->ny; j++) {
+	const mwForcing *f = forcing+t;
+	int lossy = !domain->lossless;
+	damp_row(domain, domain->Ez, domain->Edamping, j, lossy);
+	damp_row(domain, domain->Ex, domain->Edamping, j, lossy);
+	damp_row(domain, domain->Ey, domain->Edamping, j, lossy);
+	damp_row(domain, domain->Bx, domain->Bdamping, j, 0);
+	damp_row(domain, domain->By, domain->Bdamping, j, 0);
+	damp_row(domain, domain->Bz, domain->Bdamping, j, 0);
+	damp_row(domain, domain->Ez_vacuum, domain->Bdamping, j, 0);
+	damp_row(domain, domain->Ex_vacuum, domain->Bdamping, j, 0);
+	damp_row(domain, domain->Ey_vacuum, domain->Bdamping, j, 0);
+	damp_row(domain, domain->Bx_vacuum, domain->Bdamping, j, 0);
+	damp_row(domain, domain->By_vacuum, domain->Bdamping, j, 0);
+	damp_row(domain, domain->Bz_vacuum, domain->Bdamping, j, 0);
+	force_row(domain, domain->Ez, &domain->E_mask, j,
+		  dt*f->Ez_I, dt*f->Ez_Q);
+	force_row(domain, domain->Ex, &domain->E_mask, j,
+		  dt*f->Ex_I, dt*f->Ex_Q);
+	force_row(domain, domain->Ey, &domain->E_mask, j,
+		  dt*f->Ey_I, dt*f->Ey_Q);
+	force_row(domain, domain->Ez_vacuum, NULL, j, dt*f->Ez_I, dt*f->Ez_Q);
+	force_row(domain, domain->Ex_vacuum, NULL, j, dt*f->Ex_I, dt*f->Ex_Q);
+	force_row(domain, domain->Ey_vacuum, NULL, j, dt*f->Ey_I, dt*f->Ey_Q);
+      }
+      for (k = 0; k < nsystems; k++) {
+	stage(domain, system+k, 1, work);
+	stage(domain, system+k, 0, work);
+      }
+    }
+    if (work) {
+      free(work);
+    }
+  }
+
+  if (status != MW_SUCCESS) {
+    fprintf(stderr, "Error allocating the work arrays of the implicit scheme\n");
+  }
+  return status;
+}
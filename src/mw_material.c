@@ -0,0 +1,240 @@
+/* mw_material.c -- Store the electric-field coefficients as a table
+   of materials indexed by a one-byte field
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "maxwell.h"
+
+/* Return the index of the material with the specified damping factor
+   and prefix, adding it to the table if it is not already there, or
+   -1 if the table is full. Neighbouring cells are usually of the same
+   material, so "guess" (the previous answer) is tried first. */
+static
+int
+find_material(mwDomain *domain, real damping, real prefix, int guess)
+{
+  int k;
+  if (guess < domain->nmaterials
+      && domain->material_Edamping[guess] == damping
+      && domain->material_Eprefix[guess] == prefix) {
+    return guess;
+  }
+  for (k = 0; k < domain->nmaterials; k++) {
+    if (domain->material_Edamping[k] == damping
+	&& domain->material_Eprefix[k] == prefix) {
+      return k;
+    }
+  }
+  if (domain->nmaterials >= MW_MAX_MATERIALS) {
+    return -1;
+  }
+  domain->material_Edamping[k] = damping;
+  domain->material_Eprefix[k] = prefix;
+  domain->nmaterials++;
+  return k;
+}
+
+/* Free the material field and table, after which mw_step uses the
+   per-cell coefficients */
+int
+mw_free_materials(mwDomain *domain)
+{
+  if (domain->material) {
+    free(*domain->material);
+    free(domain->material);
+  }
+  if (domain->material_Edamping) {
+    free(domain->material_Edamping);
+  }
+  if (domain->material_Eprefix) {
+    free(domain->material_Eprefix);
+  }
+  if (domain->material_rows) {
+    free(domain->material_rows);
+  }
+  domain->material = NULL;
+  domain->material_Edamping = domain->material_Eprefix = NULL;
+  domain->material_rows = NULL;
+  domain->nmaterials = 0;
+  return MW_SUCCESS;
+}
+
+/* Most scenes contain only a few distinct materials, so the Edamping
+   and Eprefix fields computed by mw_init_coefficients can be replaced
+   by a table of at most MW_MAX_MATERIALS pairs of coefficients and a
+   one-byte index into it for each cell, reducing the coefficients
+   read by the electric-field update from 8 bytes per cell to 1. A
+   scene with a smooth gradient or ripples may have too many distinct
+   values; the rows for which the table runs out of space keep using
+   the per-cell fields, and are flagged by a zero in material_rows.
+   The table is only used if "material_table" is set in the
+   configuration: the gather through the index costs about as much
+   time as the smaller reads save, or more with temporal blocking. */
+int
+mw_init_materials(mwDomain *domain)
+{
+  int nx = domain->nx;
+  int ny = domain->ny;
+  /* The last row is only updated across a periodic edge */
+  int ny_updated = ny - !(domain->periodic & MW_PERIODIC_Y);
+  int j;
+  int nindexed = 0;
+
+  mw_free_materials(domain);
+  domain->material = (mwMaterial**) malloc(sizeof(mwMaterial*)*ny);
+  domain->material_Edamping
+    = (real*) malloc(sizeof(real)*MW_MAX_MATERIALS);
+  domain->material_Eprefix
+    = (real*) malloc(sizeof(real)*MW_MAX_MATERIALS);
+  domain->material_rows = (char*) calloc(ny, sizeof(char));
+  if (!domain->material || !domain->material_Edamping
+      || !domain->material_Eprefix || !domain->material_rows) {
+    fprintf(stderr, "Error allocating the material table\n");
+    return MW_FAILURE;
+  }
+  /* The vector kernels may read the indices of up to a vector beyond
+     the end of a row */
+  *domain->material = (mwMaterial*) malloc(sizeof(mwMaterial)*nx*ny
+					   + MW_ALIGN);
+  if (!*domain->material) {
+    fprintf(stderr, "Error allocating the material field\n");
+    return MW_FAILURE;
+  }
+  for (j = 1; j < ny; j++) {
+    domain->material[j] = domain->material[0] + j*nx;
+  }
+
+  /* Touch the pages of the material field from the threads that will
+     read it, as in mw_reset_field */
+#pragma omp parallel
+  {
+    int j, j0, j1;
+    mw_thread_rows(ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      memset(domain->material[j], 0, sizeof(mwMaterial)*nx);
+    }
+  }
+
+  mw_index_materials(domain, 0, ny_updated);
+  for (j = 0; j < ny_updated; j++) {
+    nindexed += domain->material_rows[j];
+  }
+
+  if (nindexed == 0) {
+    mw_free_materials(domain);
+  }
+  return MW_SUCCESS;
+}
+
+/* Index rows j0 to j1-1 of the material field from the Edamping and
+   Eprefix fields, adding any new materials to the table. The table is
+   built row by row so that the indices do not depend on the number of
+   threads; if a row does not fit then the materials it added are
+   removed again and the row is flagged to use the per-cell fields. */
+void
+mw_index_materials(mwDomain *domain, int j0, int j1)
+{
+  /* The last row and column are only updated across periodic edges */
+  int nx_updated = domain->nx - !(domain->periodic & MW_PERIODIC_X);
+  int ny_updated = domain->ny - !(domain->periodic & MW_PERIODIC_Y);
+  int i, j;
+  if (!domain->material) {
+    return;
+  }
+  for (j = j0 > 0 ? j0 : 0; j < j1 && j < ny_updated; j++) {
+    int nmaterials = domain->nmaterials;
+    int k = 0;
+    for (i = 0; i < nx_updated; i++) {
+      k = find_material(domain, domain->Edamping[j][i],
+			domain->Eprefix[j][i], k);
+      if (k < 0) {
+	break;
+      }
+      domain->material[j][i] = k;
+    }
+    if (i < nx_updated) {
+      domain->nmaterials = nmaterials;
+      domain->material_rows[j] = 0;
+    }
+    else {
+      domain->material_rows[j] = 1;
+    }
+  }
+}
+
+/* Move the rows of the material field nrows down, as mw_shift_field
+   does for the fields; the rows exposed at the top are flagged to use
+   the per-cell fields until they are indexed */
+void
+mw_shift_materials(mwDomain *domain, int nrows)
+{
+  int nx = domain->nx, ny = domain->ny;
+  if (!domain->material) {
+    return;
+  }
+  if (nrows < ny) {
+    memmove(domain->material[0], domain->material[nrows],
+	    sizeof(mwMaterial)*nx*(ny-nrows));
+    memmove(domain->material_rows, domain->material_rows+nrows,
+	    sizeof(char)*(ny-nrows));
+  }
+  else {
+    nrows = ny;
+  }
+  memset(domain->material_rows+ny-nrows, 0, sizeof(char)*nrows);
+}
+
+/* Give "band", a copy of "domain" holding only its rows j0 to
+   j0+band->ny-1 (see mw_mpi.c), its own material table and a material
+   field holding those rows */
+int
+mw_crop_materials(mwDomain *band, const mwDomain *domain, int j0)
+{
+  int nx = band->nx, ny = band->ny;
+  int j;
+  if (!domain->material) {
+    return MW_SUCCESS;
+  }
+  band->material = (mwMaterial**) malloc(sizeof(mwMaterial*)*ny);
+  band->material_Edamping = (real*) malloc(sizeof(real)*MW_MAX_MATERIALS);
+  band->material_Eprefix = (real*) malloc(sizeof(real)*MW_MAX_MATERIALS);
+  band->material_rows = (char*) malloc(sizeof(char)*ny);
+  if (!band->material || !band->material_Edamping
+      || !band->material_Eprefix || !band->material_rows) {
+    fprintf(stderr, "Error allocating the material table\n");
+    return MW_FAILURE;
+  }
+  *band->material = (mwMaterial*) malloc(sizeof(mwMaterial)*nx*ny
+					 + MW_ALIGN);
+  if (!*band->material) {
+    fprintf(stderr, "Error allocating the material field\n");
+    return MW_FAILURE;
+  }
+  for (j = 1; j < ny; j++) {
+    band->material[j] = band->material[0] + j*nx;
+  }
+  memcpy(band->material_Edamping, domain->material_Edamping,
+	 sizeof(real)*MW_MAX_MATERIALS);
+  memcpy(band->material_Eprefix, domain->material_Eprefix,
+	 sizeof(real)*MW_MAX_MATERIALS);
+  memcpy(band->material_rows, domain->material_rows+j0, sizeof(char)*ny);
+  memcpy(*band->material, domain->material[j0], sizeof(mwMaterial)*nx*ny);
+  return MW_SUCCESS;
+}
@@ -46,6 +46,19 @@ mw_scale(int nx, int ny, real **arg, real factor)
   return MW_SUCCESS;
 }
 
+/* Scale the double-precision field "arg" by "factor" */
+int
+mw_scale_sum(int nx, int ny, double **arg, double factor)
+{
+  int i, j;
+  for (j = 0; j < ny; j++) {
+    for (i = 0; i < nx; i++) {
+      arg[j][i] *= factor;
+    }
+  }
+  return MW_SUCCESS;
+}
+
 /* Calculate the complex susceptibility from the complex refractive
    index using the Clausius-Mosotti relationship
    xi=3(n^2-1)/(n^2+2). The input ni may be positive or negative, but
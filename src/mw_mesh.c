@@ -0,0 +1,299 @@
+/* mw_mesh.c -- Graded meshes with their own spacing for each column and row
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* The pixels are normally squares dx across, so a scene with one
+   small feature in a large empty region pays for fine resolution
+   everywhere. A graded mesh instead refines only the columns and rows
+   that cross the feature: within each region listed in "refine_x"
+   (or "refine_y") every pixel of the base grid is divided into as many
+   columns (or rows) as are needed to bring their spacing down to that
+   requested, and away from the region the number of divisions falls
+   by about a factor "mesh_grading" from one pixel to the next, until
+   it is one. The mesh is a tensor product, every row having the same
+   columns, and the columns of the base grid remain columns of the
+   mesh, so the edges of the domain and the absorbing border are
+   unchanged.
+
+   The position of each column is held in mesh_x in units of dx, from
+   0 at the left edge to x_pixels-1 at the right, and the shapes and
+   oscillators are placed by position rather than by index; on a
+   uniform mesh the position of each column is simply its index. The
+   kernels in mw_kernel_graded.c multiply each difference by dx over
+   the distance it spans, and since the smallest spacing limits the
+   stability of the explicit scheme the timestep is reduced in
+   proportion to it. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "maxwell.h"
+
+/* Allocate the positions of the n columns (or rows) of one axis of
+   the mesh, with MW_HALO ghost positions beyond each edge, and the
+   ratios of dx to the spacing between them. The positions are taken
+   from "positions", or are the indices if it is NULL. */
+static
+int
+new_axis(int n, const real *positions, real **mesh, real **ratio,
+	 real **dual)
+{
+  real *m = (real*) malloc(sizeof(real)*(n+2*MW_HALO));
+  real spacing0 = 1.0, spacing1 = 1.0;
+  int k;
+  *ratio = (real*) malloc(sizeof(real)*n);
+  *dual = (real*) malloc(sizeof(real)*n);
+  if (!m || !*ratio || !*dual) {
+    fprintf(stderr, "Error allocating the mesh\n");
+    free(m);
+    free(*ratio);
+    free(*dual);
+    *mesh = *ratio = *dual = NULL;
+    return MW_FAILURE;
+  }
+  m += MW_HALO;
+  for (k = 0; k < n; k++) {
+    m[k] = positions ? positions[k] : k;
+  }
+  /* The ghost positions continue the spacing at each edge */
+  if (n > 1) {
+    spacing0 = m[1]-m[0];
+    spacing1 = m[n-1]-m[n-2];
+  }
+  for (k = 1; k <= MW_HALO && n > 0; k++) {
+    m[-k] = m[0]-k*spacing0;
+    m[n-1+k] = m[n-1]+k*spacing1;
+  }
+  for (k = 0; k < n; k++) {
+    (*ratio)[k] = 1.0/(m[k+1]-m[k]);
+    (*dual)[k] = 2.0/(m[k+1]-m[k-1]);
+  }
+  *mesh = m;
+  return MW_SUCCESS;
+}
+
+/* Free the arrays of one axis of the mesh */
+static
+void
+free_axis(real *mesh, real *ratio, real *dual)
+{
+  if (mesh) {
+    free(mesh-MW_HALO);
+  }
+  free(ratio);
+  free(dual);
+}
+
+/* Set up a uniform mesh for "domain", whose nx and ny must be set */
+int
+mw_new_mesh(mwDomain *domain)
+{
+  MW_CHECK(new_axis(domain->nx, NULL, &domain->mesh_x,
+		    &domain->ratio_x, &domain->dual_x));
+  MW_CHECK(new_axis(domain->ny, NULL, &domain->mesh_y,
+		    &domain->ratio_y, &domain->dual_y));
+  domain->min_spacing = 1.0;
+  return MW_SUCCESS;
+}
+
+/* Free the mesh of "domain" */
+void
+mw_free_mesh(mwDomain *domain)
+{
+  free_axis(domain->mesh_x, domain->ratio_x, domain->dual_x);
+  free_axis(domain->mesh_y, domain->ratio_y, domain->dual_y);
+  domain->mesh_x = domain->ratio_x = domain->dual_x = NULL;
+  domain->mesh_y = domain->ratio_y = domain->dual_y = NULL;
+}
+
+/* Compute the positions of the columns (or rows) of a graded axis
+   "npixels" pixels of spacing dx across, refined within the regions
+   listed in "refine", a vector of length "nrefine" in which each group
+   of three elements corresponds to: (0) the start and (1) the end of
+   the region, in the same units and relative to the same centre as
+   the shapes, and (2) the largest spacing allowed within it. Away
+   from the regions the number of divisions of each pixel falls by
+   about a factor "grading" per pixel. The positions, in units of dx,
+   are returned in "mesh", a newly allocated array that should be
+   freed with free(), and their number in "n". */
+int
+mw_grade_axis(const real *refine, int nrefine, int npixels, real dx,
+	      real grading, real **mesh, int *n)
+{
+  /* The number of divisions of the pixel from k to k+1 */
+  int *divisions = (int*) malloc(sizeof(int)*(npixels > 1 ? npixels-1 : 1));
+  int k, l, m;
+  if (!divisions) {
+    fprintf(stderr, "Error allocating the mesh\n");
+    return MW_FAILURE;
+  }
+  for (k = 0; k < npixels-1; k++) {
+    divisions[k] = 1;
+  }
+  for ( ; nrefine > 2; nrefine -= 3, refine += 3) {
+    real lo = refine[0]/dx + npixels/2.0;
+    real hi = refine[1]/dx + npixels/2.0;
+    if (refine[2] <= 0.0 || hi < lo) {
+      fprintf(stderr, "Each mesh refinement must be a start and end position and a positive spacing\n");
+      free(divisions);
+      return MW_FAILURE;
+    }
+    /* Allow for rounding when dx is a multiple of the spacing */
+    m = ceil(dx/refine[2] - 1.0e-4);
+    for (k = 0; k < npixels-1; k++) {
+      if (k+1 > lo && k < hi && divisions[k] < m) {
+	divisions[k] = m;
+      }
+    }
+  }
+  /* Grade the divisions away from each region in both directions */
+  for (k = 1; k < npixels-1; k++) {
+    m = (int) (divisions[k-1]/grading + 0.5);
+    if (divisions[k] < m) {
+      divisions[k] = m;
+    }
+  }
+  for (k = npixels-3; k >= 0; k--) {
+    m = (int) (divisions[k+1]/grading + 0.5);
+    if (divisions[k] < m) {
+      divisions[k] = m;
+    }
+  }
+  *n = 1;
+  for (k = 0; k < npixels-1; k++) {
+    *n += divisions[k];
+  }
+  *mesh = (real*) malloc(sizeof(real)*(*n));
+  if (!*mesh) {
+    fprintf(stderr, "Error allocating the mesh\n");
+    free(divisions);
+    return MW_FAILURE;
+  }
+  m = 0;
+  for (k = 0; k < npixels-1; k++) {
+    for (l = 0; l < divisions[k]; l++) {
+      (*mesh)[m++] = k + (real) l/divisions[k];
+    }
+  }
+  (*mesh)[m] = npixels-1;
+  free(divisions);
+  return MW_SUCCESS;
+}
+
+/* Replace the uniform mesh of "domain" along x and/or y by the graded
+   positions in "mesh_x" and "mesh_y", computed by mw_grade_axis for
+   the nx and ny of the domain; an axis whose positions are NULL stays
+   uniform. Shapes and oscillators are then placed relative to the
+   centre of the pixels of the base grid, and the kernels for a graded
+   mesh are used. The timestep must afterwards be multiplied by
+   min_spacing, as mw_start does. */
+int
+mw_set_mesh(mwDomain *domain, const real *mesh_x, const real *mesh_y)
+{
+  real *ratio;
+  int axis, k;
+  for (axis = 0; axis < 2; axis++) {
+    const real *positions = axis ? mesh_y : mesh_x;
+    int n = axis ? domain->ny : domain->nx;
+    if (!positions) {
+      continue;
+    }
+    if (axis) {
+      free_axis(domain->mesh_y, domain->ratio_y, domain->dual_y);
+      MW_CHECK(new_axis(n, positions, &domain->mesh_y,
+			&domain->ratio_y, &domain->dual_y));
+      domain->origin_y = (positions[n-1]+1.0)/2.0;
+    }
+    else {
+      free_axis(domain->mesh_x, domain->ratio_x, domain->dual_x);
+      MW_CHECK(new_axis(n, positions, &domain->mesh_x,
+			&domain->ratio_x, &domain->dual_x));
+      domain->origin_x = (positions[n-1]+1.0)/2.0;
+    }
+    ratio = axis ? domain->ratio_y : domain->ratio_x;
+    for (k = 0; k < n-1; k++) {
+      if (1.0/ratio[k] < domain->min_spacing) {
+	domain->min_spacing = 1.0/ratio[k];
+      }
+    }
+    domain->kernels_graded = mw_kernels_graded();
+  }
+  return MW_SUCCESS;
+}
+
+/* Return the index of the last column (axis 0) or row (axis 1) of
+   "domain" whose position is not beyond "position", in units of dx;
+   on a uniform mesh this is simply the position converted to an
+   integer. Beyond the edges of the domain the columns are taken to
+   continue one pixel apart. */
+int
+mw_mesh_index(const mwDomain *domain, int axis, real position)
+{
+  const real *mesh = axis ? domain->mesh_y : domain->mesh_x;
+  int n = axis ? domain->ny : domain->nx;
+  int lo = 0, hi = n-1;
+  if (position < mesh[0]) {
+    return (int) (position-mesh[0]);
+  }
+  else if (position >= mesh[n-1]) {
+    return n-1 + (int) (position-mesh[n-1]);
+  }
+  /* Binary search with mesh[lo] <= position < mesh[hi] */
+  while (hi-lo > 1) {
+    int mid = (lo+hi)/2;
+    if (mesh[mid] <= position) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* Return the position, in units of dx, of column (axis 0) or row
+   (axis 1) k of "domain", which may be beyond its edges */
+real
+mw_mesh_position(const mwDomain *domain, int axis, int k)
+{
+  const real *mesh = axis ? domain->mesh_y : domain->mesh_x;
+  int n = axis ? domain->ny : domain->nx;
+  if (k < 0) {
+    return mesh[0]+k;
+  }
+  else if (k > n-1) {
+    return mesh[n-1]+(k-(n-1));
+  }
+  return mesh[k];
+}
+
+/* Return the coordinate in metres, relative to the centre of the
+   scene, of column (axis 0) or row (axis 1) k of the full domain,
+   which is unfolded about any plane of symmetry as in mw_unfold */
+double
+mw_coordinate(const mwDomain *domain, int axis, int k)
+{
+  const real *mesh = axis ? domain->mesh_y : domain->mesh_x;
+  real origin = axis ? domain->origin_y : domain->origin_x;
+  int nx, ny;
+  if (axis ? domain->symmetry_y : domain->symmetry_x) {
+    mw_full_size(domain, &nx, &ny);
+    return (k - (axis ? ny : nx)/2.0)*domain->dx;
+  }
+  return (mesh[k]-origin)*domain->dx;
+}
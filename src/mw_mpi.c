@@ -0,0 +1,486 @@
+/* mw_mpi.c -- Divide the domain among MPI processes
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* A domain can be divided among several processes, each of which
+   advances one band of its rows, just as the threads of a process
+   each advance one band (see mw_thread_rows). Every process builds
+   the whole scene and its coefficients, so that those of the rows at
+   the edges of its band, and the conductor masks that depend on the
+   rows beyond them, are exactly those of a single process, then keeps
+   only its band. The rows that the stencils read just beyond the
+   bottom and top of a band are kept in the ghost rows of its fields
+   (see MW_HALO), which each timestep receive
+
+     after E is updated:  Ex and Ey from the band below into row -1,
+                          Ez from the band above into row ny
+     after B is updated:  Bx and By from the band below into row -1,
+                          Bz from the band above into row ny
+
+   so one row of each component crosses each internal edge per
+   timestep in each direction. The rows at the edges of a band are
+   sent as soon as they have been updated, and the ghost rows are
+   received while the rows that do not read them are updated: E in
+   every row of the band but the one next to the ghost row of B, then
+   once the ghost rows of B have arrived that row, and likewise for B.
+   The arithmetic is that of mw_step, so the fields are identical to
+   those of a single process whatever the number of bands.
+
+   The first process keeps the whole domain as well as its band, and
+   the fields and the Poynting vector are gathered into it to be
+   written out. Features that read rows further away or move them (the
+   fourth-order stencil, a graded mesh, the CPML, subgrid patches, the
+   implicit integrator, periodic or symmetric edges along y,
+   Bloch-periodic edges and the moving window) cannot be used, and the
+   bands are advanced a timestep at a time, without temporal blocking
+   or concurrent streams. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "maxwell.h"
+
+#ifdef MW_DOUBLE
+#define MW_MPI_REAL MPI_DOUBLE
+#else
+#define MW_MPI_REAL MPI_FLOAT
+#endif
+
+/* The most messages of one exchange of ghost rows: a receive and a
+   send of each of three components in the main domain and in
+   vacuum */
+#define MAX_MESSAGES 12
+
+/* An exchange of ghost rows with the processes holding the bands
+   below and above, which are MPI_PROC_NULL at the edges of the
+   domain */
+typedef struct {
+  MPI_Request requests[MAX_MESSAGES];
+  int nrequests;
+  int below, above;
+} mwHalo;
+
+/* Find the band of rows [*j0,*j1) of a domain with ny rows that
+   belongs to process "rank" of nranks */
+static
+void
+band_rows(int ny, int rank, int nranks, int *j0, int *j1)
+{
+  *j0 = (ny*rank)/nranks;
+  *j1 = (ny*(rank+1))/nranks;
+}
+
+/* Start receiving row "to" of "field", including its ghost columns,
+   from process "source", and sending row "from" to process "dest" */
+static
+void
+exchange_row(mwHalo *halo, real **field, int nx, int from, int dest,
+	     int to, int source)
+{
+  int count = nx + 2*MW_HALO;
+  /* Every process starts the same exchanges in the same order */
+  int tag = halo->nrequests;
+  MPI_Irecv(field[to]-MW_HALO, count, MW_MPI_REAL, source, tag,
+	    MPI_COMM_WORLD, halo->requests + halo->nrequests++);
+  MPI_Isend(field[from]-MW_HALO, count, MW_MPI_REAL, dest, tag,
+	    MPI_COMM_WORLD, halo->requests + halo->nrequests++);
+}
+
+/* Start exchanging the ghost rows of the E field (if is_E) or of the
+   B field: the components read in the row below the band are sent up
+   from the top row of the band below, and those read in the row above
+   it are sent down from the bottom row of the band above */
+static
+void
+start_exchange(mwDomain *domain, mwHalo *halo, int is_E)
+{
+  int vacuum = (domain->mode & MW_MODE_VACUUM);
+  int nx = domain->nx, ny = domain->ny;
+  real **up[4], **down[2];
+  int nup = 0, ndown = 0, k;
+  if (domain->mode & MW_MODE_EZ) {
+    if (is_E) {
+      down[ndown++] = domain->Ez;
+      if (vacuum) {
+	down[ndown++] = domain->Ez_vacuum;
+      }
+    }
+    else {
+      up[nup++] = domain->Bx;
+      up[nup++] = domain->By;
+      if (vacuum) {
+	up[nup++] = domain->Bx_vacuum;
+	up[nup++] = domain->By_vacuum;
+      }
+    }
+  }
+  if (domain->mode & MW_MODE_EXY) {
+    if (is_E) {
+      up[nup++] = domain->Ex;
+      up[nup++] = domain->Ey;
+      if (vacuum) {
+	up[nup++] = domain->Ex_vacuum;
+	up[nup++] = domain->Ey_vacuum;
+      }
+    }
+    else {
+      down[ndown++] = domain->Bz;
+      if (vacuum) {
+	down[ndown++] = domain->Bz_vacuum;
+      }
+    }
+  }
+  halo->nrequests = 0;
+  for (k = 0; k < nup; k++) {
+    exchange_row(halo, up[k], nx, ny-1, halo->above, -1, halo->below);
+  }
+  for (k = 0; k < ndown; k++) {
+    exchange_row(halo, down[k], nx, 0, halo->below, ny, halo->above);
+  }
+}
+
+/* Wait for an exchange of ghost rows to finish */
+static
+void
+finish_exchange(mwHalo *halo)
+{
+  MPI_Waitall(halo->nrequests, halo->requests, MPI_STATUSES_IGNORE);
+  halo->nrequests = 0;
+}
+
+/* Move the E and B fields of a band forward one timestep, using the
+   forcing amplitudes in its "forcing". The ghost rows of B may still
+   be arriving on entry, and those of the new B are on return. Ez in
+   row j depends on Bx and By in row j-1 and Bx/By in row j on Ez in
+   row j+1, while Ex/Ey in row j depends on Bz in row j+1 and Bz in
+   row j on Ex and Ey in row j-1, so of each field only the row at one
+   edge of the band waits for the exchange. */
+static
+void
+step_band(mwDomain *domain, mwHalo *halo)
+{
+  int tm = domain->mode & MW_MODE_EZ;
+  int te = domain->mode & MW_MODE_EXY;
+  int nx = domain->nx, ny = domain->ny;
+
+  mw_grow_active(domain, 1);
+
+#pragma omp parallel if (ny >= 2*domain->nthreads)
+  {
+    int j, j0, j1;
+    mw_thread_rows(ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      if (tm && j > 0) {
+	mw_step_tm_E(domain, &domain->forcing, j, 0, nx, MW_PART_ALL);
+	mw_wrap_tm_E(domain, 1, j);
+      }
+      if (te && j < ny-1) {
+	mw_step_te_E(domain, &domain->forcing, j, 0, nx, MW_PART_ALL);
+	mw_wrap_te_E(domain, 1, j);
+      }
+    }
+  }
+  finish_exchange(halo);
+  if (tm) {
+    mw_step_tm_E(domain, &domain->forcing, 0, 0, nx, MW_PART_ALL);
+    mw_wrap_tm_E(domain, 1, 0);
+  }
+  if (te) {
+    mw_step_te_E(domain, &domain->forcing, ny-1, 0, nx, MW_PART_ALL);
+    mw_wrap_te_E(domain, 1, ny-1);
+  }
+  start_exchange(domain, halo, 1);
+
+#pragma omp parallel if (ny >= 2*domain->nthreads)
+  {
+    int j, j0, j1;
+    mw_thread_rows(ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      if (tm && j < ny-1) {
+	mw_step_tm_B(domain, j, 0, nx, MW_PART_ALL);
+	mw_wrap_tm_B(domain, 1, j);
+      }
+      if (te && j > 0) {
+	mw_step_te_B(domain, j, 0, nx, MW_PART_ALL);
+	mw_wrap_te_B(domain, 1, j);
+      }
+    }
+  }
+  finish_exchange(halo);
+  if (tm) {
+    mw_step_tm_B(domain, ny-1, 0, nx, MW_PART_ALL);
+    mw_wrap_tm_B(domain, 1, ny-1);
+  }
+  if (te) {
+    mw_step_te_B(domain, 0, 0, nx, MW_PART_ALL);
+    mw_wrap_te_B(domain, 1, 0);
+  }
+  start_exchange(domain, halo, 0);
+
+  domain->time += domain->dt;
+}
+
+/* Replace a double-precision field, if it exists, with a new one
+   holding ny of its rows from row j0 onwards */
+static
+int
+crop_sum(double ***sum, int nx, int ny, int j0)
+{
+  double **band;
+  if (!*sum) {
+    return MW_SUCCESS;
+  }
+  MW_CHECK(mw_new_sum(&band, nx, ny));
+  memcpy(*band, (*sum)[j0], sizeof(double)*nx*ny);
+  *sum = band;
+  return MW_SUCCESS;
+}
+
+/* Set up "band" as the band of rows of "domain", initialized by
+   mw_start, that belongs to the calling process. The coefficients of
+   the whole domain are computed first, so mw_nc_init must already
+   have been called for it if it is to be written out. The band has
+   its own copy of everything that mw_free_domain frees, so the whole
+   domain can then be freed unless it is needed for output. */
+int
+mw_mpi_split(mwDomain *domain, mwDomain *band)
+{
+  real ***fields[17];
+  double ***sums[4];
+  int nx = domain->nx;
+  int rank, nranks, j0, j1, k;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (domain->integrator == MW_INTEGRATOR_LOD || domain->kernels4
+      || domain->kernels_graded || domain->cpml || domain->subgrid
+      || (domain->periodic & MW_PERIODIC_Y) || domain->bloch
+      || domain->symmetry_y || domain->window_speed > 0.0
+      || domain->storage == MW_STORAGE_BF16) {
+    fprintf(stderr, "A domain divided among processes cannot use the fourth-order stencil, a graded mesh, the CPML, subgrid patches, the implicit integrator, periodic or symmetric edges along y, Bloch-periodic edges, a moving window or bfloat16 storage\n");
+    return MW_FAILURE;
+  }
+  if (domain->ny < nranks) {
+    fprintf(stderr, "A domain of %d rows cannot be divided among %d processes\n",
+	    domain->ny, nranks);
+    return MW_FAILURE;
+  }
+  MW_CHECK(mw_init_coefficients(domain));
+
+  band_rows(domain->ny, rank, nranks, &j0, &j1);
+  *band = *domain;
+  band->ny = j1-j0;
+  band->row_offset = j0;
+  band->ny_global = domain->ny;
+  band->origin_y = domain->origin_y - j0;
+  band->temporal_blocking = 0;
+  band->concurrent_streams = 0;
+  band->scat_field = NULL;
+  band->output = NULL;
+
+  fields[0] = &band->Ex;
+  fields[1] = &band->Ey;
+  fields[2] = &band->Ez;
+  fields[3] = &band->Bx;
+  fields[4] = &band->By;
+  fields[5] = &band->Bz;
+  fields[6] = &band->Ex_vacuum;
+  fields[7] = &band->Ey_vacuum;
+  fields[8] = &band->Ez_vacuum;
+  fields[9] = &band->Bx_vacuum;
+  fields[10] = &band->By_vacuum;
+  fields[11] = &band->Bz_vacuum;
+  fields[12] = &band->epsilon;
+  fields[13] = &band->Edamping;
+  fields[14] = &band->Bdamping;
+  fields[15] = &band->Eprefix;
+  fields[16] = &band->boundaries;
+  sums[0] = &band->Poynting_x;
+  sums[1] = &band->Poynting_y;
+  sums[2] = &band->Poynting_x_scat;
+  sums[3] = &band->Poynting_y_scat;
+  for (k = 0; k < 17; k++) {
+    if (*fields[k] && mw_crop_field(fields[k], nx, domain->ny, j0, j1)) {
+      fprintf(stderr, "Error allocating the fields of the band\n");
+      return MW_FAILURE;
+    }
+  }
+  for (k = 0; k < 4; k++) {
+    if (crop_sum(sums[k], nx, band->ny, j0)) {
+      fprintf(stderr, "Error allocating the Poynting vector of the band\n");
+      return MW_FAILURE;
+    }
+  }
+  MW_CHECK(mw_new_mesh(band));
+  MW_CHECK(mw_crop_materials(band, domain, j0));
+  MW_CHECK(mw_crop_conductors(band, domain, j0));
+  MW_CHECK(mw_crop_sources(band, j0));
+  return MW_SUCCESS;
+}
+
+/* Run a "frame" (usually 7 timesteps) of a band set up by
+   mw_mpi_split and add the Poynting vector at the end of it to the
+   summation. Every process must call this at the same time. */
+int
+mw_mpi_frame(mwDomain *band)
+{
+  mwHalo halo;
+  int rank, nranks, l;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  halo.below = rank > 0 ? rank-1 : MPI_PROC_NULL;
+  halo.above = rank < nranks-1 ? rank+1 : MPI_PROC_NULL;
+  halo.nrequests = 0;
+
+  /* The ghost rows were brought up to date at the end of the last
+     frame */
+  for (l = 0; l < MW_MINOR_STEPS; l++) {
+    mw_set_forcing(band);
+    step_band(band, &halo);
+  }
+  finish_exchange(&halo);
+
+#pragma omp parallel
+  {
+    int j, j0, j1;
+    mw_thread_rows(band->ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      if (band->mode & MW_MODE_EZ) {
+	mw_poynting_tm(band, j);
+      }
+      if (band->mode & MW_MODE_EXY) {
+	mw_poynting_te(band, j);
+      }
+    }
+  }
+
+  band->iframe++;
+  if (band->subnormal_interval > 0
+      && band->iframe % band->subnormal_interval == 0) {
+    mw_report_subnormals(stderr, band);
+  }
+  return MW_SUCCESS;
+}
+
+/* Gather the rows of each band, starting at "rows" and "stride"
+   elements apart, into "whole" on the first process, in which the
+   rows of the whole domain are the same distance apart */
+static
+int
+gather_rows(mwDomain *band, void *rows, void *whole, int stride,
+	    MPI_Datatype type)
+{
+  int *counts = NULL, *displacements = NULL;
+  int rank, nranks, r, j0, j1;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (rank == 0) {
+    counts = (int*) malloc(sizeof(int)*nranks);
+    displacements = (int*) malloc(sizeof(int)*nranks);
+    if (!counts || !displacements) {
+      fprintf(stderr, "Error allocating the layout of the bands\n");
+      return MW_FAILURE;
+    }
+    for (r = 0; r < nranks; r++) {
+      band_rows(band->ny_global, r, nranks, &j0, &j1);
+      counts[r] = stride*(j1-j0);
+      displacements[r] = stride*j0;
+    }
+  }
+  MPI_Gatherv(rows, stride*band->ny, type, whole, counts, displacements,
+	      type, 0, MPI_COMM_WORLD);
+  if (rank == 0) {
+    free(counts);
+    free(displacements);
+  }
+  return MW_SUCCESS;
+}
+
+/* Gather "field" of each band into the corresponding rows of "whole"
+   on the first process. The rows of a field are contiguous, so all
+   those of a band are sent together, with the padding between them. */
+static
+int
+gather_field(mwDomain *band, real **field, real **whole)
+{
+  int stride = field[1]-field[0];
+  return gather_rows(band, field[0], whole ? whole[0] : NULL, stride,
+		     MW_MPI_REAL);
+}
+
+/* Gather the fields of the bands that mw_nc_write_frame writes into
+   "domain", the whole domain, on the first process, where it must not
+   have been freed; every process must call this at the same time */
+int
+mw_mpi_gather_fields(mwDomain *band, mwDomain *domain)
+{
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank > 0) {
+    domain = NULL;
+  }
+  if (band->mode & MW_MODE_EZ) {
+    MW_CHECK(gather_field(band, band->Ez, domain ? domain->Ez : NULL));
+  }
+  if (band->mode & MW_MODE_EXY) {
+    MW_CHECK(gather_field(band, band->Bz, domain ? domain->Bz : NULL));
+  }
+  if (band->mode & MW_MODE_EZ && band->mode & MW_MODE_VACUUM) {
+    MW_CHECK(gather_field(band, band->Ez_vacuum,
+			  domain ? domain->Ez_vacuum : NULL));
+  }
+  if (band->mode & MW_MODE_EXY && band->mode & MW_MODE_VACUUM) {
+    MW_CHECK(gather_field(band, band->Bz_vacuum,
+			  domain ? domain->Bz_vacuum : NULL));
+  }
+  if (domain) {
+    domain->time = band->time;
+    domain->iframe = band->iframe;
+  }
+  return MW_SUCCESS;
+}
+
+/* Gather the Poynting vector summations of the bands into "domain"
+   on the first process, as mw_mpi_gather_fields does for the
+   fields */
+int
+mw_mpi_gather_sums(mwDomain *band, mwDomain *domain)
+{
+  double **sums[4], **wholes[4];
+  int rank, k;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  sums[0] = band->Poynting_x;
+  sums[1] = band->Poynting_y;
+  sums[2] = band->Poynting_x_scat;
+  sums[3] = band->Poynting_y_scat;
+  if (rank == 0) {
+    wholes[0] = domain->Poynting_x;
+    wholes[1] = domain->Poynting_y;
+    wholes[2] = domain->Poynting_x_scat;
+    wholes[3] = domain->Poynting_y_scat;
+    domain->iframe = band->iframe;
+  }
+  for (k = 0; k < 4; k++) {
+    if (sums[k]) {
+      MW_CHECK(gather_rows(band, sums[k][0], rank == 0 ? wholes[k][0] : NULL,
+			   band->nx, MPI_DOUBLE));
+    }
+  }
+  return MW_SUCCESS;
+}
@@ -19,29 +19,39 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <netcdf.h>
 #include "maxwell.h"
 #include "nctools.h"
 
+/* Fields of "real" are converted to float by the NetCDF library when
+   written in double precision */
+#ifdef MW_DOUBLE
+#define nc_put_vara_real nc_put_vara_double
+#else
+#define nc_put_vara_real nc_put_vara_float
+#endif
+
 static int ncstatus;
 #define NC_CHECK(a) if ((ncstatus = (a)) != NC_NOERR) { \
   return MW_FAILURE; }
 
-/* NetCDF variable IDs are stored as static variables within this
-   file; that means that only one NetCDF file may safely be written at
-   a time */
-static int ncid;
-static int xdimid, ydimid, timedimid;
-static int timeid;
-//static int Exid, Eyid;
-//static int Bxid, Byid;
-static int Ezid, Bzid;
-//static int Exscatid, Eyscatid;
-//static int Bxscatid, Byscatid;
-static int Ezscatid, Bzscatid;
-static int Sxid, Syid;
-static int Sxscatid, Syscatid;
-static int nc_skip = 0;
+/* The NetCDF IDs of a file being written, stored in the "output"
+   member of the domain so that the members of an ensemble can each
+   write their own file */
+typedef struct {
+  int ncid;
+  int xdimid, ydimid, timedimid;
+  int timeid;
+  int windowid;
+  int epsilon_r_id, epsilon_i_id;
+  real **epsilon_i;
+  int Ezid, Bzid;
+  int Ezscatid, Bzscatid;
+  int Sxid, Syid;
+  int Sxscatid, Syscatid;
+  int nc_skip;
+} ncFile;
 
 /* Add some standard attributes to a variable */
 static
@@ -61,39 +71,137 @@ add_attributes(int ncid, int fieldid, char *units,
   return MW_SUCCESS;
 }
 
-/* Put a 2D field in the file */
+/* Return the element of M, or of the double-precision S if M is
+   NULL, holding pixel (i,j) of the full domain: if the domain is half
+   or a quarter of a symmetric scene (see mw_symmetry.c) then the
+   pixels beyond the planes of symmetry are the mirror images of those
+   inside, changing sign if the quantity's "parity" is odd across the
+   plane */
+static
+double
+unfold(mwDomain *domain, real **M, double **S, int parity, int i, int j)
+{
+  int mirrored_x, mirrored_y;
+  int ir = mw_unfold(domain, 0, i, &mirrored_x);
+  int jr = mw_unfold(domain, 1, j, &mirrored_y);
+  double value = M ? M[jr][ir] : S[jr][ir];
+  if ((mirrored_x && (parity & MW_ODD_X))
+      ^ (mirrored_y && (parity & MW_ODD_Y))) {
+    value = -value;
+  }
+  return value;
+}
+
+/* Put a 2D field of the full domain in the file, taken from M, or
+   from the double-precision S if M is NULL */
 static
 int
-put_field(int ncid, int fieldid, real **M, int nx, int ny)
+put_field(int ncid, int fieldid, mwDomain *domain, real **M, double **S,
+	  int parity)
 {
   size_t start[2], count[2];
-
-  start[0] = 0;
+  int nx, ny, i, j;
+  double *row;
+
+  /* The rows are not contiguous in memory, and may be unfolded, so
+     are written one by one */
+  mw_full_size(domain, &nx, &ny);
+  row = (double*) malloc(sizeof(double)*nx);
+  if (!row) {
+    return MW_FAILURE;
+  }
   start[1] = 0;
-  count[0] = ny;
+  count[0] = 1;
   count[1] = nx;
-
-  NC_CHECK(nc_put_vara_float(ncid, fieldid, start, count, M[0]));
-
+  for (j = 0; j < ny; j++) {
+    for (i = 0; i < nx; i++) {
+      row[i] = unfold(domain, M, S, parity, i, j);
+    }
+    start[0] = j;
+    if ((ncstatus = nc_put_vara_double(ncid, fieldid, start, count, row))
+	!= NC_NOERR) {
+      free(row);
+      return MW_FAILURE;
+    }
+  }
+  free(row);
   return MW_SUCCESS;
 }
 
-/* Put one 2D slice of a 3D field into the file */
+/* Put one 2D slice of a 3D field of the full domain into the file */
 static
 int
-put_slice(int ncid, int fieldid, real **M, int nx, int ny, int iframe)
+put_slice(int ncid, int fieldid, mwDomain *domain, real **M, int parity,
+	  int iframe)
 {
   size_t start[3], count[3];
+  int nx, ny, i, j;
+  real *row;
 
+  mw_full_size(domain, &nx, &ny);
+  row = (real*) malloc(sizeof(real)*nx);
+  if (!row) {
+    return MW_FAILURE;
+  }
   start[0] = iframe;
-  start[1] = 0;
   start[2] = 0;
   count[0] = 1;
-  count[1] = ny;
+  count[1] = 1;
   count[2] = nx;
+  for (j = 0; j < ny; j++) {
+    for (i = 0; i < nx; i++) {
+      row[i] = unfold(domain, M, NULL, parity, i, j);
+    }
+    start[1] = j;
+    if ((ncstatus = nc_put_vara_real(ncid, fieldid, start, count, row))
+	!= NC_NOERR) {
+      free(row);
+      return MW_FAILURE;
+    }
+  }
+  free(row);
+  return MW_SUCCESS;
+}
 
-  NC_CHECK(nc_put_vara_float(ncid, fieldid, start, count, M[0]));
+/* Store in "epsilon_i" the imaginary part of the dielectric constant,
+   recovered from the factor by which mw_init_coefficients replaced it
+   in Edamping; the last row and column, which are only updated across
+   periodic edges, were never converted */
+static
+void
+imaginary_epsilon(mwDomain *domain, real **epsilon_i)
+{
+  int nx = domain->nx - !(domain->periodic & MW_PERIODIC_X);
+  int ny = domain->ny - !(domain->periodic & MW_PERIODIC_Y);
+  int i, j;
+  for (j = 0; j < domain->ny; j++) {
+    for (i = 0; i < domain->nx; i++) {
+      if (i < nx && j < ny && domain->Eprefix) {
+	epsilon_i[j][i] = -log(domain->Edamping[j][i]/domain->Bdamping[j][i])
+	  *domain->epsilon[j][i]
+	  /(2.0*M_PI*domain->primary_frequency*domain->dt);
+      }
+      else {
+	epsilon_i[j][i] = domain->Edamping[j][i];
+      }
+    }
+  }
+}
 
+/* Write the coordinates of the n columns (axis 0) or rows (axis 1)
+   of the full domain */
+static
+int
+put_coordinate(int ncid, int varid, mwDomain *domain, int axis, int n)
+{
+  size_t index;
+  for (index = 0; index < n; index++) {
+    double coordinate = mw_coordinate(domain, axis, index);
+    if ((ncstatus = nc_put_var1_double(ncid, varid, &index, &coordinate))
+	!= NC_NOERR) {
+      return MW_FAILURE;
+    }
+  }
   return MW_SUCCESS;
 }
 
@@ -103,86 +211,127 @@ mw_nc_init(char *filename, mwDomain *domain, int argc, char **argv)
 {
   char *confstring = NULL;
   char *title = NULL;
-  int epsilon_r_id, epsilon_i_id;
+  char *epsilon_comment = NULL;
+  int xid, yid;
+  int epsilon_ndims = 2;
   int dimids[3];
+  int full_nx, full_ny;
+  double frequency = domain->primary_frequency;
+  double amplitude[3];
+  ncFile *nc = (ncFile*) calloc(1, sizeof(ncFile));
+  if (!nc) {
+    fprintf(stderr, "Error allocating the NetCDF file state\n");
+    return MW_FAILURE;
+  }
+  domain->output = nc;
   
   /* If we are only interested in the Poynting vector and the
      dielectric constant then this option will result in the
      time-dependent fields not being stored */
-  nc_skip = rc_get_boolean(domain->config,
+  nc->nc_skip = rc_get_boolean(domain->config,
 			   "nc_skip_time_dependent_fields");
   /* Open new file */
-  NC_CHECK(nc_create(filename, NC_CLOBBER, &ncid));
+  NC_CHECK(nc_create(filename, NC_CLOBBER, &nc->ncid));
 
   /* Set the dimensions */
-  if (!nc_skip) {
-    NC_CHECK(nc_def_dim(ncid, "time", NC_UNLIMITED, &timedimid));
+  if (!nc->nc_skip) {
+    NC_CHECK(nc_def_dim(nc->ncid, "time", NC_UNLIMITED, &nc->timedimid));
   }
-  NC_CHECK(nc_def_dim(ncid, "y", domain->ny, &ydimid));
-  NC_CHECK(nc_def_dim(ncid, "x", domain->nx, &xdimid));
+  /* If the domain is half or a quarter of a symmetric scene then the
+     fields are unfolded to the full scene */
+  mw_full_size(domain, &full_nx, &full_ny);
+  NC_CHECK(nc_def_dim(nc->ncid, "y", full_ny, &nc->ydimid));
+  NC_CHECK(nc_def_dim(nc->ncid, "x", full_nx, &nc->xdimid));
 
   /* Define the variables */
-  dimids[0] = timedimid;
-  dimids[1] = ydimid;
-  dimids[2] = xdimid;
+  dimids[0] = nc->timedimid;
+  dimids[1] = nc->ydimid;
+  dimids[2] = nc->xdimid;
 
-  if (!nc_skip) {
-    NC_CHECK(nc_def_var(ncid, "time", NC_FLOAT,
-			1, dimids, &timeid));
+  if (!nc->nc_skip) {
+    NC_CHECK(nc_def_var(nc->ncid, "time", NC_FLOAT,
+			1, dimids, &nc->timeid));
   }
-  NC_CHECK(nc_def_var(ncid, "epsilon_r", NC_FLOAT, 
-		      2, &dimids[1], &epsilon_r_id));
-  NC_CHECK(nc_def_var(ncid, "epsilon_i", NC_FLOAT, 
-		      2, &dimids[1], &epsilon_i_id));
-  if (!nc_skip) {
-    NC_CHECK(add_attributes(ncid, timeid, "s", 
+  NC_CHECK(nc_def_var(nc->ncid, "y", NC_FLOAT, 1, &dimids[1], &yid));
+  NC_CHECK(nc_def_var(nc->ncid, "x", NC_FLOAT, 1, &dimids[2], &xid));
+  NC_CHECK(add_attributes(nc->ncid, yid, "m",
+			  "Distance of each row from the centre of the scene",
+			  NULL));
+  NC_CHECK(add_attributes(nc->ncid, xid, "m",
+			  "Distance of each column from the centre of the scene",
+			  "The columns and rows are evenly spaced unless the mesh is graded"));
+  /* A moving window brings new parts of the scene into the domain,
+     so the dielectric constant is then written with every frame */
+  if (domain->window_speed > 0.0) {
+    if (nc->nc_skip) {
+      epsilon_comment = "This is the scene in the initial position of the moving window";
+    }
+    else {
+      epsilon_ndims = 3;
+      MW_CHECK(mw_new_field(&nc->epsilon_i, domain->nx, domain->ny, 0));
+    }
+  }
+  NC_CHECK(nc_def_var(nc->ncid, "epsilon_r", NC_FLOAT, epsilon_ndims,
+		      dimids+3-epsilon_ndims, &nc->epsilon_r_id));
+  NC_CHECK(nc_def_var(nc->ncid, "epsilon_i", NC_FLOAT, epsilon_ndims,
+		      dimids+3-epsilon_ndims, &nc->epsilon_i_id));
+  if (!nc->nc_skip) {
+    NC_CHECK(add_attributes(nc->ncid, nc->timeid, "s", 
 			    "Time since start of simulation", NULL));
+    if (domain->window_speed > 0.0) {
+      NC_CHECK(nc_def_var(nc->ncid, "window_offset", NC_FLOAT,
+			  1, dimids, &nc->windowid));
+      NC_CHECK(add_attributes(nc->ncid, nc->windowid, "m",
+			      "Distance moved along y by the moving window",
+			      "Add to y for the position in the scene of the rows of each frame, including those of epsilon_r and epsilon_i; Sx and Sy are means over the frames at fixed positions in the window"));
+    }
   }
-  NC_CHECK(add_attributes(ncid, epsilon_r_id, "1", 
-			  "Real part of the dielectric constant", NULL));
-  NC_CHECK(add_attributes(ncid, epsilon_i_id, "1", 
+  NC_CHECK(add_attributes(nc->ncid, nc->epsilon_r_id, "1", 
+			  "Real part of the dielectric constant",
+			  epsilon_comment));
+  NC_CHECK(add_attributes(nc->ncid, nc->epsilon_i_id, "1", 
 			  "Imaginary part of the dielectric constant", 
 			  "Note that this field is positive for ordinary materials and the full dielectric constant is given by epsilon_r-i*epsilon_i"));
 
-  NC_CHECK(nc_def_var(ncid, "Sx", NC_FLOAT, 2, &dimids[1], &Sxid));
-  NC_CHECK(add_attributes(ncid, Sxid, "W m-2",
+  NC_CHECK(nc_def_var(nc->ncid, "Sx", NC_FLOAT, 2, &dimids[1], &nc->Sxid));
+  NC_CHECK(add_attributes(nc->ncid, nc->Sxid, "W m-2",
 	  "Mean x-component of Poynting vector for total field", NULL));
-  NC_CHECK(nc_def_var(ncid, "Sy", NC_FLOAT, 2, &dimids[1], &Syid));
-  NC_CHECK(add_attributes(ncid, Syid, "W m-2",
+  NC_CHECK(nc_def_var(nc->ncid, "Sy", NC_FLOAT, 2, &dimids[1], &nc->Syid));
+  NC_CHECK(add_attributes(nc->ncid, nc->Syid, "W m-2",
 	  "Mean y-component of Poynting vector for total field", NULL));
 
   if (domain->mode & MW_MODE_VACUUM) {
-    NC_CHECK(nc_def_var(ncid, "Sx_scat", NC_FLOAT, 2, &dimids[1], 
-			&Sxscatid));
-    NC_CHECK(add_attributes(ncid, Sxscatid, "W m-2",
+    NC_CHECK(nc_def_var(nc->ncid, "Sx_scat", NC_FLOAT, 2, &dimids[1], 
+			&nc->Sxscatid));
+    NC_CHECK(add_attributes(nc->ncid, nc->Sxscatid, "W m-2",
     "Mean x-component of Poynting vector for scattered field", NULL));
-    NC_CHECK(nc_def_var(ncid, "Sy_scat", NC_FLOAT, 2, &dimids[1], 
-			&Syscatid));
-    NC_CHECK(add_attributes(ncid, Syscatid, "W m-2",
+    NC_CHECK(nc_def_var(nc->ncid, "Sy_scat", NC_FLOAT, 2, &dimids[1], 
+			&nc->Syscatid));
+    NC_CHECK(add_attributes(nc->ncid, nc->Syscatid, "W m-2",
     "Mean y-component of Poynting vector for scattered field", NULL));
   }
 
-  if (!nc_skip) {
+  if (!nc->nc_skip) {
     if (domain->mode & MW_MODE_EZ) {
-      NC_CHECK(nc_def_var(ncid, "Ez", NC_FLOAT, 3, dimids, &Ezid));
-      NC_CHECK(add_attributes(ncid, Ezid, "V m-1",
+      NC_CHECK(nc_def_var(nc->ncid, "Ez", NC_FLOAT, 3, dimids, &nc->Ezid));
+      NC_CHECK(add_attributes(nc->ncid, nc->Ezid, "V m-1",
 	      "Z-component of the total electric field", NULL));
     }
     if (domain->mode & MW_MODE_EXY) {
-      NC_CHECK(nc_def_var(ncid, "Bz", NC_FLOAT, 3, dimids, &Bzid));
-      NC_CHECK(add_attributes(ncid, Bzid, "T",
+      NC_CHECK(nc_def_var(nc->ncid, "Bz", NC_FLOAT, 3, dimids, &nc->Bzid));
+      NC_CHECK(add_attributes(nc->ncid, nc->Bzid, "T",
 	      "Z-component of the total magnetic field", NULL));
     }
     if (domain->mode & MW_MODE_EZ && domain->mode & MW_MODE_VACUUM) {
-      NC_CHECK(nc_def_var(ncid, "Ez_scat", NC_FLOAT, 3, dimids, &Ezscatid));
-      NC_CHECK(add_attributes(ncid, Ezscatid, "V m-1",
+      NC_CHECK(nc_def_var(nc->ncid, "Ez_scat", NC_FLOAT, 3, dimids, &nc->Ezscatid));
+      NC_CHECK(add_attributes(nc->ncid, nc->Ezscatid, "V m-1",
 	      "Z-component of the scattered electric field",
 	      "This field is simply the total electric field minus the electric field that would have occurred if the same electromagnetic wave had occurred in a vacuum"));
       
     }
     if (domain->mode & MW_MODE_EXY && domain->mode & MW_MODE_VACUUM) {
-      NC_CHECK(nc_def_var(ncid, "Bz_scat", NC_FLOAT, 3, dimids, &Bzscatid));
-      NC_CHECK(add_attributes(ncid, Bzscatid, "T",
+      NC_CHECK(nc_def_var(nc->ncid, "Bz_scat", NC_FLOAT, 3, dimids, &nc->Bzscatid));
+      NC_CHECK(add_attributes(nc->ncid, nc->Bzscatid, "T",
 	      "Z-component of the scattered magnetic field",
 	      "This field is simply the total magnetic field minus the magnetic field that would have occurred if the same electromagnetic wave had occurred in a vacuum"));
     }
@@ -191,28 +340,44 @@ mw_nc_init(char *filename, mwDomain *domain, int argc, char **argv)
   /* Define some global attributes */
   rc_assign_string(domain->config, "title", &title);
   if (title) {
-    NC_CHECK(nct_add_string_attribute(ncid, NC_GLOBAL, "title", title));
+    NC_CHECK(nct_add_string_attribute(nc->ncid, NC_GLOBAL, "title", title));
     free(title);
   }
 
-  NC_CHECK(nct_add_command_line(ncid, argc, argv));
-  NC_CHECK(nct_add_history(ncid, "Maxwell2D simulation performed", NULL))
+  if (domain->nmembers > 1) {
+    NC_CHECK(nc_put_att_int(nc->ncid, NC_GLOBAL, "ensemble_member",
+			    NC_INT, 1, &domain->member));
+    NC_CHECK(nc_put_att_double(nc->ncid, NC_GLOBAL, "frequency",
+			       NC_DOUBLE, 1, &frequency));
+    amplitude[0] = domain->Ex_amplitude;
+    amplitude[1] = domain->Ey_amplitude;
+    amplitude[2] = domain->Ez_amplitude;
+    NC_CHECK(nc_put_att_double(nc->ncid, NC_GLOBAL, "amplitude",
+			       NC_DOUBLE, 3, amplitude));
+  }
+
+  NC_CHECK(nct_add_command_line(nc->ncid, argc, argv));
+  NC_CHECK(nct_add_history(nc->ncid, "Maxwell2D simulation performed", NULL))
   confstring = rc_sprint(domain->config);
   if (confstring) {
-    NC_CHECK(nc_put_att_text(ncid, NC_GLOBAL, "config",
+    NC_CHECK(nc_put_att_text(nc->ncid, NC_GLOBAL, "config",
 			     strlen(confstring),
 			     confstring));
     free(confstring);
   }
 
   /* End define mode */
-  NC_CHECK(nc_enddef(ncid));
-
-  /* Write the time-independent fields */
-  NC_CHECK(put_field(ncid, epsilon_r_id, domain->epsilon,
-		     domain->nx, domain->ny));
-  NC_CHECK(put_field(ncid, epsilon_i_id, domain->Edamping,
-		     domain->nx, domain->ny));
+  NC_CHECK(nc_enddef(nc->ncid));
+
+  /* Write the coordinates and the time-independent fields */
+  NC_CHECK(put_coordinate(nc->ncid, yid, domain, 1, full_ny));
+  NC_CHECK(put_coordinate(nc->ncid, xid, domain, 0, full_nx));
+  if (!nc->epsilon_i) {
+    NC_CHECK(put_field(nc->ncid, nc->epsilon_r_id, domain, domain->epsilon,
+		       NULL, 0));
+    NC_CHECK(put_field(nc->ncid, nc->epsilon_i_id, domain, domain->Edamping,
+		       NULL, 0));
+  }
   return MW_SUCCESS;
 }
 
@@ -220,33 +385,43 @@ mw_nc_init(char *filename, mwDomain *domain, int argc, char **argv)
 int
 mw_nc_write_frame(mwDomain *domain)
 {
+  ncFile *nc = (ncFile*) domain->output;
   size_t index = domain->iframe;
 
-  if (nc_skip) {
+  if (nc->nc_skip) {
     return MW_SUCCESS;
   }
 
-  NC_CHECK(nc_put_var1_float(ncid, timeid, &index, &domain->time));
+  NC_CHECK(nc_put_var1_double(nc->ncid, nc->timeid, &index, &domain->time));
+  if (domain->window_speed > 0.0) {
+    double offset = domain->window_offset*domain->dx;
+    NC_CHECK(nc_put_var1_double(nc->ncid, nc->windowid, &index, &offset));
+    imaginary_epsilon(domain, nc->epsilon_i);
+    NC_CHECK(put_slice(nc->ncid, nc->epsilon_r_id, domain, domain->epsilon,
+		       0, domain->iframe));
+    NC_CHECK(put_slice(nc->ncid, nc->epsilon_i_id, domain, nc->epsilon_i,
+		       0, domain->iframe));
+  }
 
   if (domain->mode & MW_MODE_EZ) {
-    NC_CHECK(put_slice(ncid, Ezid, domain->Ez,
-		       domain->nx, domain->ny, domain->iframe));
+    NC_CHECK(put_slice(nc->ncid, nc->Ezid, domain, domain->Ez,
+		       mw_parity(domain, 2, 0), domain->iframe));
   }
   if (domain->mode & MW_MODE_EXY) {
-    NC_CHECK(put_slice(ncid, Bzid, domain->Bz,
-		       domain->nx, domain->ny, domain->iframe));
+    NC_CHECK(put_slice(nc->ncid, nc->Bzid, domain, domain->Bz,
+		       mw_parity(domain, 2, 1), domain->iframe));
   }
   if (domain->mode & MW_MODE_EZ && domain->mode & MW_MODE_VACUUM) {
     mw_subtract(domain->nx, domain->ny, domain->Ez, domain->Ez_vacuum,
 		domain->scat_field);
-    NC_CHECK(put_slice(ncid, Ezscatid, domain->scat_field,
-		       domain->nx, domain->ny, domain->iframe));
+    NC_CHECK(put_slice(nc->ncid, nc->Ezscatid, domain, domain->scat_field,
+		       mw_parity(domain, 2, 0), domain->iframe));
   }
   if (domain->mode & MW_MODE_EXY && domain->mode & MW_MODE_VACUUM) {
     mw_subtract(domain->nx, domain->ny, domain->Bz, domain->Bz_vacuum,
 		domain->scat_field);
-    NC_CHECK(put_slice(ncid, Bzscatid, domain->scat_field,
-		       domain->nx, domain->ny, domain->iframe));
+    NC_CHECK(put_slice(nc->ncid, nc->Bzscatid, domain, domain->scat_field,
+		       mw_parity(domain, 2, 1), domain->iframe));
   }
   return MW_SUCCESS;
 }
@@ -255,25 +430,36 @@ mw_nc_write_frame(mwDomain *domain)
 int
 mw_nc_close(mwDomain *domain)
 {
+  ncFile *nc = (ncFile*) domain->output;
+
   /* Currently the Poynting vector contains the sum of the values from
-     each frame, so it needs to be scaled to obtain the mean */
-  mw_scale(domain->nx, domain->ny, domain->Poynting_x, 1.0/domain->iframe);
-  mw_scale(domain->nx, domain->ny, domain->Poynting_y, 1.0/domain->iframe);
-  NC_CHECK(put_field(ncid, Sxid, domain->Poynting_x,
-		     domain->nx, domain->ny));
-  NC_CHECK(put_field(ncid, Syid, domain->Poynting_y,
-		     domain->nx, domain->ny));
+     each frame, so it needs to be scaled to obtain the mean. Its
+     component normal to a plane of symmetry changes sign across it,
+     whatever the kind of plane. */
+  mw_scale_sum(domain->nx, domain->ny, domain->Poynting_x,
+	       1.0/domain->iframe);
+  mw_scale_sum(domain->nx, domain->ny, domain->Poynting_y,
+	       1.0/domain->iframe);
+  NC_CHECK(put_field(nc->ncid, nc->Sxid, domain, NULL, domain->Poynting_x,
+		     MW_ODD_X));
+  NC_CHECK(put_field(nc->ncid, nc->Syid, domain, NULL, domain->Poynting_y,
+		     MW_ODD_Y));
   if (domain->mode & MW_MODE_VACUUM) {
-    mw_scale(domain->nx, domain->ny, domain->Poynting_x_scat,
-	     1.0/domain->iframe);
-    mw_scale(domain->nx, domain->ny, domain->Poynting_y_scat,
-	     1.0/domain->iframe);
-    NC_CHECK(put_field(ncid, Sxscatid, domain->Poynting_x_scat,
-		       domain->nx, domain->ny));
-    NC_CHECK(put_field(ncid, Syscatid, domain->Poynting_y_scat,
-		       domain->nx, domain->ny));
+    mw_scale_sum(domain->nx, domain->ny, domain->Poynting_x_scat,
+		 1.0/domain->iframe);
+    mw_scale_sum(domain->nx, domain->ny, domain->Poynting_y_scat,
+		 1.0/domain->iframe);
+    NC_CHECK(put_field(nc->ncid, nc->Sxscatid, domain, NULL,
+		       domain->Poynting_x_scat, MW_ODD_X));
+    NC_CHECK(put_field(nc->ncid, nc->Syscatid, domain, NULL,
+		       domain->Poynting_y_scat, MW_ODD_Y));
   }
 
-  NC_CHECK(nc_close(ncid));
+  NC_CHECK(nc_close(nc->ncid));
+  if (nc->epsilon_i) {
+    mw_free_field(nc->epsilon_i);
+  }
+  free(nc);
+  domain->output = NULL;
   return MW_SUCCESS;
 }
@@ -0,0 +1,262 @@
+/* mw_periodic.c -- Periodic and Bloch-periodic edges of the domain
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* A grating, or any other structure that repeats along x or y, can
+   be simulated with a single unit cell if the fields leaving one side
+   of the domain re-enter at the other. Across a periodic edge there
+   is no absorbing border, every component is updated right up to the
+   edge, and the stencils read the ghost cells beyond it (see
+   MW_HALO), which are set here to copies of the opposite edge as soon
+   as each row has been updated. The period is the width of the
+   domain, so in a domain nx pixels across column -1 is a copy of
+   column nx-1, and column nx of column 0.
+
+   A plane wave arriving at an angle is not periodic, but its complex
+   amplitude is "Bloch-periodic", repeating with a phase delay phi
+   across each period: F(x+L) = F(x) exp(i phi). The real and
+   imaginary parts of such a field are simulated as a pair of domains,
+   the "bloch_partner" of each member of an ensemble (see
+   mw_ensemble.c) holding the imaginary part, and the ghost cells of
+   each combine the opposite edges of both:
+
+     real part:       R(x+L) = cos(phi) R(x) - sin(phi) I(x)
+     imaginary part:  I(x+L) = cos(phi) I(x) + sin(phi) R(x)
+
+   The complex weight of each oscillator is multiplied by exp(i theta),
+   where theta rises by phi across each period, so that the sources
+   are Bloch-periodic too. The equations are linear with real
+   coefficients, so the real part is exactly the field in the infinite
+   structure with the oscillators of the scene in every cell, each
+   delayed by phi from the last, and it is the real part that is
+   written out. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "maxwell.h"
+
+/* The kinds of field that are wrapped together */
+#define WRAP_TM_E 0
+#define WRAP_TM_B 1
+#define WRAP_TE_E 2
+#define WRAP_TE_B 3
+
+/* Store the main and vacuum fields of the specified kind in
+   "fields", and return how many there are */
+static
+int
+wrap_fields(mwDomain *domain, int kind, real ***fields)
+{
+  int vacuum = (domain->mode & MW_MODE_VACUUM);
+  int n = 0;
+  switch (kind) {
+  case WRAP_TM_E:
+    fields[n++] = domain->Ez;
+    if (vacuum) {
+      fields[n++] = domain->Ez_vacuum;
+    }
+    break;
+  case WRAP_TM_B:
+    fields[n++] = domain->Bx;
+    fields[n++] = domain->By;
+    if (vacuum) {
+      fields[n++] = domain->Bx_vacuum;
+      fields[n++] = domain->By_vacuum;
+    }
+    break;
+  case WRAP_TE_E:
+    fields[n++] = domain->Ex;
+    fields[n++] = domain->Ey;
+    if (vacuum) {
+      fields[n++] = domain->Ex_vacuum;
+      fields[n++] = domain->Ey_vacuum;
+    }
+    break;
+  default:
+    fields[n++] = domain->Bz;
+    if (vacuum) {
+      fields[n++] = domain->Bz_vacuum;
+    }
+  }
+  return n;
+}
+
+/* Set the ghost columns of row j of "field" from the columns at the
+   opposite edge. If "partner" is not NULL it is the other part of a
+   Bloch-periodic field, whose phase delay across the period is
+   "phase", and "sign" is -1 if "field" is the real part and 1 if it
+   is the imaginary part. */
+static
+void
+wrap_columns(real **field, real **partner, int nx, int j,
+	     real phase, int sign)
+{
+  real *row = field[j];
+  int k;
+  if (!partner) {
+    for (k = 1; k <= MW_HALO; k++) {
+      row[-k] = row[nx-k];
+      row[nx-1+k] = row[k-1];
+    }
+  }
+  else {
+    real c = cos(phase), s = sign*sin(phase);
+    for (k = 1; k <= MW_HALO; k++) {
+      row[-k] = c*row[nx-k] - s*partner[j][nx-k];
+      row[nx-1+k] = c*row[k-1] + s*partner[j][k-1];
+    }
+  }
+}
+
+/* As wrap_columns, but copy row j of "field", including its ghost
+   columns, to the ghost row beyond the opposite edge, if it is within
+   MW_HALO rows of an edge of a domain ny pixels high */
+static
+void
+wrap_rows(real **field, real **partner, int nx, int ny, int j,
+	  real phase, int sign)
+{
+  real c = 1.0, s = 0.0;
+  int i;
+  if (partner) {
+    c = cos(phase);
+    s = sign*sin(phase);
+  }
+  if (j < MW_HALO) {
+    real *ghost = field[ny+j];
+    for (i = -MW_HALO; i < nx+MW_HALO; i++) {
+      ghost[i] = partner ? c*field[j][i] + s*partner[j][i] : field[j][i];
+    }
+  }
+  if (j >= ny-MW_HALO) {
+    real *ghost = field[j-ny];
+    for (i = -MW_HALO; i < nx+MW_HALO; i++) {
+      ghost[i] = partner ? c*field[j][i] - s*partner[j][i] : field[j][i];
+    }
+  }
+}
+
+/* Set the ghost cells beyond the periodic edges from row j of the
+   fields of the specified kind, in each of the nmembers domains in
+   "members". If they have Bloch partners then these must be among
+   the members, and row j must have been updated in all of them. The
+   columns are wrapped before the rows so that the corners of the
+   ghost rows are set too. */
+static
+void
+wrap(mwDomain *members, int nmembers, int kind, int j)
+{
+  real **fields[4], **partners[4];
+  int m, l, n;
+  if (!members->periodic || j < 0 || j >= members->ny) {
+    return;
+  }
+  if (members->periodic & MW_PERIODIC_X) {
+    for (m = 0; m < nmembers; m++) {
+      mwDomain *domain = members+m;
+      mwDomain *partner = (mwDomain*) domain->bloch_partner;
+      int sign = domain->bloch_quadrature ? 1 : -1;
+      n = wrap_fields(domain, kind, fields);
+      if (partner) {
+	wrap_fields(partner, kind, partners);
+      }
+      for (l = 0; l < n; l++) {
+	wrap_columns(fields[l], partner ? partners[l] : NULL,
+		     domain->nx, j, domain->bloch_phase_x, sign);
+      }
+    }
+  }
+  if (members->periodic & MW_PERIODIC_Y) {
+    for (m = 0; m < nmembers; m++) {
+      mwDomain *domain = members+m;
+      mwDomain *partner = (mwDomain*) domain->bloch_partner;
+      int sign = domain->bloch_quadrature ? 1 : -1;
+      n = wrap_fields(domain, kind, fields);
+      if (partner) {
+	wrap_fields(partner, kind, partners);
+      }
+      for (l = 0; l < n; l++) {
+	wrap_rows(fields[l], partner ? partners[l] : NULL,
+		  domain->nx, domain->ny, j, domain->bloch_phase_y, sign);
+      }
+    }
+  }
+}
+
+/* Wrap row j of Ez */
+void
+mw_wrap_tm_E(mwDomain *members, int nmembers, int j)
+{
+  wrap(members, nmembers, WRAP_TM_E, j);
+}
+
+/* Wrap row j of Bx and By */
+void
+mw_wrap_tm_B(mwDomain *members, int nmembers, int j)
+{
+  wrap(members, nmembers, WRAP_TM_B, j);
+}
+
+/* Wrap row j of Ex and Ey */
+void
+mw_wrap_te_E(mwDomain *members, int nmembers, int j)
+{
+  wrap(members, nmembers, WRAP_TE_E, j);
+}
+
+/* Wrap row j of Bz */
+void
+mw_wrap_te_B(mwDomain *members, int nmembers, int j)
+{
+  wrap(members, nmembers, WRAP_TE_B, j);
+}
+
+/* Multiply the complex weight I+iQ of each oscillator of "domain" by
+   exp(i theta), where theta is bloch_phase_x*i/nx +
+   bloch_phase_y*j/ny at pixel (i,j), and return in "sources" a newly
+   allocated list of the oscillators of its Bloch partner, whose
+   weights are these multiplied by -i so that the partner is forced
+   by the imaginary part of the complex forcing. "sources" should be
+   freed with free(). */
+int
+mw_split_bloch_sources(mwDomain *domain, mwSource **sources)
+{
+  int k;
+  /* Allocate at least one to avoid a zero-sized allocation */
+  *sources = (mwSource*) malloc(sizeof(mwSource)*(domain->nsources+1));
+  if (!*sources) {
+    fprintf(stderr, "Error allocating the oscillators of the Bloch partner\n");
+    return MW_FAILURE;
+  }
+  for (k = 0; k < domain->nsources; k++) {
+    mwSource *source = domain->sources+k;
+    int i = source->index % domain->nx;
+    int j = source->index / domain->nx;
+    real theta = domain->bloch_phase_x*i/domain->nx
+      + domain->bloch_phase_y*j/domain->ny;
+    real I = source->I*cos(theta) - source->Q*sin(theta);
+    real Q = source->I*sin(theta) + source->Q*cos(theta);
+    source->I = I;
+    source->Q = Q;
+    (*sources)[k].index = source->index;
+    (*sources)[k].I = Q;
+    (*sources)[k].Q = -I;
+  }
+  return MW_SUCCESS;
+}
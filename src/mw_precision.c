@@ -0,0 +1,85 @@
+/* mw_precision.c -- Read the configuration and choose the precision
+   in which to run the simulation
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* This file does not depend on "real" and is compiled only once */
+
+#include <stdlib.h>
+#include <strings.h>
+#include "maxwell.h"
+#include "readconfig.h"
+
+/* Read the configuration from the command-line arguments and any
+   config files on standard input, returning NULL on error */
+rc_data *
+mw_read_config(int argc, char **argv)
+{
+  rc_data *config;
+
+  /* Find the first config file on the command line. */
+  int ifile = rc_get_file(argc, argv);
+
+  if (!ifile) {
+    /* No file given - assume command-line arguments contain all the
+       information. */
+    config = rc_read(NULL, stderr);
+  }
+  else {
+    /* Read configuration information from the file. */
+    config = rc_read(argv[ifile], stderr);
+  }
+  if (!config) {
+    fprintf(stderr, "Error initializing configuration information\n");
+    return NULL;
+  }
+  
+  /* Supplement configuration information with command-line
+     arguments. */
+  rc_register_args(config, argc, argv);
+  return config;
+}
+
+/* Set *precision to MW_PRECISION_FLOAT, MW_PRECISION_DOUBLE or
+   MW_PRECISION_BF16 according to the "precision" config variable,
+   which defaults to "float". Double precision halves the speed of
+   this memory-bound simulation, but is worthwhile for long runs with
+   little damping, in which the rounding errors of single precision
+   accumulate. With "bf16" the fields are stored in bfloat16 with
+   single-precision arithmetic (see mw_bf16.c). */
+int
+mw_get_precision(rc_data *config, int *precision)
+{
+  char *name = NULL;
+  *precision = MW_PRECISION_FLOAT;
+  if (rc_assign_string(config, "precision", &name)) {
+    if (strcasecmp(name, "double") == 0) {
+      *precision = MW_PRECISION_DOUBLE;
+    }
+    else if (strcasecmp(name, "bf16") == 0) {
+      *precision = MW_PRECISION_BF16;
+    }
+    else if (strcasecmp(name, "float") != 0) {
+      fprintf(stderr, "Config variable \"precision\" must be \"float\", \"double\" or \"bf16\"\n");
+      free(name);
+      return MW_FAILURE;
+    }
+    free(name);
+  }
+  return MW_SUCCESS;
+}
@@ -21,22 +21,59 @@
 #include <math.h>
 #include "maxwell.h"
 
-/* Reset the magnetic-field damping with an absorbing border */
+/* Add susceptibility xir+i*xii to pixel (i,j), or if "conductor" is
+   true make it a perfect electric conductor, unless the pixel is below
+   the rows to which the shapes are being added */
+static
+int
+add_pixel(mwDomain *domain, int i, int j, real xir, real xii, int conductor)
+{
+  if (j < domain->shape_j0) {
+    return MW_SUCCESS;
+  }
+  if (conductor) {
+    return mw_set_conductor(domain, i, j);
+  }
+  domain->epsilon[j][i] += xir;
+  domain->Edamping[j][i] += xii;
+  return MW_SUCCESS;
+}
+
+/* Reset the magnetic-field damping with an absorbing border, except
+   along periodic edges and planes of symmetry; mw_step assumes that
+   Bdamping is 1 inside the border */
 int
 mw_reset_damping(mwDomain *domain, int borderwidth)
 {
+  int periodic_x = (domain->periodic & MW_PERIODIC_X);
+  int periodic_y = (domain->periodic & MW_PERIODIC_Y);
+  int left = !periodic_x && !domain->symmetry_x;
+  int bottom = !periodic_y && !domain->symmetry_y;
   int i, k;
+  domain->borderwidth = borderwidth;
   mw_reset_field(domain->Bdamping, domain->nx, domain->ny, 1.0);
   for (k = 0; k < borderwidth; k++) {
-    for (i = k; i < domain->nx-k; i++) {
-      domain->Bdamping[k][i] = domain->Bdamping[domain->ny-1-k][i]
-	//	= (k+1.0)/(borderwidth+1);
-	= sqrt((k+1.0)/(borderwidth+1));
+    if (!periodic_y) {
+      for (i = left ? k : 0;
+	   i < (periodic_x ? domain->nx : domain->nx-k); i++) {
+	if (bottom) {
+	  domain->Bdamping[k][i] = sqrt((k+1.0)/(borderwidth+1));
+	}
+	domain->Bdamping[domain->ny-1-k][i]
+	  //	= (k+1.0)/(borderwidth+1);
+	  = sqrt((k+1.0)/(borderwidth+1));
+      }
     }
-    for (i = k; i < domain->ny-k; i++) {
-      domain->Bdamping[i][k] = domain->Bdamping[i][domain->nx-1-k]
-	//	= (k+1.0)/(borderwidth+1);
-	= sqrt((k+1.0)/(borderwidth+1));
+    if (!periodic_x) {
+      for (i = bottom ? k : 0;
+	   i < (periodic_y ? domain->ny : domain->ny-k); i++) {
+	if (left) {
+	  domain->Bdamping[i][k] = sqrt((k+1.0)/(borderwidth+1));
+	}
+	domain->Bdamping[i][domain->nx-1-k]
+	  //	= (k+1.0)/(borderwidth+1);
+	  = sqrt((k+1.0)/(borderwidth+1));
+      }
     }
   }
   return MW_SUCCESS;
@@ -50,16 +87,18 @@ int
 mw_add_circle(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 4) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real radius = var[2]/domain->dx;
-    int minx = x0-radius;
-    int maxx = x0+radius+1;
-    int miny = y0-radius;
-    int maxy = y0+radius+1;
+    int minx = mw_mesh_index(domain, 0, x0-radius);
+    int maxx = mw_mesh_index(domain, 0, x0+radius+1);
+    int miny = mw_mesh_index(domain, 1, y0-radius);
+    int maxy = mw_mesh_index(domain, 1, y0+radius+1);
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
     int i, j;
     real radius2 = radius*radius;
     real xir, xii;
+    int conductor = MW_IS_CONDUCTOR(var[3]);
     mw_susceptibility(var[3], var[4], &xir, &xii);
     if (minx < 0) {
       minx = 0;
@@ -75,10 +114,9 @@ mw_add_circle(mwDomain *domain, int nvar, real *var)
     }
     for (j = miny; j <= maxy; j++) {
       for (i = minx; i <= maxx; i++) {
-	if ((x0-i)*(x0-i) + (y0-j)*(y0-j)
+	if ((x0-X[i])*(x0-X[i]) + (y0-Y[j])*(y0-Y[j])
 	    < radius2) {
-	  domain->epsilon[j][i] += xir;
-	  domain->Edamping[j][i] += xii;
+	  MW_CHECK(add_pixel(domain, i, j, xir, xii, conductor));
 	}
       }
     }
@@ -98,20 +136,21 @@ int
 mw_add_edge(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 4) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real angle = var[2]*M_PI/180.0;
     real cos_angle = cos(angle);
     real sin_angle = sin(angle);
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
     int i, j;
     real xir, xii;
+    int conductor = MW_IS_CONDUCTOR(var[3]);
     mw_susceptibility(var[3], var[4], &xir, &xii);
     //    fprintf(stderr, "%g %g %g %g\n", var[3], var[4], xir, xii);
-    for (j = 0; j < domain->ny; j++) {
+    for (j = domain->shape_j0; j < domain->ny; j++) {
       for (i = 0; i < domain->nx; i++) {
-	if ((i-x0)*sin_angle+(j-y0)*cos_angle > 0.0) {
-	  domain->epsilon[j][i] += xir;
-	  domain->Edamping[j][i] += xii;
+	if ((X[i]-x0)*sin_angle+(Y[j]-y0)*cos_angle > 0.0) {
+	  MW_CHECK(add_pixel(domain, i, j, xir, xii, conductor));
 	}
       }
     }
@@ -130,17 +169,18 @@ int
 mw_add_gradient(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 5) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real angle = var[2]*M_PI/180.0;
     real cos_angle = cos(angle);
     real sin_angle = sin(angle);
     real xfactor = domain->dx/var[5];
     real dist;
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
     int i, j;
-    for (j = 0; j < domain->ny; j++) {
+    for (j = domain->shape_j0; j < domain->ny; j++) {
       for (i = 0; i < domain->nx; i++) {
-	dist = (i-x0)*sin_angle+(j-y0)*cos_angle;
+	dist = (X[i]-x0)*sin_angle+(Y[j]-y0)*cos_angle;
 	domain->epsilon[j][i]
 	  += var[3] + var[4]/(1.0+exp(-dist*xfactor));
       }
@@ -160,18 +200,19 @@ int
 mw_add_ripple(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 5) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real angle = var[2]*M_PI/180.0;
     real cos_angle = cos(angle);
     real sin_angle = sin(angle);
     real xfactor = domain->dx/var[5];
     real wavenumber = 2.0*M_PI*domain->dx/var[4];
     real dist;
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
     int i, j;
-    for (j = 0; j < domain->ny; j++) {
+    for (j = domain->shape_j0; j < domain->ny; j++) {
       for (i = 0; i < domain->nx; i++) {
-	dist = (i-x0)*sin_angle+(j-y0)*cos_angle;
+	dist = (X[i]-x0)*sin_angle+(Y[j]-y0)*cos_angle;
 	domain->epsilon[j][i]
 	  += var[3]*sin(wavenumber*dist)
 	  *exp(-pow(xfactor*dist, 4.0));
@@ -193,24 +234,25 @@ int
 mw_add_rotated_rectangle(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 6) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real angle = var[2]*M_PI/180.0;
     real halfwidth1 = 0.5*var[3]/domain->dx;
     real halfwidth2 = 0.5*var[4]/domain->dx;
     real cos_angle = cos(angle);
     real sin_angle = sin(angle);
     real dist1, dist2;
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
     real xir, xii;
+    int conductor = MW_IS_CONDUCTOR(var[5]);
     int i, j;
     mw_susceptibility(var[5], var[6], &xir, &xii);
-    for (j = 0; j < domain->ny; j++) {
+    for (j = domain->shape_j0; j < domain->ny; j++) {
       for (i = 0; i < domain->nx; i++) {
-	dist1 = (i-x0)*sin_angle+(j-y0)*cos_angle;
-	dist2 = (i-x0)*cos_angle-(j-y0)*sin_angle;
+	dist1 = (X[i]-x0)*sin_angle+(Y[j]-y0)*cos_angle;
+	dist2 = (X[i]-x0)*cos_angle-(Y[j]-y0)*sin_angle;
 	if (fabs(dist1) <= halfwidth1 && fabs(dist2) <= halfwidth2) {
-	  domain->epsilon[j][i] += xir;
-	  domain->Edamping[j][i] += xii;
+	  MW_CHECK(add_pixel(domain, i, j, xir, xii, conductor));
 	}
       }
     }
@@ -231,8 +273,8 @@ int
 mw_add_wave_packet(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 6) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real angle = var[2]*M_PI/180.0;
     real halfwidth1 = 0.5*var[3]/domain->dx;
     real halfwidth2 = 0.5*var[4]/domain->dx;
@@ -240,13 +282,14 @@ mw_add_wave_packet(mwDomain *domain, int nvar, real *var)
     real cos_angle = cos(angle);
     real sin_angle = sin(angle);
     real dist1, dist2;
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
     real xir, xii;
     int i, j;
     mw_susceptibility(var[6], var[7], &xir, &xii);
-    for (j = 0; j < domain->ny; j++) {
+    for (j = domain->shape_j0; j < domain->ny; j++) {
       for (i = 0; i < domain->nx; i++) {
-	dist1 = (i-x0)*sin_angle+(j-y0)*cos_angle;
-	dist2 = (i-x0)*cos_angle-(j-y0)*sin_angle;
+	dist1 = (X[i]-x0)*sin_angle+(Y[j]-y0)*cos_angle;
+	dist2 = (X[i]-x0)*cos_angle-(Y[j]-y0)*sin_angle;
 	if (fabs(dist1) <= halfwidth1 && fabs(dist2) <= halfwidth2) {
 	  real tmp = sin(M_PI*(halfwidth1-dist1)/wavelength);
 	  real amplitude = tmp*tmp;
@@ -270,25 +313,25 @@ int
 mw_add_dish(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 7) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real dist = var[2]/domain->dx;
     real radius1 = var[3]/domain->dx;
     real radius2 = var[4]/domain->dx;
     real thickness = var[5]/domain->dx;
     real xir, xii;
+    int conductor = MW_IS_CONDUCTOR(var[6]);
+    const real *X = domain->mesh_x;
+    int i0 = mw_mesh_index(domain, 0, x0-radius1);
     int i, j;
     mw_susceptibility(var[6], var[7], &xir, &xii);
-    for (i = x0-radius1; i <= x0+radius2; i++) {
-      int k;
-      if (i < 0 || i >= domain->nx) {
-	continue;
-      }
-      k = y0 + (0.25*(i-x0)*(i-x0)/dist - dist);
-      for (j = k; j > k-thickness; j--) {
+    for (i = i0 > 0 ? i0 : 0; i < domain->nx && X[i] <= x0+radius2; i++) {
+      int k = mw_mesh_index(domain, 1,
+			    y0 + (0.25*(X[i]-x0)*(X[i]-x0)/dist - dist));
+      real bottom = mw_mesh_position(domain, 1, k)-thickness;
+      for (j = k; mw_mesh_position(domain, 1, j) > bottom; j--) {
 	if (j >= 0 && j < domain->ny) {
-	  domain->epsilon[j][i] += xir;
-	  domain->Edamping[j][i] += xii;
+	  MW_CHECK(add_pixel(domain, i, j, xir, xii, conductor));
 	}
       }
     }
@@ -306,22 +349,20 @@ int
 mw_add_rectangle(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 5) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
-    real x1 = var[2]/domain->dx + domain->nx/2.0;
-    real y1 = var[3]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
+    real x1 = var[2]/domain->dx + domain->origin_x;
+    real y1 = var[3]/domain->dx + domain->origin_y;
     real xir, xii;
+    int conductor = MW_IS_CONDUCTOR(var[4]);
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
+    int i0 = mw_mesh_index(domain, 0, x0);
+    int j0 = mw_mesh_index(domain, 1, y0);
     int i, j;
     mw_susceptibility(var[4], var[5], &xir, &xii);
-    for (i = x0; i <= x1; i++) {
-      if (i < 0 || i >= domain->nx) {
-	continue;
-      }
-      for (j = y0; j <= y1; j++) {
-	if (j >= 0 && j < domain->ny) {
-	  domain->epsilon[j][i] += xir;
-	  domain->Edamping[j][i] += xii;
-	}
+    for (i = i0 > 0 ? i0 : 0; i < domain->nx && X[i] <= x1; i++) {
+      for (j = j0 > 0 ? j0 : 0; j < domain->ny && Y[j] <= y1; j++) {
+	MW_CHECK(add_pixel(domain, i, j, xir, xii, conductor));
       }
     }
     nvar -= 6;
@@ -338,24 +379,22 @@ int
 mw_add_lens(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 5) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
     real radcurv = var[2]/domain->dx;
     real radius = var[3]/domain->dx;
     real xir, xii;
+    int conductor = MW_IS_CONDUCTOR(var[4]);
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
+    int i0 = mw_mesh_index(domain, 0, x0-radius);
     int i, j;
     mw_susceptibility(var[4], var[5], &xir, &xii);
-    for (i = x0-radius; i <= x0+radius; i++) {
+    for (i = i0 > 0 ? i0 : 0; i < domain->nx && X[i] <= x0+radius; i++) {
       int thickness = 2+radcurv - sqrt(radcurv*radcurv
-				     -radius*radius+(i-x0)*(i-x0));
-      if (i < 0 || i >= domain->nx) {
-	continue;
-      }
-      for (j = y0-thickness; j < y0; j++) {
-	if (j >= 0 && j < domain->ny) {
-	  domain->epsilon[j][i] += xir;
-	  domain->Edamping[j][i] += xii;
-	}
+				     -radius*radius+(X[i]-x0)*(X[i]-x0));
+      int j0 = mw_mesh_index(domain, 1, y0-thickness);
+      for (j = j0 > 0 ? j0 : 0; j < domain->ny && Y[j] < y0; j++) {
+	MW_CHECK(add_pixel(domain, i, j, xir, xii, conductor));
       }
     }
     nvar -= 6;
@@ -374,28 +413,26 @@ int
 mw_add_cavity(mwDomain *domain, int nvar, real *var)
 {
   while (nvar > 8) {
-    real x0 = var[0]/domain->dx + domain->nx/2.0;
-    real y0 = var[1]/domain->dx + domain->ny/2.0;
-    real x1 = var[2]/domain->dx + domain->nx/2.0;
-    real y1 = var[3]/domain->dx + domain->ny/2.0;
-    real xc = var[4]/domain->dx + domain->nx/2.0;
-    real yc = var[5]/domain->dx + domain->ny/2.0;
+    real x0 = var[0]/domain->dx + domain->origin_x;
+    real y0 = var[1]/domain->dx + domain->origin_y;
+    real x1 = var[2]/domain->dx + domain->origin_x;
+    real y1 = var[3]/domain->dx + domain->origin_y;
+    real xc = var[4]/domain->dx + domain->origin_x;
+    real yc = var[5]/domain->dx + domain->origin_y;
     real radius = var[6]/domain->dx;
     real radius2 = radius*radius;
     real xir, xii;
+    int conductor = MW_IS_CONDUCTOR(var[7]);
+    const real *X = domain->mesh_x, *Y = domain->mesh_y;
+    int i0 = mw_mesh_index(domain, 0, x0);
+    int j0 = mw_mesh_index(domain, 1, y0);
     int i, j;
     mw_susceptibility(var[7], var[8], &xir, &xii);
-    for (i = x0; i <= x1; i++) {
-      if (i < 0 || i >= domain->nx) {
-	continue;
-      }
-      for (j = y0; j <= y1; j++) {
-	if (j >= 0 && j < domain->ny) {
-	  if ((xc-i)*(xc-i) + (yc-j)*(yc-j)
-	      > radius2) {
-	    domain->epsilon[j][i] += xir;
-	    domain->Edamping[j][i] += xii;
-	  }
+    for (i = i0 > 0 ? i0 : 0; i < domain->nx && X[i] <= x1; i++) {
+      for (j = j0 > 0 ? j0 : 0; j < domain->ny && Y[j] <= y1; j++) {
+	if ((xc-X[i])*(xc-X[i]) + (yc-Y[j])*(yc-Y[j])
+	    > radius2) {
+	  MW_CHECK(add_pixel(domain, i, j, xir, xii, conductor));
 	}
       }
     }
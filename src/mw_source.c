@@ -0,0 +1,237 @@
+/* mw_source.c -- Oscillators at individual pixels
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "maxwell.h"
+#include "mw_bf16.h"
+
+/* The oscillators occupy at most a few thousand pixels, so rather
+   than storing their weights in fields the size of the domain they
+   are stored as a list sorted by pixel index, and added to the
+   electric field by a separate pass after each row is updated. */
+
+/* Return the position of the first source in the list whose index is
+   greater than or equal to "index" */
+static
+int
+find_source(mwDomain *domain, int index)
+{
+  int lo = 0, hi = domain->nsources;
+  while (lo < hi) {
+    int mid = (lo+hi)/2;
+    if (domain->sources[mid].index < index) {
+      lo = mid+1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* Set the in-phase and quadrature weights of the oscillator at pixel
+   (i,j), replacing any that is already there, and add the pixel to
+   the active region */
+int
+mw_set_source(mwDomain *domain, int i, int j, real I, real Q)
+{
+  int index = j*domain->nx + i;
+  int k = find_source(domain, index);
+  if (i < domain->active_i0) {
+    domain->active_i0 = i;
+  }
+  if (i+1 > domain->active_i1) {
+    domain->active_i1 = i+1;
+  }
+  if (j < domain->active_j0) {
+    domain->active_j0 = j;
+  }
+  if (j+1 > domain->active_j1) {
+    domain->active_j1 = j+1;
+  }
+  if (k < domain->nsources && domain->sources[k].index == index) {
+    domain->sources[k].I = I;
+    domain->sources[k].Q = Q;
+    return MW_SUCCESS;
+  }
+  if (domain->nsources >= domain->max_sources) {
+    int max_sources = domain->max_sources ? 2*domain->max_sources : 64;
+    mwSource *sources = (mwSource*) realloc(domain->sources,
+					    sizeof(mwSource)*max_sources);
+    if (!sources) {
+      fprintf(stderr, "Error allocating the list of oscillators\n");
+      return MW_FAILURE;
+    }
+    domain->sources = sources;
+    domain->max_sources = max_sources;
+  }
+  memmove(domain->sources+k+1, domain->sources+k,
+	  sizeof(mwSource)*(domain->nsources-k));
+  domain->sources[k].index = index;
+  domain->sources[k].I = I;
+  domain->sources[k].Q = Q;
+  domain->nsources++;
+  return MW_SUCCESS;
+}
+
+/* Add the forcing by the oscillators in row j between columns i0 and
+   i1-1 to the electric field component E, where fI and fQ are the
+   in-phase and quadrature forcing amplitudes multiplied by the
+   timestep */
+void
+mw_apply_sources(mwDomain *domain, real **E, int j, int i0, int i1,
+		 real fI, real fQ)
+{
+  int row = j*domain->nx;
+  int k;
+  if (domain->nsources == 0 || (fI == 0.0 && fQ == 0.0)) {
+    return;
+  }
+  for (k = find_source(domain, row+i0);
+       k < domain->nsources && domain->sources[k].index < row+i1; k++) {
+    E[j][domain->sources[k].index-row]
+      += fI*domain->sources[k].I - fQ*domain->sources[k].Q;
+  }
+}
+
+/* As mw_apply_sources, but for a component stored in bfloat16 (see
+   mw_bf16.c), which is rounded again once the forcing is added */
+void
+mw_apply_sources_bf16(mwDomain *domain, mwBf16 **E, int j, int i0, int i1,
+		      real fI, real fQ)
+{
+  int row = j*domain->nx;
+  int k;
+  if (domain->nsources == 0 || (fI == 0.0 && fQ == 0.0)) {
+    return;
+  }
+  for (k = find_source(domain, row+i0);
+       k < domain->nsources && domain->sources[k].index < row+i1; k++) {
+    mwBf16 *e = E[j] + domain->sources[k].index-row;
+    *e = mw_to_bf16(mw_from_bf16(*e)
+		    + fI*domain->sources[k].I - fQ*domain->sources[k].Q);
+  }
+}
+
+/* The fields start at zero and can only become non-zero at the
+   oscillators, and then spread by at most one pixel in each direction
+   for each update of E or B (two with the fourth-order stencil). The
+   "active region" is a rectangle outside which the fields are known
+   to still be exactly zero, so the row functions in mw_step.c need
+   not update it. Enlarge it by the distance the fields can spread in
+   nsteps timesteps. */
+void
+mw_grow_active(mwDomain *domain, int nsteps)
+{
+  int margin = (domain->kernels4 ? 4 : 2)*nsteps;
+  if (domain->active_i0 >= domain->active_i1) {
+    return;
+  }
+  domain->active_i0 -= margin;
+  if (domain->active_i0 < 0) {
+    domain->active_i0 = 0;
+  }
+  domain->active_i1 += margin;
+  if (domain->active_i1 > domain->nx) {
+    domain->active_i1 = domain->nx;
+  }
+  domain->active_j0 -= margin;
+  if (domain->active_j0 < 0) {
+    domain->active_j0 = 0;
+  }
+  domain->active_j1 += margin;
+  if (domain->active_j1 > domain->ny) {
+    domain->active_j1 = domain->ny;
+  }
+}
+
+/* Move the oscillators and the active region nrows down with the
+   fields (see mw_window.c), removing the oscillators that leave the
+   bottom of the domain */
+int
+mw_shift_sources(mwDomain *domain, int nrows)
+{
+  int shift = nrows*domain->nx;
+  int k = find_source(domain, shift);
+  int n;
+  if (k > 0) {
+    memmove(domain->sources, domain->sources+k,
+	    sizeof(mwSource)*(domain->nsources-k));
+    domain->nsources -= k;
+  }
+  for (n = 0; n < domain->nsources; n++) {
+    domain->sources[n].index -= shift;
+  }
+  if (domain->active_i0 < domain->active_i1) {
+    domain->active_j0 -= nrows;
+    domain->active_j1 -= nrows;
+    if (domain->active_j0 < 0) {
+      domain->active_j0 = 0;
+    }
+    if (domain->active_j1 < domain->active_j0) {
+      domain->active_j1 = domain->active_j0;
+    }
+  }
+  return MW_SUCCESS;
+}
+
+/* Give "band", a copy of a domain holding only its rows j0 to
+   j0+band->ny-1 (see mw_mpi.c), its own list of the oscillators in
+   those rows, and move its active region with them. The active
+   region may then extend beyond the band, or lie entirely outside
+   it, in which case it still grows towards the band as the fields
+   spread from the oscillators of the other bands. */
+int
+mw_crop_sources(mwDomain *band, int j0)
+{
+  int shift = j0*band->nx;
+  int k0 = find_source(band, shift);
+  int k1 = find_source(band, shift + band->ny*band->nx);
+  mwSource *sources = NULL;
+  int k;
+  if (k1 > k0) {
+    sources = (mwSource*) malloc(sizeof(mwSource)*(k1-k0));
+    if (!sources) {
+      fprintf(stderr, "Error allocating the list of oscillators\n");
+      return MW_FAILURE;
+    }
+    for (k = k0; k < k1; k++) {
+      sources[k-k0] = band->sources[k];
+      sources[k-k0].index -= shift;
+    }
+  }
+  band->sources = sources;
+  band->nsources = band->max_sources = k1-k0;
+  band->active_j0 -= j0;
+  band->active_j1 -= j0;
+  return MW_SUCCESS;
+}
+
+/* Remove all the oscillators */
+int
+mw_free_sources(mwDomain *domain)
+{
+  if (domain->sources) {
+    free(domain->sources);
+  }
+  domain->sources = NULL;
+  domain->nsources = domain->max_sources = 0;
+  return MW_SUCCESS;
+}
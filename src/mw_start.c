@@ -19,26 +19,175 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <math.h>
 #include "maxwell.h"
 #include "readconfig.h"
 
-/* Initialize the domain for the simulation based on the command-line
-   arguments and any config files on standard input */
+/* The config file is read in single precision, so in double
+   precision the values are converted */
+static
 int
-mw_start(int argc, char **argv, mwDomain *domain)
+assign_real(rc_data *config, char *param, real *value)
+{
+  rc_real rc_value;
+  if (rc_assign_real(config, param, &rc_value)) {
+    *value = rc_value;
+    return 1;
+  }
+  return 0;
+}
+
+/* As rc_get_real_vector but returning a vector of "real", which
+   should be freed with free() */
+static
+real *
+get_real_vector(rc_data *config, char *param, int *length)
+{
+  rc_real *rc_vector = rc_get_real_vector(config, param, length);
+  real *vector;
+  int k;
+  if (!rc_vector || sizeof(real) == sizeof(rc_real)) {
+    return (real*) rc_vector;
+  }
+  vector = (real*) malloc(sizeof(real)*(*length));
+  if (vector) {
+    for (k = 0; k < *length; k++) {
+      vector[k] = rc_vector[k];
+    }
+  }
+  free(rc_vector);
+  return vector;
+}
+
+/* Read the kind of plane of symmetry (see mw_symmetry.c) named by
+   config variable "param", which may be "none", "pec" or "pmc", into
+   "symmetry" */
+static
+int
+get_symmetry(rc_data *config, char *param, int *symmetry)
+{
+  char *value = NULL;
+  int status = MW_SUCCESS;
+  *symmetry = MW_SYMMETRY_NONE;
+  rc_assign_string(config, param, &value);
+  if (value) {
+    if (strcasecmp(value, "pec") == 0) {
+      *symmetry = MW_SYMMETRY_PEC;
+    }
+    else if (strcasecmp(value, "pmc") == 0) {
+      *symmetry = MW_SYMMETRY_PMC;
+    }
+    else if (strcasecmp(value, "none") != 0) {
+      fprintf(stderr, "Config variable \"%s\" must be \"none\", \"pec\" or \"pmc\"\n",
+	      param);
+      status = MW_FAILURE;
+    }
+    free(value);
+  }
+  return status;
+}
+
+/* Add the shapes listed in "config" to "domain" */
+int
+mw_add_shapes(rc_data *config, mwDomain *domain)
+{
+  real *var;
+  int n_var;
+
+  if ((var = get_real_vector(config, "circle",
+				   &n_var)) && n_var > 3) {
+    mw_add_circle(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "edge",
+				   &n_var)) && n_var > 3) {
+    mw_add_edge(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "ripple",
+				   &n_var)) && n_var > 3) {
+    mw_add_ripple(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "gradient",
+				   &n_var)) && n_var > 3) {
+    mw_add_gradient(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "dish",
+				   &n_var)) && n_var > 3) {
+    mw_add_dish(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "rectangle",
+				   &n_var)) && n_var > 3) {
+    mw_add_rectangle(domain, n_var, var);
+    free(var);
+  }
+
+
+  if ((var = get_real_vector(config, "rotated_rectangle",
+				&n_var)) && n_var > 3) {
+    mw_add_rotated_rectangle(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "wave_packet",
+				&n_var)) && n_var > 3) {
+    mw_add_wave_packet(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "lens",
+				   &n_var)) && n_var > 3) {
+    mw_add_lens(domain, n_var, var);
+    free(var);
+  }
+
+  if ((var = get_real_vector(config, "cavity",
+				   &n_var)) && n_var > 3) {
+    mw_add_cavity(domain, n_var, var);
+    free(var);
+  }
+  return MW_SUCCESS;
+}
+
+/* Initialize the domain for the simulation based on the configuration
+   read by mw_read_config */
+int
+mw_start(rc_data *config, mwDomain *domain)
 {
   int k;
-  rc_data *config;
 
   int nx = 64;
   int ny = 64;
   real dx = 1.0;
+  real duration;
   int borderwidth = 6.0;
   char *polarization = "z";
+  char *kernel = NULL;
+  char *integrator = NULL;
+  char *boundary = NULL;
+  char *periodic = NULL;
+  int periodic_edges = 0;
+  int symmetry_x, symmetry_y;
+  int cpml = 0;
+  real bloch_phase_x = 0.0, bloch_phase_y = 0.0, incidence_angle = 0.0;
+  real timestep_factor = 1.0;
+  int has_timestep_factor;
+  real *refine_x, *refine_y;
+  int n_refine_x = 0, n_refine_y = 0;
+  real *mesh_x = NULL, *mesh_y = NULL;
   int mode = 0;
   int vacuum = 0;
+  int nthreads = 0;
   real *line_osc;
   int n_line_osc;
   real *point_osc;
@@ -46,31 +195,108 @@ mw_start(int argc, char **argv, mwDomain *domain)
   int n_var;
   //  char *epsilon_plot_file = NULL;
 
-  /* Find the first config file on the command line. */
-  int ifile = rc_get_file(argc, argv);
+  /* Start with every pointer NULL, so that mw_free_domain only frees
+     the fields that are used */
+  memset(domain, 0, sizeof(mwDomain));
 
-  if (!ifile) {
-    /* No file given - assume command-line arguments contain all the
-       information. */
-    config = rc_read(NULL, stderr);
+  rc_assign_int(config, "x_pixels", &nx);
+  rc_assign_int(config, "y_pixels", &ny);
+  assign_real(config, "pixel_spacing", &dx);
+  /* The absorbing boundary is either a border in which the fields
+     are damped ("damping", the default) or a convolutional perfectly
+     matched layer ("cpml"), which reflects far less and so can be
+     thinner and closer to the scene; either way it is "border_width"
+     pixels wide, by default 6 or 10 respectively */
+  rc_assign_string(config, "boundary", &boundary);
+  if (boundary) {
+    if (strcasecmp(boundary, "cpml") == 0) {
+      cpml = 1;
+      borderwidth = 10;
+    }
+    else if (strcasecmp(boundary, "damping") != 0) {
+      fprintf(stderr, "Config variable \"boundary\" must be \"damping\" or \"cpml\"\n");
+      free(boundary);
+      return MW_FAILURE;
+    }
+    free(boundary);
   }
-  else {
-    /* Read configuration information from the file. */
-    config = rc_read(argv[ifile], stderr);
+  rc_assign_int(config, "border_width", &borderwidth);
+  /* The edges along x and/or y can instead be periodic, so that a
+     grating can be simulated with one unit cell (see mw_periodic.c) */
+  rc_assign_string(config, "periodic", &periodic);
+  if (periodic) {
+    if (strcasecmp(periodic, "x") == 0) {
+      periodic_edges = MW_PERIODIC_X;
+    }
+    else if (strcasecmp(periodic, "y") == 0) {
+      periodic_edges = MW_PERIODIC_Y;
+    }
+    else if (strcasecmp(periodic, "xy") == 0) {
+      periodic_edges = MW_PERIODIC_X | MW_PERIODIC_Y;
+    }
+    else if (strcasecmp(periodic, "none") != 0) {
+      fprintf(stderr, "Config variable \"periodic\" must be \"none\", \"x\", \"y\" or \"xy\"\n");
+      free(periodic);
+      return MW_FAILURE;
+    }
+    free(periodic);
   }
-  if (!config) {
-    fprintf(stderr, "Error initializing configuration information\n");
+  /* If the scene is symmetric about x=0 and/or y=0 then only the half
+     or quarter to the right of and above the plane is simulated, in a
+     domain that starts MW_HALO pixels before it (see mw_symmetry.c) */
+  MW_CHECK(get_symmetry(config, "symmetry_x", &symmetry_x));
+  MW_CHECK(get_symmetry(config, "symmetry_y", &symmetry_y));
+  if ((symmetry_x && (periodic_edges & MW_PERIODIC_X))
+      || (symmetry_y && (periodic_edges & MW_PERIODIC_Y))) {
+    fprintf(stderr, "An edge cannot be both \"periodic\" and a plane of symmetry\n");
     return MW_FAILURE;
   }
-  
-  /* Supplement configuration information with command-line
-     arguments. */
-  rc_register_args(config, argc, argv);
-
-  rc_assign_int(config, "x_pixels", &nx);
-  rc_assign_int(config, "y_pixels", &ny);
-  rc_assign_real(config, "pixel_spacing", &dx);
-  rc_assign_int(config, "border_width", &borderwidth);
+  if ((symmetry_x && nx % 2) || (symmetry_y && ny % 2)) {
+    fprintf(stderr, "A plane of symmetry needs an even number of \"x_pixels\" or \"y_pixels\" across it\n");
+    return MW_FAILURE;
+  }
+  if (symmetry_x) {
+    nx = nx/2 + MW_HALO;
+  }
+  if (symmetry_y) {
+    ny = ny/2 + MW_HALO;
+  }
+  /* The columns and/or rows can be refined around small features,
+     giving a graded mesh (see mw_mesh.c) with more of them than
+     x_pixels and y_pixels. The regions are positioned like the shapes,
+     in the units of "dx", and the number of divisions of each pixel
+     falls by up to a factor of "mesh_grading" from one to the next. */
+  refine_x = get_real_vector(config, "refine_x", &n_refine_x);
+  refine_y = get_real_vector(config, "refine_y", &n_refine_y);
+  if (refine_x || refine_y) {
+    real scale = dx, grading = 1.5;
+    int status = MW_SUCCESS;
+    assign_real(config, "dx", &scale);
+    assign_real(config, "mesh_grading", &grading);
+    if (grading <= 1.0) {
+      fprintf(stderr, "Config variable \"mesh_grading\" must be greater than 1\n");
+      status = MW_FAILURE;
+    }
+    else if (periodic_edges || symmetry_x || symmetry_y) {
+      fprintf(stderr, "A graded mesh cannot have \"periodic\" edges or planes of symmetry\n");
+      status = MW_FAILURE;
+    }
+    if (status == MW_SUCCESS && refine_x) {
+      status = mw_grade_axis(refine_x, n_refine_x, nx, scale, grading,
+			     &mesh_x, &nx);
+    }
+    if (status == MW_SUCCESS && refine_y) {
+      status = mw_grade_axis(refine_y, n_refine_y, ny, scale, grading,
+			     &mesh_y, &ny);
+    }
+    free(refine_x);
+    free(refine_y);
+    if (status != MW_SUCCESS) {
+      free(mesh_x);
+      free(mesh_y);
+      return MW_FAILURE;
+    }
+  }
   rc_assign_string(config, "polarization", &polarization);
   if (strcasecmp(polarization, "xyz") == 0) {
     mode |= (MW_MODE_EXY | MW_MODE_EZ);
@@ -89,11 +315,58 @@ mw_start(int argc, char **argv, mwDomain *domain)
   vacuum = rc_get_boolean(config, "vacuum");
   if (vacuum) {
     mode |= MW_MODE_VACUUM;
+  }
+
+  /* Take the threads, kernels and blocking that "tune" found fastest
+     for this grid on this machine, unless set explicitly */
+#ifdef MW_DOUBLE
+  MW_CHECK(mw_load_tuning(config, nx, ny, mode, MW_PRECISION_DOUBLE));
+#else
+  MW_CHECK(mw_load_tuning(config, nx, ny, mode, MW_PRECISION_FLOAT));
+#endif
+
+  /* The number of threads must be set before any fields are
+     allocated, since each thread zeros the part of each field that it
+     will later update */
+  rc_assign_int(config, "threads", &nthreads);
+  nthreads = mw_set_threads(nthreads);
+
+  /* Flush subnormal numbers to zero unless "flush_denormals" is 0 */
+  mw_set_flush_denormals(!rc_exists(config, "flush_denormals")
+			 || rc_get_boolean(config, "flush_denormals"));
+
+  /* Choose the row kernels for the instruction set of this machine,
+     unless overridden by the "kernel" config variable */
+  rc_assign_string(config, "kernel", &kernel);
+  if (mw_select_kernels(domain, kernel) != MW_SUCCESS) {
+    return MW_FAILURE;
+  }
+  if (kernel) {
+    free(kernel);
+  }
+
+  if (vacuum) {
     mw_new_field(&domain->scat_field, nx, ny, 0.0);
   }
 
   mw_new_domain(domain, nx, ny, dx, mode);
+  domain->periodic = periodic_edges;
+  domain->symmetry_x = symmetry_x;
+  domain->symmetry_y = symmetry_y;
+  if (symmetry_x) {
+    domain->origin_x = MW_HALO;
+  }
+  if (symmetry_y) {
+    domain->origin_y = MW_HALO;
+  }
+  if (mesh_x || mesh_y) {
+    int status = mw_set_mesh(domain, mesh_x, mesh_y);
+    free(mesh_x);
+    free(mesh_y);
+    MW_CHECK(status);
+  }
   mw_reset_damping(domain, borderwidth);
+  domain->nthreads = nthreads;
 
   domain->primary_frequency = 0.1*MW_C;
   domain->Ex_amplitude = 0.0;
@@ -102,45 +375,203 @@ mw_start(int argc, char **argv, mwDomain *domain)
   domain->cycles = 10;
   domain->duration = 200.0*MW_MINOR_STEPS*domain->dt;
 
-  rc_assign_real(config, "frequency", &domain->primary_frequency);
+  assign_real(config, "frequency", &domain->primary_frequency);
   if ((domain->frequencies
-       = rc_get_real_vector(config, "frequencies",
+       = get_real_vector(config, "frequencies",
 			    &n_var)) && n_var > 2) {
     domain->nfrequencies = n_var / 3;
     domain->primary_frequency = domain->frequencies[0];    
   }
 
-  rc_assign_real(config, "x_amplitude", &domain->Ex_amplitude);
-  rc_assign_real(config, "y_amplitude", &domain->Ey_amplitude);
-  rc_assign_real(config, "z_amplitude", &domain->Ez_amplitude);
+  assign_real(config, "x_amplitude", &domain->Ex_amplitude);
+  assign_real(config, "y_amplitude", &domain->Ey_amplitude);
+  assign_real(config, "z_amplitude", &domain->Ez_amplitude);
   rc_assign_int(config, "cycles", &domain->cycles);
   rc_assign_int(config, "mag", &domain->mag);
-  rc_assign_real(config, "plot_E_max", &domain->plot_E_max);
-  rc_assign_real(config, "plot_B_max", &domain->plot_B_max);
-  rc_assign_real(config, "plot_scat_ratio", &domain->plot_scat_ratio);
-  rc_assign_real(config, "dx", &domain->dx);
-  rc_assign_real(config, "duration", &domain->duration);
+  assign_real(config, "plot_E_max", &domain->plot_E_max);
+  assign_real(config, "plot_B_max", &domain->plot_B_max);
+  assign_real(config, "plot_scat_ratio", &domain->plot_scat_ratio);
+  assign_real(config, "dx", &domain->dx);
+  duration = domain->duration;
+  if (assign_real(config, "duration", &duration)) {
+    domain->duration = duration;
+  }
+  /* The timestep chosen by mw_new_domain gives a Courant number
+     c*dt/(2*dx) of 0.4 for each update of E or B, and the
+     "timestep_factor" scales it, as does the smallest spacing of a
+     graded mesh; the damping of the absorbing border is a factor per
+     timestep, so it is raised to the same power. The explicit scheme
+     is stable only up to MW_COURANT_LIMIT_2, or 6/7 of that with the
+     fourth-order stencil, which can also be exceeded if "dx" is set
+     smaller than "pixel_spacing"; the LOD scheme is stable for any
+     timestep. */
+  has_timestep_factor = assign_real(config, "timestep_factor",
+				    &timestep_factor);
+  if (has_timestep_factor && timestep_factor <= 0.0) {
+    fprintf(stderr, "Config variable \"timestep_factor\" must be positive\n");
+    return MW_FAILURE;
+  }
+  timestep_factor *= domain->min_spacing;
+  if (has_timestep_factor || domain->kernels_graded) {
+    int i, j;
+    domain->dt *= timestep_factor;
+    domain->dt_dx = domain->dt/domain->dx;
+    for (j = 0; j < domain->ny; j++) {
+      for (i = 0; i < domain->nx; i++) {
+	domain->Bdamping[j][i] = pow(domain->Bdamping[j][i], timestep_factor);
+      }
+    }
+  }
+  rc_assign_int(config, "stencil_order", &domain->stencil_order);
+  if (domain->stencil_order == 4) {
+    if (domain->kernels_graded) {
+      fprintf(stderr, "A graded mesh supports only \"stencil_order\" 2\n");
+      return MW_FAILURE;
+    }
+    domain->kernels4 = mw_kernels_fourth_order();
+  }
+  else if (domain->stencil_order != 2) {
+    fprintf(stderr, "Config variable \"stencil_order\" must be 2 or 4\n");
+    return MW_FAILURE;
+  }
+  rc_assign_string(config, "integrator", &integrator);
+  if (integrator) {
+    if (strcasecmp(integrator, "lod") == 0) {
+      domain->integrator = MW_INTEGRATOR_LOD;
+    }
+    else if (strcasecmp(integrator, "explicit") != 0) {
+      fprintf(stderr, "Config variable \"integrator\" must be \"explicit\" or \"lod\"\n");
+      free(integrator);
+      return MW_FAILURE;
+    }
+    free(integrator);
+  }
+  if (domain->integrator == MW_INTEGRATOR_LOD) {
+    if (domain->kernels4) {
+      fprintf(stderr, "The \"lod\" integrator supports only \"stencil_order\" 2\n");
+      return MW_FAILURE;
+    }
+    if (cpml) {
+      fprintf(stderr, "The \"lod\" integrator supports only \"boundary\" damping\n");
+      return MW_FAILURE;
+    }
+    if (domain->kernels_graded) {
+      fprintf(stderr, "The \"lod\" integrator does not support a graded mesh\n");
+      return MW_FAILURE;
+    }
+  }
+  else {
+    real courant = 0.5*domain->c*domain->dt/(domain->dx*domain->min_spacing);
+    real limit = domain->kernels4 ? MW_COURANT_LIMIT_4 : MW_COURANT_LIMIT_2;
+    if (courant > limit) {
+      fprintf(stderr, "The Courant number %g exceeds the limit of %g for the explicit integrator with \"stencil_order\" %d; use \"integrator lod\" or reduce \"timestep_factor\"\n",
+	      courant, limit, domain->stencil_order);
+      return MW_FAILURE;
+    }
+  }
+  /* The CPML depends on the final timestep and replaces the damping */
+  if (cpml) {
+    MW_CHECK(mw_reset_damping(domain, 0));
+    MW_CHECK(mw_new_cpml(domain, borderwidth));
+  }
+  domain->temporal_blocking = rc_get_boolean(config, "temporal_blocking");
+  domain->concurrent_streams = rc_get_boolean(config, "concurrent_streams");
+  rc_assign_int(config, "subnormal_interval", &domain->subnormal_interval);
+  rc_assign_int(config, "block_cols", &domain->block_cols);
+  rc_assign_int(config, "material_table", &domain->material_table);
+  if (rc_exists(config, "active_region")
+      && !rc_get_boolean(config, "active_region")) {
+    /* Update the whole domain from the start */
+    domain->active_i0 = domain->active_j0 = 0;
+    domain->active_i1 = domain->nx;
+    domain->active_j1 = domain->ny;
+  }
+  /* A Bloch-periodic edge delays the fields that cross it by a phase,
+     given in degrees by "bloch_phase_x" or "bloch_phase_y", or for
+     x by the angle of incidence of a plane wave at the primary
+     frequency */
+  assign_real(config, "bloch_phase_x", &bloch_phase_x);
+  assign_real(config, "bloch_phase_y", &bloch_phase_y);
+  if (assign_real(config, "incidence_angle", &incidence_angle)) {
+    bloch_phase_x = 360.0*domain->primary_frequency*domain->nx*domain->dx
+      *sin(M_PI*incidence_angle/180.0)/domain->c;
+  }
+  if ((bloch_phase_x != 0.0 && !(domain->periodic & MW_PERIODIC_X))
+      || (bloch_phase_y != 0.0 && !(domain->periodic & MW_PERIODIC_Y))) {
+    fprintf(stderr, "A Bloch phase is only possible across \"periodic\" edges\n");
+    return MW_FAILURE;
+  }
+  domain->bloch_phase_x = M_PI*bloch_phase_x/180.0;
+  domain->bloch_phase_y = M_PI*bloch_phase_y/180.0;
+  domain->bloch = (bloch_phase_x != 0.0 || bloch_phase_y != 0.0);
+  if (domain->periodic) {
+    /* The periodic edges are wrapped row by row by the explicit
+       stepper in mw_step.c, and the fields leaving one edge of the
+       active region re-enter at the other, so the whole domain is
+       updated by that stepper from the start */
+    if (domain->integrator == MW_INTEGRATOR_LOD) {
+      fprintf(stderr, "The \"lod\" integrator does not support \"periodic\" edges\n");
+      return MW_FAILURE;
+    }
+    domain->temporal_blocking = domain->concurrent_streams = 0;
+    domain->active_i0 = domain->active_j0 = 0;
+    domain->active_i1 = domain->nx;
+    domain->active_j1 = domain->ny;
+  }
+  if (symmetry_x || symmetry_y) {
+    /* The planes of symmetry are imposed by the explicit stepper, row
+       by row, or for one along the bottom edge after each half-step,
+       so neither the trapezoids of temporal blocking nor, for the
+       latter, the fused passes of the streams can be used */
+    if (domain->integrator == MW_INTEGRATOR_LOD) {
+      fprintf(stderr, "The \"lod\" integrator does not support planes of symmetry\n");
+      return MW_FAILURE;
+    }
+    domain->temporal_blocking = 0;
+    if (symmetry_y) {
+      domain->concurrent_streams = 0;
+    }
+  }
 
   //  domain->Ez_forcing = 1.0;
 
-  if ((line_osc = rc_get_real_vector(config, "line_oscillator",
+  if ((line_osc = get_real_vector(config, "line_oscillator",
 				     &n_line_osc)) && n_line_osc > 1) {
+    /* The taper is measured from the centre of the scene, and its
+       scale is the width of the full domain, in pixels of dx */
+    real width = 2.0*(mw_mesh_position(domain, 0, domain->nx)
+		      - domain->origin_x);
+    if (symmetry_y) {
+      fprintf(stderr, "The \"line_oscillator\" along the bottom of the domain is not symmetric about y=0\n");
+      free(line_osc);
+      return MW_FAILURE;
+    }
     for (k = 0; k < domain->nx; k++) {
-      domain->forcingI[borderwidth+1][k]
-	= line_osc[0]*exp(-pow(((real)k-domain->nx/2.0)*2.0
-			       /(line_osc[1]*domain->nx), 4.0));
+      /* The line is tapered towards its ends unless it crosses a
+	 periodic edge, where it has none */
+      real weight = line_osc[0];
+      if (!(domain->periodic & MW_PERIODIC_X)) {
+	weight *= exp(-pow((domain->mesh_x[k]-domain->origin_x)*2.0
+			   /(line_osc[1]*width), 4.0));
+      }
+      if (weight != 0.0) {
+	MW_CHECK(mw_set_source(domain, k, borderwidth+1, weight, 0.0));
+      }
     }
   }
 
-  if ((var = rc_get_real_vector(config, "point_oscillator",
+  if ((var = get_real_vector(config, "point_oscillator",
 				&n_var))) {
     point_osc = var;
     while (n_var > 2) {
-      real x0 = point_osc[1]/domain->dx + domain->nx/2.0;
-      real y0 = point_osc[2]/domain->dx + domain->ny/2.0;
-
-      if (x0 > 0 && x0 < nx-1 && y0 > 0 && y0 < ny-1) {
-	domain->forcingI[(int)y0][(int)x0] = point_osc[0];
+      real x0 = point_osc[1]/domain->dx + domain->origin_x;
+      real y0 = point_osc[2]/domain->dx + domain->origin_y;
+
+      if (x0 > domain->mesh_x[0] && x0 < domain->mesh_x[nx-1]
+	  && y0 > domain->mesh_y[0] && y0 < domain->mesh_y[ny-1]) {
+	MW_CHECK(mw_set_source(domain, mw_mesh_index(domain, 0, x0),
+			       mw_mesh_index(domain, 1, y0),
+			       point_osc[0], 0.0));
       }
       n_var -= 3;
       point_osc += 3;
@@ -148,18 +579,19 @@ mw_start(int argc, char **argv, mwDomain *domain)
     free(var);
   }
 
-  if ((var = rc_get_real_vector(config, "phased_point_oscillator",
+  if ((var = get_real_vector(config, "phased_point_oscillator",
 				&n_var))) {
     point_osc = var;
     while (n_var > 3) {
-      real x0 = point_osc[1]/domain->dx + domain->nx/2.0;
-      real y0 = point_osc[2]/domain->dx + domain->ny/2.0;
-
-      if (x0 > 0 && x0 < nx-1 && y0 > 0 && y0 < ny-1) {
-	domain->forcingI[(int)y0][(int)x0] = point_osc[0] 
-	  * cos(M_PI*point_osc[3]/180.0);
-	domain->forcingQ[(int)y0][(int)x0] = point_osc[0]
-	  * sin(M_PI*point_osc[3]/180.0);
+      real x0 = point_osc[1]/domain->dx + domain->origin_x;
+      real y0 = point_osc[2]/domain->dx + domain->origin_y;
+
+      if (x0 > domain->mesh_x[0] && x0 < domain->mesh_x[nx-1]
+	  && y0 > domain->mesh_y[0] && y0 < domain->mesh_y[ny-1]) {
+	MW_CHECK(mw_set_source(domain, mw_mesh_index(domain, 0, x0),
+			       mw_mesh_index(domain, 1, y0),
+			       point_osc[0]*cos(M_PI*point_osc[3]/180.0),
+			       point_osc[0]*sin(M_PI*point_osc[3]/180.0)));
       }
       n_var -= 4;
       point_osc += 4;
@@ -167,67 +599,65 @@ mw_start(int argc, char **argv, mwDomain *domain)
     free(var);
   }
 
-  if ((var = rc_get_real_vector(config, "circle",
-				   &n_var)) && n_var > 3) {
-    mw_add_circle(domain, n_var, var);
-    free(var);
-  }
-
-  if ((var = rc_get_real_vector(config, "edge",
-				   &n_var)) && n_var > 3) {
-    mw_add_edge(domain, n_var, var);
-    free(var);
-  }
-
-  if ((var = rc_get_real_vector(config, "ripple",
-				   &n_var)) && n_var > 3) {
-    mw_add_ripple(domain, n_var, var);
-    free(var);
-  }
-
-  if ((var = rc_get_real_vector(config, "gradient",
-				   &n_var)) && n_var > 3) {
-    mw_add_gradient(domain, n_var, var);
-    free(var);
-  }
-
-  if ((var = rc_get_real_vector(config, "dish",
-				   &n_var)) && n_var > 3) {
-    mw_add_dish(domain, n_var, var);
-    free(var);
-  }
-
-  if ((var = rc_get_real_vector(config, "rectangle",
-				   &n_var)) && n_var > 3) {
-    mw_add_rectangle(domain, n_var, var);
-    free(var);
-  }
-
-
-  if ((var = rc_get_real_vector(config, "rotated_rectangle",
-				&n_var)) && n_var > 3) {
-    mw_add_rotated_rectangle(domain, n_var, var);
+  MW_CHECK(mw_add_shapes(config, domain));
+
+  /* Rectangles in which the pixels are refined, each advanced with a
+     shorter timestep and given the shapes at its own resolution */
+  if ((var = get_real_vector(config, "subgrid", &n_var)) && n_var > 4) {
+    int status;
+    if (domain->integrator == MW_INTEGRATOR_LOD || domain->kernels4
+	|| domain->kernels_graded || domain->periodic
+	|| symmetry_x || symmetry_y) {
+      fprintf(stderr, "A \"subgrid\" needs the explicit integrator with \"stencil_order\" 2, a uniform mesh and no periodic edges or planes of symmetry\n");
+      free(var);
+      return MW_FAILURE;
+    }
+    status = mw_new_subgrid(domain, n_var, var);
     free(var);
+    MW_CHECK(status);
+    for (k = 0; k < domain->npatches; k++) {
+      MW_CHECK(mw_add_shapes(config, mw_patch(domain, k)));
+    }
+    domain->temporal_blocking = domain->concurrent_streams = 0;
   }
 
-  if ((var = rc_get_real_vector(config, "wave_packet",
-				&n_var)) && n_var > 3) {
-    mw_add_wave_packet(domain, n_var, var);
-    free(var);
+  /* The domain can be a window that moves along y with a pulse, at
+     "window_speed" times c after "window_delay" seconds, adding the
+     shapes to the rows it reaches (see mw_window.c) */
+  assign_real(config, "window_speed", &domain->window_speed);
+  assign_real(config, "window_delay", &domain->window_delay);
+  if (domain->window_speed < 0.0) {
+    fprintf(stderr, "Config variable \"window_speed\" must not be negative\n");
+    return MW_FAILURE;
   }
-
-  if ((var = rc_get_real_vector(config, "lens",
-				   &n_var)) && n_var > 3) {
-    mw_add_lens(domain, n_var, var);
-    free(var);
+  if (domain->window_speed > 0.0
+      && (domain->integrator == MW_INTEGRATOR_LOD || domain->cpml
+	  || domain->kernels_graded || domain->subgrid
+	  || (domain->periodic & MW_PERIODIC_Y) || domain->bloch
+	  || symmetry_y)) {
+    fprintf(stderr, "A moving window needs the explicit integrator, \"boundary\" damping and a uniform mesh, and cannot have a subgrid, a Bloch phase, or a periodic edge or plane of symmetry along y\n");
+    return MW_FAILURE;
   }
 
-  if ((var = rc_get_real_vector(config, "cavity",
-				   &n_var)) && n_var > 3) {
-    mw_add_cavity(domain, n_var, var);
-    free(var);
+#ifndef MW_DOUBLE
+  /* With "precision bf16" the fields are stored in bfloat16 and
+     advanced by their own stepper (see mw_bf16.c) */
+  {
+    int precision;
+    MW_CHECK(mw_get_precision(config, &precision));
+    if (precision == MW_PRECISION_BF16) {
+      if (domain->integrator == MW_INTEGRATOR_LOD || domain->kernels4
+	  || domain->kernels_graded || domain->cpml || domain->periodic
+	  || symmetry_x || symmetry_y || domain->subgrid
+	  || domain->window_speed > 0.0) {
+	fprintf(stderr, "\"precision bf16\" needs the explicit integrator with \"stencil_order\" 2, \"boundary\" damping and a uniform mesh, and cannot have periodic edges, planes of symmetry, a subgrid or a moving window\n");
+	return MW_FAILURE;
+      }
+      domain->storage = MW_STORAGE_BF16;
+      domain->temporal_blocking = domain->concurrent_streams = 0;
+    }
   }
-
+#endif
 
   /*
   if (epsilon_plot_file) {
@@ -17,143 +17,811 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <stddef.h>
 #include <math.h>
 #include "maxwell.h"
 
-/* Move the E and B fields forward one timestep. */
+/* The following four functions increment one row j of the fields of
+   one polarization between columns i0 and i1-1, for the main domain
+   if "parts" contains MW_PART_MAIN and for the parallel calculation
+   in vacuum (if there is one) if it contains MW_PART_VACUUM. In
+   vacuum the damping is only from the absorbing border and the
+   dielectric constant is 1 everywhere. Rows and columns that are not
+   updated at the edges of the domain, or that are outside the active
+   region, are skipped, so the caller need not trim the ranges. In the
+   main domain, columns masked out by perfect conductors are skipped
+   too. Neighbours beyond the edge of the domain are read from the
+   ghost cells, so the same kernel covers the whole row. If the domain
+   has a CPML then its terms are added to the columns within it (see
+   mw_cpml.c). If there is a plane of symmetry along the left edge
+   then the columns to the left of it are set from those to the right
+   once the row has been updated (see mw_symmetry.c). */
+
+/* Return where the electric-field row kernels should get their
+   coefficients for row j (MW_COEFFICIENTS_*), and set the material,
+   Edamping and Eprefix arguments to pass them */
 int
-mw_step(mwDomain *domain)
+mw_row_coefficients(mwDomain *domain, int j, const mwMaterial **material,
+		    const real **Edamping, const real **Eprefix)
+{
+  *material = NULL;
+  *Eprefix = NULL;
+  if (domain->lossless) {
+    *Edamping = domain->Bdamping[j];
+  }
+  else {
+    *Edamping = domain->Edamping[j];
+  }
+  if (domain->Eprefix_uniform) {
+    return MW_COEFFICIENTS_UNIFORM;
+  }
+  else if (domain->material_rows && domain->material_rows[j]) {
+    *material = domain->material[j];
+    *Edamping = domain->material_Edamping;
+    *Eprefix = domain->material_Eprefix;
+    return MW_COEFFICIENTS_INDEXED;
+  }
+  *Eprefix = domain->Eprefix[j];
+  return MW_COEFFICIENTS_FIELD;
+}
+
+/* Trim row j and columns i0 to i1-1 to those updated for a
+   component, returning 0 if none of them are. Components at the
+   corners of the pixels (Ez and Bz) are held at zero along all four
+   edges of the domain, so are updated in rows and columns 1 to n-2 of
+   a domain n pixels across, and those at the middles of the sides
+   (Ex, Ey, Bx and By) in rows and columns 0 to n-2; "first" is 1 or 0
+   respectively. Across a periodic edge every component is updated in
+   rows or columns 0 to n-1, and so is every component at the top or
+   bottom of a band of a larger domain (see mw_mpi.c), which is not an
+   edge at all. The range is then trimmed to the active region.
+   Whatever the component, its stencil never reaches more than MW_HALO
+   pixels beyond the range, into the ghost cells. */
+int
+mw_update_range(mwDomain *domain, int first, int j, int *i0, int *i1)
+{
+  int x0 = first, x1 = domain->nx-1;
+  int y0 = first, y1 = domain->ny-1;
+  if (domain->periodic & MW_PERIODIC_X) {
+    x0 = 0;
+    x1 = domain->nx;
+  }
+  if (domain->periodic & MW_PERIODIC_Y) {
+    y0 = 0;
+    y1 = domain->ny;
+  }
+  if (domain->row_offset > 0) {
+    y0 = 0;
+  }
+  if (domain->row_offset + domain->ny < domain->ny_global) {
+    y1 = domain->ny;
+  }
+  if (j < y0 || j >= y1
+      || j < domain->active_j0 || j >= domain->active_j1) {
+    return 0;
+  }
+  if (*i0 < x0) {
+    *i0 = x0;
+  }
+  if (*i1 > x1) {
+    *i1 = x1;
+  }
+  if (*i0 < domain->active_i0) {
+    *i0 = domain->active_i0;
+  }
+  if (*i1 > domain->active_i1) {
+    *i1 = domain->active_i1;
+  }
+  return *i0 < *i1;
+}
+
+/* Find the next run of columns of row j that "mask" says should be
+   updated, trimmed to columns i0 to i1-1, storing its first column
+   and last column+1 in r0 and r1. Before the first call *k should be
+   -1. Return 0 when there are no more runs. */
+int
+mw_next_run(const mwMask *mask, int j, int i0, int i1,
+	    int *k, int *r0, int *r1)
+{
+  if (!mask->start) {
+    /* No conductors: the whole range is one run */
+    *r0 = i0;
+    *r1 = i1;
+    return (*k)++ < 0;
+  }
+  if (*k < 0) {
+    *k = mask->start[j];
+  }
+  for ( ; *k < mask->start[j+1]; (*k)++) {
+    const mwRun *run = mask->runs + *k;
+    if (run->i0 >= i1) {
+      break;
+    }
+    *r0 = run->i0 > i0 ? run->i0 : i0;
+    *r1 = run->i1 < i1 ? run->i1 : i1;
+    if (*r0 < *r1) {
+      (*k)++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Divide columns i0 to i1-1 of row j into at most three segments,
+   alternating between the absorbing border, where the fields are
+   damped, and the interior, where Bdamping is 1 and need not be
+   loaded; there is no border across a periodic edge or along a plane
+   of symmetry, and in a band of a larger domain the border is that of
+   the larger domain. The first column and last column+1 of each
+   segment are stored in s0 and s1, and whether it is damped
+   (MW_DAMPED or MW_UNDAMPED) in "damped". Return the number of
+   segments. */
+int
+mw_row_segments(mwDomain *domain, int j, int i0, int i1,
+		int *s0, int *s1, int *damped)
+{
+  int border = domain->borderwidth;
+  int k0 = border, k1 = domain->nx-border;
+  int row = j + domain->row_offset;
+  int n = 0;
+  if (domain->periodic & MW_PERIODIC_X) {
+    k0 = i0;
+    k1 = i1;
+  }
+  else if (domain->symmetry_x) {
+    k0 = i0;
+  }
+  if (!(domain->periodic & MW_PERIODIC_Y)
+      && ((row < border && !domain->symmetry_y)
+	  || row >= domain->ny_global-border)) {
+    k0 = k1 = i1;
+  }
+  if (k0 < i0) {
+    k0 = i0;
+  }
+  if (k1 > i1) {
+    k1 = i1;
+  }
+  if (k1 < k0) {
+    k1 = k0;
+  }
+  if (i0 < k0) {
+    s0[n] = i0; s1[n] = k0; damped[n++] = MW_DAMPED;
+  }
+  if (k0 < k1) {
+    s0[n] = k0; s1[n] = k1; damped[n++] = MW_UNDAMPED;
+  }
+  if (k1 < i1) {
+    s0[n] = k1; s1[n] = i1; damped[n++] = MW_DAMPED;
+  }
+  return n;
+}
+
+/* Increment segments s0[k] to s1[k]-1, k < n, of row j of Ez in the
+   fields Ez, Bx and By, with the fourth-order kernels or those for a
+   graded mesh if they are in use; the stencil of the former reaches
+   two rows below and one above */
+static
+void
+tm_E_row(mwDomain *domain, int n, const int *s0, const int *s1,
+	 const int *damped, int coefficients, int j,
+	 real **Ez, real **Bx, real **By, const mwMaterial *material,
+	 const real *Edamping, const real *Eprefix, real Eprefix_const)
+{
+  int k;
+  for (k = 0; k < n; k++) {
+    if (domain->kernels4) {
+      domain->kernels4->tm_E[damped[k]][coefficients]
+	(s0[k], s1[k], Ez[j], Bx[j+1], Bx[j], Bx[j-1], Bx[j-2], By[j-1],
+	 material, Edamping, Eprefix, Eprefix_const);
+    }
+    else if (domain->kernels_graded) {
+      domain->kernels_graded->tm_E[damped[k]][coefficients]
+	(s0[k], s1[k], Ez[j], Bx[j], Bx[j-1], By[j-1],
+	 material, Edamping, Eprefix, Eprefix_const,
+	 domain->dual_x, domain->dual_y[j]);
+    }
+    else {
+      domain->kernels->tm_E[damped[k]][coefficients]
+	(s0[k], s1[k], Ez[j], Bx[j], Bx[j-1], By[j-1],
+	 material, Edamping, Eprefix, Eprefix_const);
+    }
+  }
+}
+
+/* Increment segments of row j of Bx and By from Ez */
+static
+void
+tm_B_row(mwDomain *domain, int n, const int *s0, const int *s1,
+	 const int *damped, int j, real **Bx, real **By, real **Ez,
+	 real dt_dx)
+{
+  int k;
+  for (k = 0; k < n; k++) {
+    if (domain->kernels4) {
+      domain->kernels4->tm_B[damped[k]]
+	(s0[k], s1[k], Bx[j], By[j], Ez[j-1], Ez[j], Ez[j+1], Ez[j+2],
+	 domain->Bdamping[j], dt_dx);
+    }
+    else if (domain->kernels_graded) {
+      domain->kernels_graded->tm_B[damped[k]]
+	(s0[k], s1[k], Bx[j], By[j], Ez[j], Ez[j+1],
+	 domain->Bdamping[j], dt_dx, domain->ratio_x, domain->ratio_y[j]);
+    }
+    else {
+      domain->kernels->tm_B[damped[k]]
+	(s0[k], s1[k], Bx[j], By[j], Ez[j], Ez[j+1],
+	 domain->Bdamping[j], dt_dx);
+    }
+  }
+}
+
+/* Increment segments of row j of Ex and Ey from Bz */
+static
+void
+te_E_row(mwDomain *domain, int n, const int *s0, const int *s1,
+	 const int *damped, int coefficients, int j,
+	 real **Ex, real **Ey, real **Bz, const mwMaterial *material,
+	 const real *Edamping, const real *Eprefix, real Eprefix_const)
+{
+  int k;
+  for (k = 0; k < n; k++) {
+    if (domain->kernels4) {
+      domain->kernels4->te_E[damped[k]][coefficients]
+	(s0[k], s1[k], Ex[j], Ey[j], Bz[j-1], Bz[j], Bz[j+1], Bz[j+2],
+	 material, Edamping, Eprefix, Eprefix_const);
+    }
+    else if (domain->kernels_graded) {
+      domain->kernels_graded->te_E[damped[k]][coefficients]
+	(s0[k], s1[k], Ex[j], Ey[j], Bz[j], Bz[j+1],
+	 material, Edamping, Eprefix, Eprefix_const,
+	 domain->ratio_x, domain->ratio_y[j]);
+    }
+    else {
+      domain->kernels->te_E[damped[k]][coefficients]
+	(s0[k], s1[k], Ex[j], Ey[j], Bz[j], Bz[j+1],
+	 material, Edamping, Eprefix, Eprefix_const);
+    }
+  }
+}
+
+/* Increment segments of row j of Bz from Ex and Ey */
+static
+void
+te_B_row(mwDomain *domain, int n, const int *s0, const int *s1,
+	 const int *damped, int j, real **Bz, real **Ex, real **Ey,
+	 real dt_dx)
+{
+  int k;
+  for (k = 0; k < n; k++) {
+    if (domain->kernels4) {
+      domain->kernels4->te_B[damped[k]]
+	(s0[k], s1[k], Bz[j], Ex[j+1], Ex[j], Ex[j-1], Ex[j-2], Ey[j-1],
+	 domain->Bdamping[j], dt_dx);
+    }
+    else if (domain->kernels_graded) {
+      domain->kernels_graded->te_B[damped[k]]
+	(s0[k], s1[k], Bz[j], Ex[j], Ex[j-1], Ey[j-1],
+	 domain->Bdamping[j], dt_dx, domain->dual_x, domain->dual_y[j]);
+    }
+    else {
+      domain->kernels->te_B[damped[k]]
+	(s0[k], s1[k], Bz[j], Ex[j], Ex[j-1], Ey[j-1],
+	 domain->Bdamping[j], dt_dx);
+    }
+  }
+}
+
+/* Increment row j of the Ez component */
+void
+mw_step_tm_E(mwDomain *domain, mwForcing *forcing, int j, int i0, int i1,
+	     int parts)
+{
+  real dt = domain->dt;
+  const mwMaterial *material;
+  const real *Edamping, *Eprefix;
+  int coefficients, k, n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 1, j, &i0, &i1)) {
+    return;
+  }
+  coefficients = mw_row_coefficients(domain, j, &material,
+				     &Edamping, &Eprefix);
+  run = -1;
+  while ((parts & MW_PART_MAIN)
+	 && mw_next_run(&domain->E_mask, j, i0, i1, &run, &r0, &r1)) {
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    /* Lossy materials are damped even in the interior */
+    if (!domain->lossless) {
+      for (k = 0; k < n; k++) {
+	damped[k] = MW_DAMPED;
+      }
+    }
+    tm_E_row(domain, n, s0, s1, damped, coefficients, j,
+	     domain->Ez, domain->Bx, domain->By,
+	     material, Edamping, Eprefix, domain->Eprefix_uniform);
+    if (domain->cpml) {
+      mw_cpml_tm_E(domain, MW_PART_MAIN, j, r0, r1, domain->Eprefix_uniform);
+    }
+    mw_apply_sources(domain, domain->Ez, j, r0, r1,
+		     dt*forcing->Ez_I, dt*forcing->Ez_Q);
+  }
+  if ((parts & MW_PART_VACUUM) && (domain->mode & MW_MODE_VACUUM)) {
+    real Eprefix_vacuum = 0.5*dt*domain->c*domain->c/domain->dx;
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    tm_E_row(domain, n, s0, s1, damped, MW_COEFFICIENTS_UNIFORM, j,
+	     domain->Ez_vacuum, domain->Bx_vacuum, domain->By_vacuum,
+	     NULL, domain->Bdamping[j], NULL, Eprefix_vacuum);
+    if (domain->cpml) {
+      mw_cpml_tm_E(domain, MW_PART_VACUUM, j, i0, i1, Eprefix_vacuum);
+    }
+    mw_apply_sources(domain, domain->Ez_vacuum, j, i0, i1,
+		     dt*forcing->Ez_I, dt*forcing->Ez_Q);
+  }
+  mw_mirror_tm_E(domain, j, parts);
+}
+
+/* Increment row j of the Bx and By components */
+void
+mw_step_tm_B(mwDomain *domain, int j, int i0, int i1, int parts)
+{
+  real dt_dx = 0.5*domain->dt/domain->dx;
+  int n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 0, j, &i0, &i1)) {
+    return;
+  }
+  run = -1;
+  while ((parts & MW_PART_MAIN)
+	 && mw_next_run(&domain->tm_B_mask, j, i0, i1, &run, &r0, &r1)) {
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    tm_B_row(domain, n, s0, s1, damped, j,
+	     domain->Bx, domain->By, domain->Ez, dt_dx);
+    if (domain->cpml) {
+      mw_cpml_tm_B(domain, MW_PART_MAIN, j, r0, r1);
+    }
+  }
+  if ((parts & MW_PART_VACUUM) && (domain->mode & MW_MODE_VACUUM)) {
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    tm_B_row(domain, n, s0, s1, damped, j,
+	     domain->Bx_vacuum, domain->By_vacuum, domain->Ez_vacuum, dt_dx);
+    if (domain->cpml) {
+      mw_cpml_tm_B(domain, MW_PART_VACUUM, j, i0, i1);
+    }
+  }
+  mw_mirror_tm_B(domain, j, parts);
+}
+
+/* Increment row j of the Ex and Ey components */
+void
+mw_step_te_E(mwDomain *domain, mwForcing *forcing, int j, int i0, int i1,
+	     int parts)
+{
+  real dt = domain->dt;
+  const mwMaterial *material;
+  const real *Edamping, *Eprefix;
+  int coefficients, k, n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 0, j, &i0, &i1)) {
+    return;
+  }
+  coefficients = mw_row_coefficients(domain, j, &material,
+				     &Edamping, &Eprefix);
+  run = -1;
+  while ((parts & MW_PART_MAIN)
+	 && mw_next_run(&domain->E_mask, j, i0, i1, &run, &r0, &r1)) {
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    if (!domain->lossless) {
+      for (k = 0; k < n; k++) {
+	damped[k] = MW_DAMPED;
+      }
+    }
+    te_E_row(domain, n, s0, s1, damped, coefficients, j,
+	     domain->Ex, domain->Ey, domain->Bz,
+	     material, Edamping, Eprefix, domain->Eprefix_uniform);
+    if (domain->cpml) {
+      mw_cpml_te_E(domain, MW_PART_MAIN, j, r0, r1, domain->Eprefix_uniform);
+    }
+    mw_apply_sources(domain, domain->Ex, j, r0, r1,
+		     dt*forcing->Ex_I, dt*forcing->Ex_Q);
+    mw_apply_sources(domain, domain->Ey, j, r0, r1,
+		     dt*forcing->Ey_I, dt*forcing->Ey_Q);
+  }
+  if ((parts & MW_PART_VACUUM) && (domain->mode & MW_MODE_VACUUM)) {
+    real Eprefix_vacuum = 0.5*dt*domain->c*domain->c/domain->dx;
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    te_E_row(domain, n, s0, s1, damped, MW_COEFFICIENTS_UNIFORM, j,
+	     domain->Ex_vacuum, domain->Ey_vacuum, domain->Bz_vacuum,
+	     NULL, domain->Bdamping[j], NULL, Eprefix_vacuum);
+    if (domain->cpml) {
+      mw_cpml_te_E(domain, MW_PART_VACUUM, j, i0, i1, Eprefix_vacuum);
+    }
+    mw_apply_sources(domain, domain->Ex_vacuum, j, i0, i1,
+		     dt*forcing->Ex_I, dt*forcing->Ex_Q);
+    mw_apply_sources(domain, domain->Ey_vacuum, j, i0, i1,
+		     dt*forcing->Ey_I, dt*forcing->Ey_Q);
+  }
+  mw_mirror_te_E(domain, j, parts);
+}
+
+/* Increment row j of the Bz component */
+void
+mw_step_te_B(mwDomain *domain, int j, int i0, int i1, int parts)
 {
   real dt_dx = 0.5*domain->dt/domain->dx;
-  real Eprefix_vacuum = 0.5*domain->dt*domain->c*domain->c
-    / domain->dx;
+  int n, run, r0, r1;
+  int s0[3], s1[3], damped[3];
+  if (!mw_update_range(domain, 1, j, &i0, &i1)) {
+    return;
+  }
+  run = -1;
+  while ((parts & MW_PART_MAIN)
+	 && mw_next_run(&domain->te_B_mask, j, i0, i1, &run, &r0, &r1)) {
+    n = mw_row_segments(domain, j, r0, r1, s0, s1, damped);
+    te_B_row(domain, n, s0, s1, damped, j,
+	     domain->Bz, domain->Ex, domain->Ey, dt_dx);
+    if (domain->cpml) {
+      mw_cpml_te_B(domain, MW_PART_MAIN, j, r0, r1);
+    }
+  }
+  if ((parts & MW_PART_VACUUM) && (domain->mode & MW_MODE_VACUUM)) {
+    n = mw_row_segments(domain, j, i0, i1, s0, s1, damped);
+    te_B_row(domain, n, s0, s1, damped, j,
+	     domain->Bz_vacuum, domain->Ex_vacuum, domain->Ey_vacuum, dt_dx);
+    if (domain->cpml) {
+      mw_cpml_te_B(domain, MW_PART_VACUUM, j, i0, i1);
+    }
+  }
+  mw_mirror_te_B(domain, j, parts);
+}
+
+/* Compute Eprefix from the dielectric constant in rows j0 to j1-1,
+   and convert the imaginary part of the dielectric constant stored in
+   Edamping into the factor by which the electric field is damped each
+   timestep, setting *nonuniform if Eprefix differs from
+   Eprefix_uniform and *lossy if Edamping differs from Bdamping */
+static
+void
+coefficient_rows(mwDomain *domain, int j0, int j1, real Eprefix_uniform,
+		 int *nonuniform, int *lossy)
+{
+  /* The last row and column are only updated across periodic edges */
+  int nx = domain->nx - !(domain->periodic & MW_PERIODIC_X);
+  int ny = domain->ny - !(domain->periodic & MW_PERIODIC_Y);
   int i, j;
+  if (j1 > ny) {
+    j1 = ny;
+  }
+  for (j = j0; j < j1; j++) {
+    for (i = 0; i < nx; i++) {
+      domain->Eprefix[j][i] = 0.5*domain->dt*domain->c*domain->c
+	/(domain->dx*domain->epsilon[j][i]);
+      domain->Edamping[j][i] = domain->Bdamping[j][i]
+	* exp(-2.0*M_PI*domain->primary_frequency*domain->dt
+	      *domain->Edamping[j][i]/domain->epsilon[j][i]);
+      *nonuniform |= (domain->Eprefix[j][i] != Eprefix_uniform);
+      *lossy |= (domain->Edamping[j][i] != domain->Bdamping[j][i]);
+    }
+  }
+}
+
+/* If this is the first timestep then create a convenience field that
+   reduces the number of multiplications and divisions, and convert
+   the imaginary part of the dielectric constant stored in Edamping
+   into the factor by which the electric field is damped each
+   timestep. At the same time, find out which of the row-kernel
+   variants can be used for the rest of the simulation: if the
+   dielectric constant is the same everywhere then Eprefix is replaced
+   by a constant, and if it has no imaginary part then Edamping is the
+   same as Bdamping. Otherwise the coefficients are compressed into a
+   table of materials where possible. The masks that exclude the
+   interior of perfect conductors are built at the same time. */
+int
+mw_init_coefficients(mwDomain *domain)
+{
+  real Eprefix_uniform;
+  int nonuniform = 0, lossy = 0;
+  if (domain->Eprefix) {
+    return MW_SUCCESS;
+  }
+  mw_new_field(&domain->Eprefix, domain->nx, domain->ny, 1.0);
+  Eprefix_uniform = 0.5*domain->dt*domain->c*domain->c
+    /(domain->dx*domain->epsilon[0][0]);
+#pragma omp parallel reduction(|:nonuniform,lossy)
+  {
+    int j0, j1;
+    mw_thread_rows(domain->ny, &j0, &j1);
+    coefficient_rows(domain, j0, j1, Eprefix_uniform, &nonuniform, &lossy);
+  }
+  domain->Eprefix_uniform = nonuniform ? 0.0 : Eprefix_uniform;
+  domain->lossless = !lossy;
+  if (domain->material_table && !domain->Eprefix_uniform) {
+    MW_CHECK(mw_init_materials(domain));
+  }
+  MW_CHECK(mw_init_conductors(domain));
+  return MW_SUCCESS;
+}
+
+/* Compute the coefficients of rows j0 to j1-1 as mw_init_coefficients
+   does, after the dielectric constant there has changed (see
+   mw_window.c), falling back to the row-kernel variants for a
+   non-uniform or lossy domain if necessary and indexing the rows in
+   the table of materials, which is created if the domain has just
+   become non-uniform. The conductor masks are not rebuilt. */
+int
+mw_update_coefficients(mwDomain *domain, int j0, int j1)
+{
+  int nonuniform = 0, lossy = 0;
+  coefficient_rows(domain, j0, j1, domain->Eprefix_uniform,
+		   &nonuniform, &lossy);
+  if (lossy) {
+    domain->lossless = 0;
+  }
+  if (nonuniform && domain->Eprefix_uniform) {
+    domain->Eprefix_uniform = 0.0;
+    if (domain->material_table) {
+      MW_CHECK(mw_init_materials(domain));
+    }
+  }
+  else {
+    mw_index_materials(domain, j0, j1);
+  }
+  return MW_SUCCESS;
+}
+
+/* Move the E and B fields of each of the nmembers simulations in
+   "members" forward one timestep, using the forcing amplitudes in
+   their "forcing", and if "poynting" is true add the Poynting vector
+   at the end of the timestep to the summation. The members of an
+   ensemble (see mw_ensemble.c) have the same geometry, so each row is
+   advanced in all of them in turn while its coefficients are in
+   cache; usually there is only one. Once a row has been advanced in
+   all the members, the ghost cells beyond any periodic edges are set
+   from it (see mw_periodic.c), which for a Bloch-periodic pair needs
+   the row of both.
+
+   This is done in a single pass through memory: for each row j the E
+   field is incremented, followed by the B field in the row that
+   depends on it (j-1 for Bx/By, j for Bz), followed by the Poynting
+   vector in row j-1 whose fields are now all up to date. The domain
+   is divided into bands of rows, one per thread. The B rows at the
+   bottom of each band that depend on E fields from the neighbouring
+   band (row j0-1 for Bx/By, j0 for Bz) are left until all threads
+   have finished their pass, along with the Poynting vector in the
+   two rows that depend on them. Across a periodic bottom edge row -1
+   is row ny-1. Each band needs at least two rows. */
+static
+void
+step(mwDomain *members, int nmembers, int poynting)
+{
+  int tm = members->mode & MW_MODE_EZ;
+  int te = members->mode & MW_MODE_EXY;
+  int m;
+
+  for (m = 0; m < nmembers; m++) {
+    mw_grow_active(members+m, 1);
+  }
+
+#pragma omp parallel if (members->ny >= 2*members->nthreads)
+  {
+    int j, j0, j1, jB, m;
+    int nx = members->nx;
+    mw_thread_rows(members->ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      for (m = 0; m < nmembers; m++) {
+	mwDomain *domain = members+m;
+	if (tm) {
+	  mw_step_tm_E(domain, &domain->forcing, j, 0, nx, MW_PART_ALL);
+	}
+	if (te) {
+	  mw_step_te_E(domain, &domain->forcing, j, 0, nx, MW_PART_ALL);
+	}
+      }
+      if (tm) {
+	mw_wrap_tm_E(members, nmembers, j);
+      }
+      if (te) {
+	mw_wrap_te_E(members, nmembers, j);
+      }
+      if (j > j0) {
+	for (m = 0; m < nmembers; m++) {
+	  if (tm) {
+	    mw_step_tm_B(members+m, j-1, 0, nx, MW_PART_ALL);
+	  }
+	  if (te) {
+	    mw_step_te_B(members+m, j, 0, nx, MW_PART_ALL);
+	  }
+	}
+	if (tm) {
+	  mw_wrap_tm_B(members, nmembers, j-1);
+	}
+	if (te) {
+	  mw_wrap_te_B(members, nmembers, j);
+	}
+      }
+      if (poynting && j-1 > j0) {
+	for (m = 0; m < nmembers; m++) {
+	  if (tm) {
+	    mw_poynting_tm(members+m, j-1);
+	  }
+	  if (te) {
+	    mw_poynting_te(members+m, j-1);
+	  }
+	}
+      }
+    }
+#pragma omp barrier
+    jB = j0 > 0 ? j0-1 : members->ny-1;
+    for (m = 0; m < nmembers; m++) {
+      if (tm) {
+	mw_step_tm_B(members+m, jB, 0, nx, MW_PART_ALL);
+      }
+      if (te) {
+	mw_step_te_B(members+m, j0, 0, nx, MW_PART_ALL);
+      }
+    }
+    if (tm) {
+      mw_wrap_tm_B(members, nmembers, jB);
+    }
+    if (te) {
+      mw_wrap_te_B(members, nmembers, j0);
+    }
+    if (poynting) {
+      for (m = 0; m < nmembers; m++) {
+	for (j = j0-1; j <= j0; j++) {
+	  if (tm) {
+	    mw_poynting_tm(members+m, j);
+	  }
+	  if (te) {
+	    mw_poynting_te(members+m, j);
+	  }
+	}
+      }
+    }
+  }
+
+  for (m = 0; m < nmembers; m++) {
+    members[m].time += members[m].dt;
+  }
+}
+
+/* As step(), but for the fourth-order stencil, in which B in row j
+   depends on E up to row j+2 and E depends on B up to two rows below,
+   so the fused pass would have to leave three rows at the bottom of
+   each band and the bands would need at least four rows. Instead E is
+   incremented in every row of the band, then after a barrier B, and
+   after another the Poynting vector, at the cost of streaming the
+   fields through memory two or three times per timestep. The same
+   order is used for a plane of symmetry along the bottom edge, across
+   which B in the row on the plane depends on E two rows above it:
+   once all the rows of E, or of B, have been incremented, the rows
+   below the plane are set from those above it by a single thread
+   (see mw_symmetry.c). */
+static
+void
+step_unfused(mwDomain *members, int nmembers, int poynting)
+{
+  int tm = members->mode & MW_MODE_EZ;
+  int te = members->mode & MW_MODE_EXY;
+  int m;
 
-  /* If this is the first call then create a convenience field that
-     reduces the number of multiplications and divisions. */
-  if (domain->Eprefix == NULL) {
-    mw_new_field(&domain->Eprefix, domain->nx, domain->ny, 1.0);
-    for (j = 0; j < domain->ny-1; j++) {
-      for (i = 0; i < domain->nx-1; i++) {
-	domain->Eprefix[j][i] = 0.5*domain->dt*domain->c*domain->c
-	  /(domain->dx*domain->epsilon[j][i]);
-	domain->Edamping[j][i] = domain->Bdamping[j][i]
-	  * exp(-2.0*M_PI*domain->primary_frequency*domain->dt
-		*domain->Edamping[j][i]/domain->epsilon[j][i]);
-      }
-    }
-  }
-
-  /* If wave has a horizontally polarized component... */
-  if (domain->mode & MW_MODE_EXY) {
-    /* Increment the Ex and Ey components. */
-    for (j = 0; j < domain->ny-1; j++) {
-      for (i = 0; i < domain->nx-1; i++) {
-	domain->Ex[j][i] = domain->Edamping[j][i]*domain->Ex[j][i]
-	  + domain->dt*(domain->forcingI[j][i]*domain->Ex_forcingI
-			-domain->forcingQ[j][i]*domain->Ex_forcingQ)
-	  + domain->Eprefix[j][i]*(domain->Bz[j+1][i+1] - domain->Bz[j][i+1]);
-	domain->Ey[j][i] = domain->Edamping[j][i]*domain->Ey[j][i]
-	  + domain->dt*(domain->forcingI[j][i]*domain->Ey_forcingI
-			-domain->forcingQ[j][i]*domain->Ey_forcingQ)
-	  + domain->Eprefix[j][i]*(domain->Bz[j+1][i] - domain->Bz[j+1][i+1]);
-      }
-    }
-  }
-  /* If wave has a vertically polarized component... */
-  if (domain->mode & MW_MODE_EZ) {
-    /* Increment the Ez component. */
-    for (j = 1; j < domain->ny-1; j++) {
-      for (i = 1; i < domain->nx-1; i++) {
-	domain->Ez[j][i] = domain->Edamping[j][i]*domain->Ez[j][i]
-	  + domain->dt*(domain->forcingI[j][i]*domain->Ez_forcingI
-			-domain->forcingQ[j][i]*domain->Ez_forcingQ)
-	  + domain->Eprefix[j][i]*(domain->By[j-1][i] - domain->By[j-1][i-1]
-			   - domain->Bx[j][i-1] + domain->Bx[j-1][i-1]);
-      }
-    }
-    /* Increment the Bx and By components. */
-    for (j = 0; j < domain->ny-1; j++) {
-      for (i = 0; i < domain->nx-1; i++) {
-	domain->Bx[j][i] = domain->Bdamping[j][i]*domain->Bx[j][i]
-	  - dt_dx*(domain->Ez[j+1][i+1] - domain->Ez[j][i+1]);
-	domain->By[j][i] = domain->Bdamping[j][i]*domain->By[j][i]
-	  - dt_dx*(domain->Ez[j+1][i] - domain->Ez[j+1][i+1]);
-      }
-    }
-  }
-  /* If wave has a horizontally polarized component. */
-  if (domain->mode & MW_MODE_EXY) {
-    /* Increment the Bz component. */
-    for (j = 1; j < domain->ny-1; j++) {
-      for (i = 1; i < domain->nx-1; i++) {
-	domain->Bz[j][i] = domain->Bdamping[j][i]*domain->Bz[j][i]
-	  - dt_dx*(domain->Ey[j-1][i] - domain->Ey[j-1][i-1]
-		   - domain->Ex[j][i-1] + domain->Ex[j-1][i-1]);
-      }
-    }
-  }
-
-  /* Is a parallel calculation required for vacuum? */
-  if (domain->mode & MW_MODE_VACUUM) {
-    if (domain->mode & MW_MODE_EXY) {
-      /* Increment the Ex and Ey components. */
-      for (j = 0; j < domain->ny-1; j++) {
-	for (i = 0; i < domain->nx-1; i++) {
-	  domain->Ex_vacuum[j][i]
-	    = domain->Bdamping[j][i]*domain->Ex_vacuum[j][i]
-	    + domain->dt*(domain->forcingI[j][i]*domain->Ex_forcingI
-			  -domain->forcingQ[j][i]*domain->Ex_forcingQ)
-	    + Eprefix_vacuum
-	    *(domain->Bz_vacuum[j+1][i+1] - domain->Bz_vacuum[j][i+1]);
-	  domain->Ey_vacuum[j][i]
-	    = domain->Bdamping[j][i]*domain->Ey_vacuum[j][i]
-	    + domain->dt*(domain->forcingI[j][i]*domain->Ey_forcingI
-			  -domain->forcingQ[j][i]*domain->Ey_forcingQ)
-	    + Eprefix_vacuum
-	    *(domain->Bz_vacuum[j+1][i] - domain->Bz_vacuum[j+1][i+1]);
+  for (m = 0; m < nmembers; m++) {
+    mw_grow_active(members+m, 1);
+  }
+
+#pragma omp parallel if (members->ny >= 2*members->nthreads)
+  {
+    int j, j0, j1, m;
+    int nx = members->nx;
+    mw_thread_rows(members->ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      for (m = 0; m < nmembers; m++) {
+	mwDomain *domain = members+m;
+	if (tm) {
+	  mw_step_tm_E(domain, &domain->forcing, j, 0, nx, MW_PART_ALL);
+	}
+	if (te) {
+	  mw_step_te_E(domain, &domain->forcing, j, 0, nx, MW_PART_ALL);
 	}
       }
+      if (tm) {
+	mw_wrap_tm_E(members, nmembers, j);
+      }
+      if (te) {
+	mw_wrap_te_E(members, nmembers, j);
+      }
+    }
+#pragma omp barrier
+    if (members->symmetry_y) {
+#pragma omp single
+      mw_mirror_E_rows(members, nmembers);
     }
-    /* If wave has a vertically polarized component... */
-    if (domain->mode & MW_MODE_EZ) {
-      /* Increment the Ez component. */
-      for (j = 1; j < domain->ny-1; j++) {
-	for (i = 1; i < domain->nx-1; i++) {
-	  domain->Ez_vacuum[j][i]
-	    = domain->Bdamping[j][i]*domain->Ez_vacuum[j][i]
-	    + domain->dt*(domain->forcingI[j][i]*domain->Ez_forcingI
-			  -domain->forcingQ[j][i]*domain->Ez_forcingQ)
-	    + Eprefix_vacuum
-	    *(domain->By_vacuum[j-1][i] - domain->By_vacuum[j-1][i-1]
-	      - domain->Bx_vacuum[j][i-1] + domain->Bx_vacuum[j-1][i-1]);
+    for (j = j0; j < j1; j++) {
+      for (m = 0; m < nmembers; m++) {
+	if (tm) {
+	  mw_step_tm_B(members+m, j, 0, nx, MW_PART_ALL);
 	}
+	if (te) {
+	  mw_step_te_B(members+m, j, 0, nx, MW_PART_ALL);
+	}
+      }
+      if (tm) {
+	mw_wrap_tm_B(members, nmembers, j);
+      }
+      if (te) {
+	mw_wrap_te_B(members, nmembers, j);
       }
-      /* Increment the Bx and By components. */
-      for (j = 0; j < domain->ny-1; j++) {
-	for (i = 0; i < domain->nx-1; i++) {
-	  domain->Bx_vacuum[j][i]
-	    = domain->Bdamping[j][i]*domain->Bx_vacuum[j][i]
-	    - dt_dx*(domain->Ez_vacuum[j+1][i+1] - domain->Ez_vacuum[j][i+1]);
-	  domain->By_vacuum[j][i]
-	    = domain->Bdamping[j][i]*domain->By_vacuum[j][i]
-	    - dt_dx*(domain->Ez_vacuum[j+1][i] - domain->Ez_vacuum[j+1][i+1]);
+    }
+    if (members->symmetry_y) {
+#pragma omp barrier
+#pragma omp single
+      mw_mirror_B_rows(members, nmembers);
+    }
+    if (poynting) {
+#pragma omp barrier
+      for (j = j0; j < j1; j++) {
+	for (m = 0; m < nmembers; m++) {
+	  if (tm) {
+	    mw_poynting_tm(members+m, j);
+	  }
+	  if (te) {
+	    mw_poynting_te(members+m, j);
+	  }
 	}
       }
     }
-    /* If wave has a horizontally polarized component. */
-    if (domain->mode & MW_MODE_EXY) {
-      /* Increment the Bz component. */
-      for (j = 1; j < domain->ny-1; j++) {
-	for (i = 1; i < domain->nx-1; i++) {
-	  domain->Bz_vacuum[j][i]
-	    = domain->Bdamping[j][i]*domain->Bz_vacuum[j][i]
-	    - dt_dx*(domain->Ey_vacuum[j-1][i] - domain->Ey_vacuum[j-1][i-1]
-	     - domain->Ex_vacuum[j][i-1] + domain->Ex_vacuum[j-1][i-1]);
+  }
+
+  for (m = 0; m < nmembers; m++) {
+    members[m].time += members[m].dt;
+  }
+}
+
+/* Move the E and B fields forward one timestep */
+int
+mw_step(mwDomain *domain)
+{
+  return mw_step_ensemble(domain, 1, 0);
+}
+
+/* Move the E and B fields of the members of an ensemble forward one
+   timestep, and if "poynting" is true add the Poynting vector at the
+   end of it to the summation */
+int
+mw_step_ensemble(mwDomain *members, int nmembers, int poynting)
+{
+  int m;
+  for (m = 0; m < nmembers; m++) {
+    MW_CHECK(mw_init_coefficients(members+m));
+  }
+  if (members->subgrid) {
+    /* The patches (see mw_subgrid.c) catch up with the domain and then
+       replace its fields within them, after which the Poynting vector
+       can be added; there is only ever one member */
+    mw_save_subgrid(members);
+    step(members, 1, 0);
+    MW_CHECK(mw_step_subgrid(members));
+    if (poynting) {
+#pragma omp parallel
+      {
+	int j, j0, j1;
+	mw_thread_rows(members->ny, &j0, &j1);
+	for (j = j0; j < j1; j++) {
+	  if (members->mode & MW_MODE_EZ) {
+	    mw_poynting_tm(members, j);
+	  }
+	  if (members->mode & MW_MODE_EXY) {
+	    mw_poynting_te(members, j);
+	  }
 	}
       }
     }
   }
-  domain->time += domain->dt;
+  else if (members->kernels4 || members->symmetry_y) {
+    step_unfused(members, nmembers, poynting);
+  }
+  else {
+    step(members, nmembers, poynting);
+  }
   return MW_SUCCESS;
 }
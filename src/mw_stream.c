@@ -0,0 +1,178 @@
+/* mw_stream.c -- Advance the independent sub-problems of a domain
+   concurrently on separate groups of threads
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* In 2D the Ez/Bx/By fields (TM) and the Ex/Ey/Bz fields (TE) do not
+   interact, and nor do the main fields and those of the parallel
+   simulation in vacuum until the scattered field is computed, so a
+   domain consists of up to four independent "streams". mw_step
+   advances them all in each pass through the rows, with every thread
+   working on its own band of rows and all threads meeting at a
+   barrier twice per timestep. Here instead the threads are divided
+   into one group per stream, and each group advances its stream
+   through all the timesteps of a frame, meeting only the other
+   threads of its group. All the groups meet at the end of the frame,
+   when the Poynting vector (which needs both the main and vacuum
+   fields) is calculated. With more streams than threads, each group
+   advances several streams one after another. The results are
+   identical to calling mw_step repeatedly. */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "maxwell.h"
+
+/* Polarizations */
+#define TM 0
+#define TE 1
+
+/* Advance the fields of polarization "pol" in the parts of the domain
+   in "parts" through nsteps timesteps using nthreads threads, with
+   forcing[t] being the forcing for timestep t. The rows are divided
+   into bands as in mw_step, and as there the B rows at the bottom of
+   each band, which depend on E in the band below, are left until all
+   threads of the group have finished their pass; with the
+   fourth-order stencil E is incremented in the whole band before B,
+   as in mw_step. */
+static
+void
+advance_stream(mwDomain *domain, mwForcing *forcing, int nsteps,
+	       int pol, int parts, int nthreads)
+{
+#pragma omp parallel num_threads(nthreads) if (domain->ny >= 2*nthreads)
+  {
+    int j, j0, j1, t;
+    int nx = domain->nx;
+    /* The threads of a nested team may be new */
+    mw_thread_denormals();
+    mw_thread_rows(domain->ny, &j0, &j1);
+    for (t = 0; t < nsteps; t++) {
+      if (domain->kernels4) {
+	for (j = j0; j < j1; j++) {
+	  if (pol == TM) {
+	    mw_step_tm_E(domain, forcing+t, j, 0, nx, parts);
+	  }
+	  else {
+	    mw_step_te_E(domain, forcing+t, j, 0, nx, parts);
+	  }
+	}
+#pragma omp barrier
+	for (j = j0; j < j1; j++) {
+	  if (pol == TM) {
+	    mw_step_tm_B(domain, j, 0, nx, parts);
+	  }
+	  else {
+	    mw_step_te_B(domain, j, 0, nx, parts);
+	  }
+	}
+#pragma omp barrier
+	continue;
+      }
+      for (j = j0; j < j1; j++) {
+	if (pol == TM) {
+	  mw_step_tm_E(domain, forcing+t, j, 0, nx, parts);
+	  if (j > j0) {
+	    mw_step_tm_B(domain, j-1, 0, nx, parts);
+	  }
+	}
+	else {
+	  mw_step_te_E(domain, forcing+t, j, 0, nx, parts);
+	  if (j > j0) {
+	    mw_step_te_B(domain, j, 0, nx, parts);
+	  }
+	}
+      }
+#pragma omp barrier
+      if (pol == TM) {
+	mw_step_tm_B(domain, j0-1, 0, nx, parts);
+      }
+      else {
+	mw_step_te_B(domain, j0, 0, nx, parts);
+      }
+#pragma omp barrier
+    }
+  }
+}
+
+/* Move the E and B fields forward nsteps timesteps, advancing the
+   streams of the domain concurrently and updating the forcing each
+   timestep. If there is only one stream or one thread then mw_step is
+   simply called nsteps times. */
+int
+mw_step_streams(mwDomain *domain, int nsteps)
+{
+  mwForcing forcing[MW_MINOR_STEPS];
+  int pol[4], parts[4];
+  int nstreams = 0, ngroups, l;
+
+  /* List the streams */
+  for (l = TM; l <= TE; l++) {
+    if (domain->mode & (l == TM ? MW_MODE_EZ : MW_MODE_EXY)) {
+      pol[nstreams] = l;
+      parts[nstreams++] = MW_PART_MAIN;
+      if (domain->mode & MW_MODE_VACUUM) {
+	pol[nstreams] = l;
+	parts[nstreams++] = MW_PART_VACUUM;
+      }
+    }
+  }
+
+  if (nsteps > MW_MINOR_STEPS || nstreams < 2 || domain->nthreads < 2) {
+    for (l = 0; l < nsteps; l++) {
+      mw_set_forcing(domain);
+      MW_CHECK(mw_step(domain));
+    }
+    return MW_SUCCESS;
+  }
+
+  MW_CHECK(mw_init_coefficients(domain));
+
+  /* Compute the forcing for each timestep in advance */
+  for (l = 0; l < nsteps; l++) {
+    mw_set_forcing(domain);
+    forcing[l] = domain->forcing;
+    domain->time += domain->dt;
+  }
+
+  /* The streams cannot share the enlargement of the active region at
+     each timestep, so it is enlarged for all the timesteps at once as
+     in mw_step_blocked */
+  mw_grow_active(domain, nsteps);
+
+  ngroups = nstreams < domain->nthreads ? nstreams : domain->nthreads;
+#ifdef _OPENMP
+  omp_set_max_active_levels(2);
+#endif
+
+#pragma omp parallel num_threads(ngroups)
+  {
+    int group = 0, k, nthreads;
+#ifdef _OPENMP
+    group = omp_get_thread_num();
+#endif
+    /* Share out the threads as evenly as possible */
+    nthreads = (domain->nthreads*(group+1))/ngroups
+      - (domain->nthreads*group)/ngroups;
+    for (k = group; k < nstreams; k += ngroups) {
+      advance_stream(domain, forcing, nsteps, pol[k], parts[k], nthreads);
+    }
+  }
+
+  return MW_SUCCESS;
+}
@@ -0,0 +1,95 @@
+/* mw_subnormal.c -- Count the subnormal numbers in the fields
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include "maxwell.h"
+
+/* A number is subnormal if its exponent bits are all zero but its
+   mantissa is not. The bits are tested directly because a comparison
+   with the smallest normal number would see zero if subnormal inputs
+   are being treated as zero. */
+#ifdef MW_DOUBLE
+typedef uint64_t real_bits;
+#define EXPONENT_BITS 0x7ff0000000000000ULL
+#define MANTISSA_BITS 0x000fffffffffffffULL
+#else
+typedef uint32_t real_bits;
+#define EXPONENT_BITS 0x7f800000U
+#define MANTISSA_BITS 0x007fffffU
+#endif
+
+/* Return the number of subnormal values in a field */
+long
+mw_count_subnormals(real **field, int nx, int ny)
+{
+  long count = 0;
+  if (!field) {
+    return 0;
+  }
+#pragma omp parallel reduction(+:count)
+  {
+    int i, j, j0, j1;
+    mw_thread_rows(ny, &j0, &j1);
+    for (j = j0; j < j1; j++) {
+      for (i = 0; i < nx; i++) {
+	real_bits bits;
+	memcpy(&bits, field[j]+i, sizeof(bits));
+	count += !(bits & EXPONENT_BITS) && (bits & MANTISSA_BITS);
+      }
+    }
+  }
+  return count;
+}
+
+/* Write one line to "file" giving the fraction of the values of each
+   field that are subnormal. Called every "subnormal_interval" frames,
+   this shows whether the decaying fields are slowing the simulation
+   down when flush_denormals is 0. */
+int
+mw_report_subnormals(FILE *file, mwDomain *domain)
+{
+  const char *names[] = { "Ez", "Bx", "By", "Ex", "Ey", "Bz",
+			  "Ez_vacuum", "Bx_vacuum", "By_vacuum",
+			  "Ex_vacuum", "Ey_vacuum", "Bz_vacuum" };
+  real **fields[12];
+  double n = (double) domain->nx * domain->ny;
+  int k;
+  fields[0] = domain->Ez;
+  fields[1] = domain->Bx;
+  fields[2] = domain->By;
+  fields[3] = domain->Ex;
+  fields[4] = domain->Ey;
+  fields[5] = domain->Bz;
+  fields[6] = domain->Ez_vacuum;
+  fields[7] = domain->Bx_vacuum;
+  fields[8] = domain->By_vacuum;
+  fields[9] = domain->Ex_vacuum;
+  fields[10] = domain->Ey_vacuum;
+  fields[11] = domain->Bz_vacuum;
+  fprintf(file, "\nSubnormal fraction at frame %d:", domain->iframe);
+  for (k = 0; k < 12; k++) {
+    if (fields[k]) {
+      fprintf(file, " %s %.2e", names[k],
+	      mw_count_subnormals(fields[k], domain->nx, domain->ny)/n);
+    }
+  }
+  fprintf(file, "\n");
+  return MW_SUCCESS;
+}
@@ -0,0 +1,303 @@
+/* mw_symmetry.c -- Mirror-symmetry planes at the left and bottom edges
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* If the scene and its oscillators are symmetric about the line x=0
+   then the fields are either symmetric or antisymmetric about it, and
+   only the half x >= 0 need be simulated; likewise for y=0, so a
+   scene symmetric about both needs only a quarter of the memory and
+   time. The plane of symmetry then acts as a perfect magnetic
+   conductor (PMC) if the E field parallel to it is symmetric, which
+   is the case for a line or point oscillator of Ez on the plane, or
+   as a perfect electric conductor (PEC) if it is antisymmetric.
+   Across a PEC plane the tangential components of E and the normal
+   component of B change sign, and the others do not; across a PMC
+   plane it is the other way round.
+
+   The plane is MW_HALO pixels inside the domain, at column (or row)
+   MW_HALO, which is column (or row) x_pixels/2 of the full domain.
+   The pixels to the left of it are mirror images of those to the
+   right, set as soon as each row has been updated, so that the
+   stencils of the pixels on and right of the plane read the right
+   values without any special case in the kernels; the mirror images
+   themselves are updated by the kernels too, but then overwritten.
+   The components are staggered, so the image of element i of a
+   component whose position is i+o/2 pixels along the axis (o=0, 1 or
+   2, see below) is element 2*MW_HALO-i-o, and a component that is
+   odd across the plane is zero on it.
+
+   A plane along y=0 couples the rows, so the whole of each row below
+   the plane is set from the row above it after all the rows have
+   been updated, by the unfused stepper in mw_step.c. */
+
+#include "maxwell.h"
+
+/* The kinds of field that are mirrored together */
+#define MIRROR_TM_E 0
+#define MIRROR_TM_B 1
+#define MIRROR_TE_E 2
+#define MIRROR_TE_B 3
+
+/* One component of the fields: its direction (0, 1 or 2 for x, y or
+   z) and whether it is magnetic */
+typedef struct {
+  real **field;
+  int direction;
+  int magnetic;
+} mirrorComponent;
+
+/* Store the components of the specified kind in "components", those
+   of the main domain if "parts" contains MW_PART_MAIN and of the
+   parallel simulation in vacuum if it contains MW_PART_VACUUM, and
+   return how many there are */
+static
+int
+mirror_components(mwDomain *domain, int kind, int parts,
+		  mirrorComponent *components)
+{
+  int vacuum = (domain->mode & MW_MODE_VACUUM) && (parts & MW_PART_VACUUM);
+  int n = 0, p;
+  for (p = 0; p < 2; p++) {
+    if (p == 0 ? !(parts & MW_PART_MAIN) : !vacuum) {
+      continue;
+    }
+    switch (kind) {
+    case MIRROR_TM_E:
+      components[n].field = p ? domain->Ez_vacuum : domain->Ez;
+      components[n].direction = 2;
+      components[n++].magnetic = 0;
+      break;
+    case MIRROR_TM_B:
+      components[n].field = p ? domain->Bx_vacuum : domain->Bx;
+      components[n].direction = 0;
+      components[n++].magnetic = 1;
+      components[n].field = p ? domain->By_vacuum : domain->By;
+      components[n].direction = 1;
+      components[n++].magnetic = 1;
+      break;
+    case MIRROR_TE_E:
+      components[n].field = p ? domain->Ex_vacuum : domain->Ex;
+      components[n].direction = 0;
+      components[n++].magnetic = 0;
+      components[n].field = p ? domain->Ey_vacuum : domain->Ey;
+      components[n].direction = 1;
+      components[n++].magnetic = 0;
+      break;
+    default:
+      components[n].field = p ? domain->Bz_vacuum : domain->Bz;
+      components[n].direction = 2;
+      components[n++].magnetic = 1;
+    }
+  }
+  return n;
+}
+
+/* Return the position of element i of a component along an axis (0
+   for x, 1 for y), as i+offset/2 pixels: Ez and Bz are at the
+   corners of the pixels, Bx[j][i] and Ex[j][i] at (i+1,j+1/2), and
+   By[j][i] and Ey[j][i] at (i+1/2,j+1), following the kernels */
+static
+int
+offset(const mirrorComponent *component, int axis)
+{
+  if (component->direction == 2) {
+    return 0;
+  }
+  return component->direction == axis ? 2 : 1;
+}
+
+/* Return 1 if a component in "direction" (0, 1 or 2 for x, y or z),
+   magnetic or not, changes sign across a plane of the specified kind
+   normal to "axis", 0 otherwise */
+static
+int
+odd(int symmetry, int axis, int direction, int magnetic)
+{
+  return (symmetry == MW_SYMMETRY_PEC) ^ (direction == axis) ^ magnetic;
+}
+
+/* Set the elements of "row" to the left of the plane at MW_HALO to
+   the images of those to the right, for a component at offset o */
+static
+void
+mirror_row(real *row, int o, int odd)
+{
+  int i;
+  for (i = 0; 2*i+o < 2*MW_HALO; i++) {
+    row[i] = odd ? -row[2*MW_HALO-i-o] : row[2*MW_HALO-i-o];
+  }
+  if (odd && o != 1) {
+    row[MW_HALO-o/2] = 0.0;
+  }
+}
+
+/* Mirror the columns of row j of the fields of the specified kind
+   across the plane along the left edge, if there is one */
+static
+void
+mirror_columns(mwDomain *domain, int kind, int j, int parts)
+{
+  mirrorComponent components[4];
+  int l, n;
+  if (!domain->symmetry_x || j < 0 || j >= domain->ny) {
+    return;
+  }
+  n = mirror_components(domain, kind, parts, components);
+  for (l = 0; l < n; l++) {
+    mirrorComponent *c = components+l;
+    mirror_row(c->field[j], offset(c, 0),
+	       odd(domain->symmetry_x, 0, c->direction, c->magnetic));
+  }
+}
+
+/* Mirror the rows of the fields of the specified kinds across the
+   plane along the bottom edge, if there is one, in each of the
+   nmembers domains in "members". Whole rows are copied, including
+   their ghost columns, so the corners below a plane along the left
+   edge, or beyond a periodic edge, are set too. */
+static
+void
+mirror_rows(mwDomain *members, int nmembers, int kind1, int kind2)
+{
+  mirrorComponent components[8];
+  int m, l, n, i, j;
+  if (!members->symmetry_y) {
+    return;
+  }
+  for (m = 0; m < nmembers; m++) {
+    mwDomain *domain = members+m;
+    int tm = domain->mode & MW_MODE_EZ;
+    int te = domain->mode & MW_MODE_EXY;
+    n = 0;
+    if (tm) {
+      n += mirror_components(domain, kind1, MW_PART_ALL, components+n);
+    }
+    if (te) {
+      n += mirror_components(domain, kind2, MW_PART_ALL, components+n);
+    }
+    for (l = 0; l < n; l++) {
+      mirrorComponent *c = components+l;
+      int o = offset(c, 1);
+      int sign = odd(domain->symmetry_y, 1, c->direction, c->magnetic)
+	? -1 : 1;
+      for (j = 0; 2*j+o < 2*MW_HALO; j++) {
+	real *row = c->field[j], *image = c->field[2*MW_HALO-j-o];
+	for (i = -MW_HALO; i < domain->nx+MW_HALO; i++) {
+	  row[i] = sign*image[i];
+	}
+      }
+      if (sign < 0 && o != 1) {
+	real *row = c->field[MW_HALO-o/2];
+	for (i = -MW_HALO; i < domain->nx+MW_HALO; i++) {
+	  row[i] = 0.0;
+	}
+      }
+    }
+  }
+}
+
+/* Mirror row j of Ez across the plane along the left edge */
+void
+mw_mirror_tm_E(mwDomain *domain, int j, int parts)
+{
+  mirror_columns(domain, MIRROR_TM_E, j, parts);
+}
+
+/* Mirror row j of Bx and By */
+void
+mw_mirror_tm_B(mwDomain *domain, int j, int parts)
+{
+  mirror_columns(domain, MIRROR_TM_B, j, parts);
+}
+
+/* Mirror row j of Ex and Ey */
+void
+mw_mirror_te_E(mwDomain *domain, int j, int parts)
+{
+  mirror_columns(domain, MIRROR_TE_E, j, parts);
+}
+
+/* Mirror row j of Bz */
+void
+mw_mirror_te_B(mwDomain *domain, int j, int parts)
+{
+  mirror_columns(domain, MIRROR_TE_B, j, parts);
+}
+
+/* Mirror the rows of the E field below the plane along the bottom
+   edge, once every row has been updated */
+void
+mw_mirror_E_rows(mwDomain *members, int nmembers)
+{
+  mirror_rows(members, nmembers, MIRROR_TM_E, MIRROR_TE_E);
+}
+
+/* Mirror the rows of the B field below the plane along the bottom
+   edge */
+void
+mw_mirror_B_rows(mwDomain *members, int nmembers)
+{
+  mirror_rows(members, nmembers, MIRROR_TM_B, MIRROR_TE_B);
+}
+
+/* Store in nx and ny the size of the full domain of which "domain"
+   is a half or a quarter: x_pixels and y_pixels in the configuration,
+   the plane of symmetry being at column nx/2 and/or row ny/2 */
+void
+mw_full_size(const mwDomain *domain, int *nx, int *ny)
+{
+  *nx = domain->symmetry_x ? 2*(domain->nx-MW_HALO) : domain->nx;
+  *ny = domain->symmetry_y ? 2*(domain->ny-MW_HALO) : domain->ny;
+}
+
+/* Return the column (axis 0) or row (axis 1) of "domain" holding
+   column or row k of the full domain, and set *mirrored to 1 if it is
+   the mirror image, 0 otherwise. Column 0 of the full domain, whose
+   image would lie beyond the opposite edge, is shown as that edge. */
+int
+mw_unfold(const mwDomain *domain, int axis, int k, int *mirrored)
+{
+  int n = axis ? domain->ny : domain->nx;
+  int centre = n-MW_HALO;
+  *mirrored = 0;
+  if (!(axis ? domain->symmetry_y : domain->symmetry_x)) {
+    return k;
+  }
+  else if (k >= centre) {
+    return k-centre+MW_HALO;
+  }
+  *mirrored = 1;
+  k = centre-k+MW_HALO;
+  return k < n ? k : n-1;
+}
+
+/* Return the bits MW_ODD_X and/or MW_ODD_Y if the component of E (or
+   of B if "magnetic") in "direction" (0, 1 or 2 for x, y or z)
+   changes sign across the planes of symmetry of "domain" */
+int
+mw_parity(const mwDomain *domain, int direction, int magnetic)
+{
+  int parity = 0;
+  if (domain->symmetry_x && odd(domain->symmetry_x, 0, direction, magnetic)) {
+    parity |= MW_ODD_X;
+  }
+  if (domain->symmetry_y && odd(domain->symmetry_y, 1, direction, magnetic)) {
+    parity |= MW_ODD_Y;
+  }
+  return parity;
+}
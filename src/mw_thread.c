@@ -0,0 +1,106 @@
+/* mw_thread.c -- Divide the work of the simulation between threads
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk> 
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+#include "maxwell.h"
+
+/* Whether subnormal numbers are flushed to zero, set by
+   mw_set_flush_denormals */
+static int flush_denormals = 1;
+
+/* Set the number of threads used for all subsequent parallel
+   regions, returning the number actually in use. If nthreads is zero
+   or negative then the OpenMP default is used (usually the number of
+   cores, or OMP_NUM_THREADS if set). Without OpenMP support this
+   always returns 1. */
+int
+mw_set_threads(int nthreads)
+{
+#ifdef _OPENMP
+  if (nthreads > 0) {
+    omp_set_num_threads(nthreads);
+  }
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+/* Find the band of rows [*j0,*j1) of a field with ny rows that
+   belongs to the calling thread. Every loop over rows in a parallel
+   region uses this same partition, so the thread that first touches a
+   page of a field when it is allocated is the one that updates it
+   thereafter, which keeps the memory local on NUMA machines. Outside
+   a parallel region the band is the whole field. */
+void
+mw_thread_rows(int ny, int *j0, int *j1)
+{
+  int ithread = 0;
+  int nthreads = 1;
+#ifdef _OPENMP
+  ithread = omp_get_thread_num();
+  nthreads = omp_get_num_threads();
+#endif
+  *j0 = (ny*ithread)/nthreads;
+  *j1 = (ny*(ithread+1))/nthreads;
+}
+
+/* Apply the setting of mw_set_flush_denormals to the calling thread:
+   if it is true then results that would be subnormal are replaced by
+   zero (FTZ) and subnormal inputs are treated as zero (DAZ). Each
+   thread has its own floating-point control register, and whether
+   the startup code of the program sets these bits depends on whether
+   it was linked with --fast-math, so the threads that run a parallel
+   region of their own call this at its start. */
+void
+mw_thread_denormals()
+{
+#if defined(__SSE__) || defined(__x86_64__)
+  /* Bit 15 of MXCSR is FTZ and bit 6 is DAZ */
+  unsigned int csr = _mm_getcsr() & ~0x8040u;
+  _mm_setcsr(flush_denormals ? (csr | 0x8040u) : csr);
+#elif defined(__aarch64__)
+  /* Bit 24 of FPCR is FZ, which covers both inputs and results */
+  unsigned long fpcr;
+  __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+  fpcr = flush_denormals ? (fpcr | (1UL << 24)) : (fpcr & ~(1UL << 24));
+  __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr));
+#endif
+}
+
+/* Set whether subnormal numbers are flushed to zero in every thread.
+   Decaying fields in the absorbing border and in lossy materials
+   would otherwise pass through the subnormal range, in which
+   arithmetic can be many times slower. Call this after
+   mw_set_threads. */
+void
+mw_set_flush_denormals(int flush)
+{
+  flush_denormals = flush;
+  mw_thread_denormals();
+#pragma omp parallel
+  {
+    mw_thread_denormals();
+  }
+}
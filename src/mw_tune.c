@@ -0,0 +1,217 @@
+/* mw_tune.c -- Store and look up the settings found fastest by the
+   "tune" benchmark for each grid size and mode on this machine
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* This file does not depend on "real" and is compiled only once.
+
+   The cache is a text file with one line per tuned case, e.g.
+
+     256 256 xyz+vacuum float threads=4 kernel=avx2 temporal_blocking=1 block_cols=128
+
+   giving x_pixels, y_pixels, the polarization (with "+vacuum" if the
+   parallel simulation in vacuum is run), the precision and then the
+   config variables to use. Lines starting with "#" are ignored. The
+   file is named after the host, since the best settings depend on its
+   cores and caches, and is kept in the home directory unless the
+   "tuning_file" config variable names another. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "maxwell.h"
+#include "readconfig.h"
+
+/* The longest line of the cache that is understood */
+#define MAX_LINE 1024
+
+/* Write the key of a tuned case to "key", which must have room for
+   MAX_LINE characters */
+static
+void
+tuning_key(char *key, int nx, int ny, int mode, int precision)
+{
+  const char *polarization = "xyz";
+  if (!(mode & MW_MODE_EZ)) {
+    polarization = "xy";
+  }
+  else if (!(mode & MW_MODE_EXY)) {
+    polarization = "z";
+  }
+  snprintf(key, MAX_LINE, "%d %d %s%s %s", nx, ny, polarization,
+	   (mode & MW_MODE_VACUUM) ? "+vacuum" : "",
+	   precision == MW_PRECISION_DOUBLE ? "double" : "float");
+}
+
+/* Return the part of "line" after its key if the key is "key", or
+   NULL otherwise */
+static
+char *
+match_key(char *line, const char *key)
+{
+  int length = strlen(key);
+  if (strncmp(line, key, length) == 0
+      && (line[length] == ' ' || line[length] == '\n'
+	  || line[length] == '\0')) {
+    return line+length;
+  }
+  return NULL;
+}
+
+/* Return the name of the tuning cache, which should be freed with
+   free(), or NULL on error */
+char *
+mw_tuning_file(rc_data *config)
+{
+  char host[256];
+  char *file = rc_get_string(config, "tuning_file");
+  const char *home;
+  if (file) {
+    return file;
+  }
+  if (gethostname(host, sizeof(host)) != 0) {
+    strcpy(host, "localhost");
+  }
+  host[sizeof(host)-1] = '\0';
+  home = getenv("HOME");
+  if (!home) {
+    home = ".";
+  }
+  file = (char*) malloc(strlen(home) + strlen(host) + 32);
+  if (!file) {
+    fprintf(stderr, "Error allocating the name of the tuning cache\n");
+    return NULL;
+  }
+  sprintf(file, "%s/.maxwell2d_tuning.%s", home, host);
+  return file;
+}
+
+/* If the tuning cache has an entry for an nx by ny domain in the
+   given mode and precision, add its settings to "config", except for
+   those that the configuration already sets explicitly. Nothing is
+   done if "use_tuning" is 0 or there is no entry. */
+int
+mw_load_tuning(rc_data *config, int nx, int ny, int mode, int precision)
+{
+  char key[MAX_LINE], line[MAX_LINE];
+  char *file_name;
+  FILE *file;
+  if (rc_exists(config, "use_tuning") && !rc_get_boolean(config, "use_tuning")) {
+    return MW_SUCCESS;
+  }
+  file_name = mw_tuning_file(config);
+  if (!file_name) {
+    return MW_FAILURE;
+  }
+  file = fopen(file_name, "r");
+  if (!file) {
+    free(file_name);
+    return MW_SUCCESS;
+  }
+  tuning_key(key, nx, ny, mode, precision);
+  while (fgets(line, MAX_LINE, file)) {
+    char *setting = match_key(line, key);
+    if (!setting || line[0] == '#') {
+      continue;
+    }
+    fprintf(stderr, "Using the settings tuned for %s from %s:", key, file_name);
+    for (setting = strtok(setting, " \t\n"); setting;
+	 setting = strtok(NULL, " \t\n")) {
+      char *value = strchr(setting, '=');
+      if (!value) {
+	continue;
+      }
+      *value++ = '\0';
+      if (!rc_exists(config, setting)) {
+	if (!rc_register(config, setting, value)) {
+	  fprintf(stderr, "\nError registering tuned config variable \"%s\"\n",
+		  setting);
+	  fclose(file);
+	  free(file_name);
+	  return MW_FAILURE;
+	}
+	fprintf(stderr, " %s=%s", setting, value);
+      }
+    }
+    fprintf(stderr, "\n");
+    break;
+  }
+  fclose(file);
+  free(file_name);
+  return MW_SUCCESS;
+}
+
+/* Store "settings", a space-separated list of name=value pairs, in
+   the tuning cache for an nx by ny domain in the given mode and
+   precision, replacing any earlier entry for the same case */
+int
+mw_save_tuning(rc_data *config, int nx, int ny, int mode, int precision,
+	       const char *settings)
+{
+  char key[MAX_LINE], line[MAX_LINE];
+  char *file_name, *temp_name;
+  FILE *file, *temp;
+  file_name = mw_tuning_file(config);
+  if (!file_name) {
+    return MW_FAILURE;
+  }
+  /* Write the new cache to a temporary file and then rename it, so
+     that a run starting meanwhile sees either the old or the new
+     cache */
+  temp_name = (char*) malloc(strlen(file_name) + 32);
+  if (!temp_name) {
+    fprintf(stderr, "Error allocating the name of the tuning cache\n");
+    free(file_name);
+    return MW_FAILURE;
+  }
+  sprintf(temp_name, "%s.%ld", file_name, (long) getpid());
+  temp = fopen(temp_name, "w");
+  if (!temp) {
+    fprintf(stderr, "Error opening %s\n", temp_name);
+    free(temp_name);
+    free(file_name);
+    return MW_FAILURE;
+  }
+  tuning_key(key, nx, ny, mode, precision);
+  file = fopen(file_name, "r");
+  if (file) {
+    while (fgets(line, MAX_LINE, file)) {
+      if (!match_key(line, key)) {
+	fputs(line, temp);
+      }
+    }
+    fclose(file);
+  }
+  else {
+    fprintf(temp, "# Settings found fastest by \"maxwell2d_benchmark benchmark=tune\":\n"
+	    "# x_pixels y_pixels polarization precision name=value ...\n");
+  }
+  fprintf(temp, "%s %s\n", key, settings);
+  if (fclose(temp) != 0 || rename(temp_name, file_name) != 0) {
+    fprintf(stderr, "Error writing %s\n", file_name);
+    remove(temp_name);
+    free(temp_name);
+    free(file_name);
+    return MW_FAILURE;
+  }
+  fprintf(stderr, "Stored the settings for %s in %s\n", key, file_name);
+  free(temp_name);
+  free(file_name);
+  return MW_SUCCESS;
+}
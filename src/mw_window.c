@@ -0,0 +1,130 @@
+/* mw_window.c -- Move the domain along y with a travelling pulse
+
+   Copyright (C) 2008 Robin Hogan <r.j.hogan@reading.ac.uk>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "maxwell.h"
+
+/* A pulse travelling along a long guide only excites the part of it
+   that it has reached, so rather than allocating and stepping the
+   whole length the domain can be a window that moves along y with
+   the pulse, at "window_speed" times c once "window_delay" has
+   elapsed. After each frame in which the window has advanced by one
+   or more whole rows, the fields and the scene are moved that many
+   rows down: the rows that fall off the bottom are discarded, and the
+   shapes are added to the rows exposed at the top, which start with
+   no field. The absorbing border stays with the window, and so does
+   the Poynting vector summation, which is therefore the mean over
+   the frames of the pixels at each position relative to the
+   window. */
+
+/* Move a field down by nrows if it has been allocated */
+static
+void
+shift_field(mwDomain *domain, real **field, int nrows, real value)
+{
+  if (field) {
+    mw_shift_field(field, domain->nx, domain->ny, nrows, value);
+  }
+}
+
+/* Move the window by the whole number of rows that it has advanced
+   since the last call, if any */
+int
+mw_move_window(mwDomain *domain)
+{
+  int nx = domain->nx, ny = domain->ny;
+  /* The last column is only updated across a periodic edge */
+  int nx_updated = nx - !(domain->periodic & MW_PERIODIC_X);
+  int border = domain->borderwidth;
+  double distance = domain->window_speed*domain->c
+    *(domain->time - domain->window_delay);
+  int nrows, j_new, i, j, status;
+
+  if (distance <= 0.0) {
+    return MW_SUCCESS;
+  }
+  nrows = (int) (distance/domain->dx) - domain->window_offset;
+  if (nrows <= 0) {
+    return MW_SUCCESS;
+  }
+  domain->window_offset += nrows;
+  if (nrows > ny) {
+    nrows = ny;
+  }
+  /* The first of the new rows */
+  j_new = ny - nrows;
+
+  /* The coefficients are created before the first timestep, so they
+     will already exist unless the window moves before it */
+  MW_CHECK(mw_init_coefficients(domain));
+
+  shift_field(domain, domain->Ex, nrows, 0.0);
+  shift_field(domain, domain->Ey, nrows, 0.0);
+  shift_field(domain, domain->Ez, nrows, 0.0);
+  shift_field(domain, domain->Bx, nrows, 0.0);
+  shift_field(domain, domain->By, nrows, 0.0);
+  shift_field(domain, domain->Bz, nrows, 0.0);
+  shift_field(domain, domain->Ex_vacuum, nrows, 0.0);
+  shift_field(domain, domain->Ey_vacuum, nrows, 0.0);
+  shift_field(domain, domain->Ez_vacuum, nrows, 0.0);
+  shift_field(domain, domain->Bx_vacuum, nrows, 0.0);
+  shift_field(domain, domain->By_vacuum, nrows, 0.0);
+  shift_field(domain, domain->Bz_vacuum, nrows, 0.0);
+  shift_field(domain, domain->epsilon, nrows, 1.0);
+  shift_field(domain, domain->Edamping, nrows, 0.0);
+  shift_field(domain, domain->Eprefix, nrows, 1.0);
+  shift_field(domain, domain->boundaries, nrows, 0.0);
+  mw_shift_materials(domain, nrows);
+  mw_shift_conductors(domain, nrows);
+  MW_CHECK(mw_shift_sources(domain, nrows));
+
+  /* The electric-field damping includes the magnetic-field damping
+     of the row it was computed for, which differs from that of its
+     new row if it has moved into the border along the bottom or out
+     of the border along the top. The last row was never converted
+     from the imaginary part of the dielectric constant, so is
+     converted below with the new rows. */
+  for (j = 0; j < j_new-1; j++) {
+    if (j < border || j+nrows >= ny-border) {
+      for (i = 0; i < nx_updated; i++) {
+	domain->Edamping[j][i] = domain->Bdamping[j][i]
+	  *(domain->Edamping[j][i]/domain->Bdamping[j+nrows][i]);
+      }
+      mw_index_materials(domain, j, j+1);
+    }
+  }
+
+  /* Add the shapes to the new rows, which are further along y in the
+     scene than the rows they replace */
+  domain->origin_y -= nrows;
+  domain->shape_j0 = j_new;
+  status = mw_add_shapes(domain->config, domain);
+  domain->shape_j0 = 0;
+  MW_CHECK(status);
+  MW_CHECK(mw_update_coefficients(domain, j_new > 0 ? j_new-1 : 0, ny));
+  MW_CHECK(mw_init_conductors(domain));
+
+  /* The boundaries of the two rows below the new ones depend on
+     them */
+  for (j = (j_new > 2 ? j_new-2 : 0); j < ny; j++) {
+    for (i = 0; i < nx; i++) {
+      domain->boundaries[j][i] = 0.0;
+    }
+  }
+  return mw_find_boundary_rows(domain, j_new-2, ny);
+}